@@ -11,18 +11,36 @@
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
 
 #include "amded.h"
+#include "batch.h"
+#include "cache.h"
 #include "cmdline.h"
+#include "file-source.h"
 #include "file-spec.h"
+#include "http-stream.h"
 #include "info.h"
+#include "io-stream.h"
 #include "list-human.h"
 #include "list-json.h"
 #include "list-machine.h"
+#include "list.h"
 #include "mode.h"
+#include "native.h"
+#include "parallel.h"
+#include "pictures.h"
+#include "prefetch.h"
+#include "server.h"
 #include "setup.h"
 #include "strip.h"
 #include "tag.h"
+#include "tar.h"
 
 #include "bsdgetopt.c"
 
@@ -42,12 +60,12 @@ static void
 amded_failure(void)
 {
     std::cout << PROJECT
-              << ": -m, -j, -l and -t/-d may *not* be used at the same time.\n";
-    exit(EXIT_FAILURE);
+              << ": -m, -j, -J, -l and -t/-d may *not* be used at the same time.\n";
+    amded_exit(EXIT_FAILURE);
 }
 
 /**
- * Check that -m, -l and -t are not used with one another
+ * Check that -m, -j, -J, -l and -t are not used with one another
  *
  * @return      void
  * @sideeffects Exists with EXIT_FAILURE on failure.
@@ -79,10 +97,47 @@ verify_tag_name(enum tag_type type, const std::string &name)
 {
     if (type == TAG_INVALID) {
         std::cerr << PROJECT << ": Invalid tag name: " << '"' << name << "\"\n";
-        exit(EXIT_FAILURE);
+        amded_exit(EXIT_FAILURE);
     }
 }
 
+/**
+ * Parse the argument of the ‘-P’ option
+ *
+ * Zero means: Use as many workers as there are CPUs in the system. Only
+ * plain digits are accepted, as std::stoul() wraps "-1" around.
+ *
+ * @param   arg     the option's argument
+ *
+ * @return      void
+ * @sideeffects Exists with EXIT_FAILURE if ‘arg’ is not a number up to
+ *              AMDED_MAX_THREADS.
+ */
+static void
+setup_jobs(const std::string &arg)
+{
+    unsigned long n = 0;
+    std::size_t idx = 0;
+
+    try {
+        if (!arg.empty() && arg[0] >= '0' && arg[0] <= '9') {
+            n = std::stoul(arg, &idx);
+        }
+    }
+    catch (const std::exception &e) {
+        idx = 0;
+    }
+    if (idx == 0 || idx != arg.size() || n > AMDED_MAX_THREADS) {
+        std::cerr << PROJECT << ": Invalid number of jobs: "
+                  << '"' << arg << "\"\n";
+        amded_exit(EXIT_FAILURE);
+    }
+    if (n == 0) {
+        n = std::thread::hardware_concurrency();
+    }
+    set_jobs(n > 0 ? n : 1);
+}
+
 /**
  * Parsing command line options
  *
@@ -107,18 +162,38 @@ parse_options(int argc, char *argv[])
     enum tag_type type;
     Value tagval;
 
-    while ((opt = bsd_getopt(argc, argv, "d:hjLlmo:R:Ss:t:VW:")) != -1) {
+    while ((opt = bsd_getopt(argc, argv, "0a:Bd:F:f:hJjLlmo:P:R:rSs:T:t:U:VW:")) != -1) {
         switch (opt) {
+        case '0':
+            set_opt(AMDED_FILE_LIST_NUL);
+            break;
+        case 'a':
+            set_archive(optarg);
+            break;
+        case 'B':
+            std::cerr << PROJECT ": -B has to be the only argument."
+                      << std::endl;
+            amded_exit(EXIT_FAILURE);
+        case 'F':
+            setup_fields(optarg);
+            break;
+        case 'f':
+            set_file_list(optarg);
+            break;
         case 'h':
             amded_usage();
-            exit(EXIT_SUCCESS);
+            amded_exit(EXIT_SUCCESS);
         case 'j':
             check_singlemode_ok();
             amded_mode.set(AmdedMode::LIST_JSON);
             break;
+        case 'J':
+            check_singlemode_ok();
+            amded_mode.set(AmdedMode::LIST_JSON_LINES);
+            break;
         case 'L':
             amded_licence();
-            exit(EXIT_SUCCESS);
+            amded_exit(EXIT_SUCCESS);
         case 'l':
             check_singlemode_ok();
             amded_mode.set(AmdedMode::LIST_HUMAN);
@@ -130,9 +205,15 @@ parse_options(int argc, char *argv[])
         case 'o':
             amded_parameters(optarg);
             break;
+        case 'P':
+            setup_jobs(optarg);
+            break;
         case 'R':
             setup_readmap(optarg);
             break;
+        case 'r':
+            set_opt(AMDED_RECURSIVE);
+            break;
         case 's':
             if (strcmp(optarg, "tags") == 0) {
                 list_tags();
@@ -142,7 +223,10 @@ parse_options(int argc, char *argv[])
                 std::cerr << PROJECT << ": Unknown aspect `"
                           << optarg << "'." << std::endl;
             }
-            exit(EXIT_SUCCESS);
+            amded_exit(EXIT_SUCCESS);
+        case 'T':
+            setup_stdin_type(optarg);
+            break;
         case 'd':
             /* ‘-d’ is a special case of the TAG mode. */
             check_multimode_ok();
@@ -164,7 +248,7 @@ parse_options(int argc, char *argv[])
                 std::cerr << PROJECT << ": Broken tag definition: "
                           << '"' << optarg << '"'
                           << std::endl;
-                exit(EXIT_FAILURE);
+                amded_exit(EXIT_FAILURE);
             }
 
             /* Make sure ‘foo’ in "foo=bar" is a supported tag name */
@@ -180,7 +264,7 @@ parse_options(int argc, char *argv[])
                           << tag.first
                           << '"' << '!'
                           << std::endl;
-                exit(EXIT_FAILURE);
+                amded_exit(EXIT_FAILURE);
             }
 
             /* Looks good. Add the tag. */
@@ -191,35 +275,597 @@ parse_options(int argc, char *argv[])
             check_singlemode_ok();
             amded_mode.set(AmdedMode::STRIP);
             break;
+        case 'U':
+            set_server_socket(optarg);
+            break;
         case 'V':
             amded_version();
-            exit(EXIT_SUCCESS);
+            amded_exit(EXIT_SUCCESS);
         case 'W':
             setup_writemap(optarg);
             break;
         default:
             amded_usage();
-            exit(EXIT_FAILURE);
+            amded_exit(EXIT_FAILURE);
         }
     }
 }
 
 /**
- * amded: command line utility for listing and modifying meta
- *         information in audio files
+ * Check, that a file may be read from stdin, before anything is read
  *
- * Interfacing KDE's taglib:
- *   <http://taglib.github.io>
+ * Stdin carries the requests in batch mode, and the file list with ‘-f -’,
+ * so audio data cannot come from there, too. Without ‘-T’, there is no way
+ * to tell what the data is.
+ *
+ * @param   name    name of the file to read
+ * @param   fd      descriptor to read the file from; -1 if there is none
+ *
+ * @return      true if ‘name’ does not refer to stdin, or stdin may be
+ *              read; false otherwise.
+ * @sideeffects Prints a diagnostic to stderr on failure.
+ */
+static bool
+stdin_usable(const std::string &name, int fd)
+{
+    if (name != "-" || fd >= 0) {
+        return true;
+    }
+    if (amded_batch_mode() || get_file_list() == "-"
+        || get_archive() == "-")
+    {
+        std::cerr << PROJECT ": Cannot read audio data from stdin"
+                  << " in batch mode or with a file list or archive on"
+                  << " stdin." << std::endl;
+        return false;
+    }
+    if (get_stdin_type() == FILE_T_INVALID) {
+        std::cerr << PROJECT ": Reading from stdin needs a file type"
+                  << " (see -T)." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Determine a file's type and open it
+ *
+ * The type of data read from stdin (‘-’) is given via ‘-T’; the data is
+ * read from ‘file.stream’, which the caller has to set up.
+ * The type of a URL's file is taken from the URL's path.
+ *
+ * @param   file        amded file handle to fill in
+ * @param   name        name of the file to open
+ * @param   properties  read the file's audio properties, too
+ *
+ * @return      true if the file is ready for processing; false otherwise.
+ * @sideeffects Prints a diagnostic to stderr on failure.
+ */
+static bool
+open_file(struct amded_file &file, const std::string &name, bool properties)
+{
+    file.name = name;
+    if (name == "-") {
+        file.type = get_stdin_type();
+        if (file.type.get_id() == FILE_T_INVALID) {
+            std::cerr << PROJECT ": Reading from stdin needs a file type"
+                      << " (see -T)." << std::endl;
+            return false;
+        }
+        return amded_open(file, properties);
+    }
+    file.type = get_ext_type(amded_is_url(name) ? amded_url_path(name) : name);
+    if (file.type.get_id() == FILE_T_INVALID) {
+        std::cerr << PROJECT ": Unsupported filetype: `"
+                  << file.name << "'" << std::endl;
+        return false;
+    }
+    return amded_open(file, properties);
+}
+
+/**
+ * Print what goes between the records of two files in listing modes
+ *
+ * @param   mode    the listing mode in use
+ * @param   first   true if no record was printed yet; cleared by this
+ * @param   out     stream to print to
+ *
+ * @return      void
+ */
+static void
+list_separator(AmdedMode mode, bool &first, std::ostream &out)
+{
+    if (first) {
+        first = false;
+        return;
+    }
+    switch (mode) {
+    case AmdedMode::LIST_HUMAN:
+        out << std::endl;
+        break;
+    case AmdedMode::LIST_MACHINE:
+        out << ASCII_EOT;
+        break;
+    case AmdedMode::LIST_JSON:
+        out << ',';
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Read the listing data of a file, that is available as a stream
+ *
+ * @param   name        name of the file to list; determines its type
+ * @param   stream      stream to read the file's data from
+ * @param   properties  read the file's audio properties if true
+ * @param   fields      the set of fields to list
+ * @param   data        where to store the file's listing data
+ *
+ * @return      true if ‘data’ was filled in; false otherwise.
+ * @sideeffects Prints a diagnostic to stderr on failure.
+ */
+static bool
+stream_listing(const std::string &name, TagLib::IOStream *stream,
+               bool properties, const amded_fields &fields,
+               struct amded_listing &data)
+{
+    struct amded_file file;
+    file.stream = stream;
+    if (!open_file(file, name, properties)) {
+        return false;
+    }
+    data = amded_list_file(file, fields);
+    delete file.fh;
+    return true;
+}
+
+/**
+ * Read a file's listing data with TagLib
+ *
+ * @param   name        name of the file to list
+ * @param   fd          descriptor to read the file from; -1 to open it by
+ *                      name
+ * @param   properties  read the file's audio properties if true
+ * @param   fields      the set of fields to list
+ * @param   data        where to store the file's listing data
+ * @param   stats       counters to account reads in
+ *
+ * @return      true if ‘data’ was filled in; false otherwise.
+ * @sideeffects Prints a diagnostic to stderr on failure.
+ */
+static bool
+taglib_listing(const std::string &name, int fd, bool properties,
+               const amded_fields &fields, struct amded_listing &data,
+               Amded::IOStats &stats)
+{
+    /* Listing never needs write access (see io-stream.cpp). */
+    std::unique_ptr<TagLib::IOStream> stream =
+        amded_io_stream(name, fd, stats);
+    return stream_listing(name, stream.get(), properties, fields, data);
+}
+
+/**
+ * Check a native reader's listing data against TagLib's (‘native-verify’)
+ *
+ * If the two differ, the differences are reported, and TagLib's data
+ * replaces the native reader's.
+ *
+ * @param   name        name of the listed file
+ * @param   fd          descriptor to read the file from; -1 to open it by
+ *                      name
+ * @param   properties  compare the file's audio properties, too
+ * @param   fields      the set of fields to list
+ * @param   data        the native reader's listing data
+ * @param   stats       counters to account reads in
+ *
+ * @return void
+ */
+static void
+verify_listing(const std::string &name, int fd, bool properties,
+               const amded_fields &fields, struct amded_listing &data,
+               Amded::IOStats &stats)
+{
+    struct amded_listing reference;
+    if (!taglib_listing(name, fd, properties, fields, reference, stats)) {
+        return;
+    }
+    if (!amded_native_verify(name, data, reference)) {
+        data = reference;
+    }
+}
+
+/**
+ * Tell if listings need more of a file's tags than the fields they list
+ *
+ * That is the case with ‘all-tag-blocks’, ‘raw-properties’ and
+ * ‘picture-store’. Neither native readers nor the cache can serve those.
+ */
+static bool
+needs_all_tags(void)
+{
+    return get_opt(AMDED_ALL_TAG_BLOCKS) || get_opt(AMDED_RAW_PROPERTIES)
+        || !get_picture_store().empty();
+}
+
+/**
+ * Warn if ‘max-frame-bytes’ cannot bound what listings read
+ *
+ * The limit only applies to native readers, which ‘max-frame-bytes’ turns
+ * on. Files, that get_listing() reads with TagLib instead, are read in
+ * full: All files with the parameters, that ‘needs_all_tags()’ checks, and
+ * with ‘payload-hash’; all but flac files if audio properties are listed.
+ *
+ * @return      void
+ * @sideeffects Prints a warning to stderr.
+ */
+static void
+check_frame_limit(void)
+{
+    if (get_max_frame_bytes() == 0) {
+        return;
+    }
+    if (needs_all_tags() || get_opt(AMDED_PAYLOAD_HASH)) {
+        std::cerr << PROJECT ": Warning: max-frame-bytes has no effect with"
+                  << " all-tag-blocks, raw-properties, picture-store or"
+                  << " payload-hash; files are read by TagLib in full."
+                  << std::endl;
+    } else if (!get_opt(AMDED_NO_PROPERTIES)
+               && amded_list_wants_properties(get_fields()))
+    {
+        std::cerr << PROJECT ": Warning: max-frame-bytes (which turns on"
+                  << " native-readers) only applies to flac files while"
+                  << " audio properties are listed; use no-properties or"
+                  << " -F to bound reading other files, too." << std::endl;
+    }
+}
+
+/**
+ * Gather the listing data of a file
+ *
+ * If a cache is in use, the data is taken from there if possible. Otherwise
+ * the file is opened and read, and the result is added to the cache.
+ *
+ * Data only gets restricted to the fields selected by ‘-F’ while reading
+ * files, if there is no cache: Cached records have to serve any selection.
+ *
+ * With ‘native-readers’, files are read by a native reader (see native.cpp)
+ * if audio properties are not needed or the reader produces them (FLAC),
+ * and with TagLib otherwise. Native readers only read the selected tag,
+ * and only the properties listings need, so listings need TagLib if
+ * ‘needs_all_tags()’ says so. Payload
+ * hashes (see payload.cpp) are computed from TagLib files, too.
+ *
+ * @param   cache   the listing cache; nullptr if none is used
+ * @param   name    name of the file to list
+ * @param   fd      descriptor to read the file from; -1 to open it by name
+ * @param   data    where to store the file's listing data
+ *
+ * @return      true if ‘data’ was filled in; false otherwise.
+ * @sideeffects Prints a diagnostic to stderr on failure.
+ */
+static bool
+get_listing(Amded::ListCache *cache, const std::string &name, int fd,
+            struct amded_listing &data)
+{
+    if (!stdin_usable(name, fd)) {
+        return false;
+    }
+
+    Amded::CacheKey key;
+    /* Cached records only hold the fields of the selected tag. */
+    bool cacheable = cache != nullptr && !needs_all_tags()
+        && cache->key(name, fd, key);
+    const amded_fields all {};
+    const amded_fields &fields = cacheable ? all : get_fields();
+
+    if (cacheable && cache->lookup(key, data)) {
+        amded_list_project(data, get_fields());
+        return true;
+    }
+
+    const bool properties = !get_opt(AMDED_NO_PROPERTIES)
+        && amded_list_wants_properties(fields);
+    Amded::IOStats stats;
+    bool native = false;
+    struct amded_file file;
+    file.name = name;
+    file.type = get_ext_type(name);
+    if (get_opt(AMDED_NATIVE_READERS) && name != "-"
+        && (!properties || amded_native_has_properties(file))
+        && !amded_is_url(name) && !needs_all_tags()
+        && !get_opt(AMDED_PAYLOAD_HASH))
+    {
+        native = amded_native_open(file, fd, amded_list_keys(fields),
+                                   properties, stats);
+        if (native) {
+            data = amded_list_file(file, fields);
+            delete file.native;
+            if (get_opt(AMDED_NATIVE_VERIFY)) {
+                verify_listing(name, fd, properties, fields, data, stats);
+            }
+        }
+    }
+
+    const bool ok = native
+        || taglib_listing(name, fd, properties, fields, data, stats);
+    amded_io_report(name, stats);
+    if (!ok) {
+        return false;
+    }
+    if (cacheable) {
+        cache->store(key, data);
+        amded_list_project(data, get_fields());
+    }
+    return true;
+}
+
+/**
+ * Print a file's listing data
+ *
+ * @param   mode    the listing mode to print the data in
+ * @param   name    the file's name
+ * @param   data    the file's listing data
+ * @param   out     stream to put the file's record on
+ *
+ * @return      void
+ */
+static void
+list_file(AmdedMode mode, const std::string &name,
+          const struct amded_listing &data, std::ostream &out)
+{
+    switch (mode) {
+    case AmdedMode::LIST_HUMAN:
+        amded_list_human(name, data, out);
+        break;
+    case AmdedMode::LIST_JSON:
+        amded_list_json(name, data, out);
+        break;
+    case AmdedMode::LIST_JSON_LINES:
+        amded_list_json_lines(name, data, out);
+        break;
+    case AmdedMode::LIST_MACHINE:
+        amded_list_machine(name, data, out);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Finish a record, that was put onto stdout
+ *
+ * JSON Lines consumers process records while amded is still running, so
+ * each of them is pushed out immediately. That also leaves intact records
+ * behind if a run is interrupted.
+ *
+ * @return      void
+ */
+static void
+list_record_done(void)
+{
+    if (amded_mode.get() == AmdedMode::LIST_JSON_LINES) {
+        std::cout.flush();
+    }
+}
+
+/**
+ * List the audio files in a tar archive (see ‘-a’)
+ *
+ * The archive is read in a single pass. Members are recognised by their
+ * file name extensions, just like files on the command line; others are
+ * skipped without being read. Recognised members are read into memory and
+ * listed from there, under their path in the archive. Members named like
+ * a file, that was listed before, are skipped if ‘files’ says so.
+ *
+ * @param   tar     the opened archive
+ * @param   name    the archive's name
+ * @param   files   the source of the files listed before the archive
+ * @param   first   true if no record was printed yet
+ *
+ * @return      void
+ * @sideeffects Prints a diagnostic to stderr if the archive is broken.
+ */
+static void
+list_archive(Amded::TarReader &tar, const std::string &name,
+             Amded::FileSource &files, bool &first)
+{
+    const amded_fields &fields = get_fields();
+    const bool properties = !get_opt(AMDED_NO_PROPERTIES)
+        && amded_list_wants_properties(fields);
+    Amded::TarMember member;
+
+    while (tar.next(member)) {
+        if (!member.regular
+            || get_ext_type(member.name) == FILE_T_INVALID
+            || !files.claim(member.name))
+        {
+            continue;
+        }
+        TagLib::ByteVector contents;
+        if (!tar.data(member, contents)) {
+            break;
+        }
+        TagLib::ByteVectorStream stream(contents);
+        struct amded_listing data;
+        if (stream_listing(member.name, &stream, properties, fields, data)) {
+            list_separator(amded_mode.get(), first, std::cout);
+            list_file(amded_mode.get(), member.name, data, std::cout);
+            list_record_done();
+        }
+    }
+    if (tar.is_broken()) {
+        std::cerr << PROJECT ": Broken archive: `" << name << "'"
+                  << std::endl;
+    }
+}
+
+/**
+ * Open the listing cache, if one was configured
+ *
+ * @param   cache   cache object to open
+ *
+ * @return      ‘cache’ if it is ready for use; nullptr otherwise.
+ */
+static Amded::ListCache *
+open_cache(Amded::ListCache &cache)
+{
+    if (get_cache_file().empty()
+        || !cache.open(get_cache_file(), get_opt(AMDED_CACHE_PRUNE)))
+    {
+        return nullptr;
+    }
+    return &cache;
+}
+
+/**
+ * Report cache statistics and close the cache
+ *
+ * @param   cache   the listing cache; nullptr if none is used
+ *
+ * @return      void
+ */
+static void
+close_cache(Amded::ListCache *cache)
+{
+    if (cache == nullptr) {
+        return;
+    }
+    std::cout.flush();
+    cache->report(std::cerr);
+    cache->close();
+}
+
+/**
+ * Determine the listing mode, that a server request asks for
+ *
+ * @param   arg     the request's first argument
+ * @param   mode    where to store the mode
+ *
+ * @return      true if ‘arg’ is a listing option; false otherwise.
+ */
+static bool
+request_mode(const std::string &arg, AmdedMode &mode)
+{
+    if (arg == "-l") {
+        mode = AmdedMode::LIST_HUMAN;
+    } else if (arg == "-m") {
+        mode = AmdedMode::LIST_MACHINE;
+    } else if (arg == "-j") {
+        mode = AmdedMode::LIST_JSON;
+    } else if (arg == "-J") {
+        mode = AmdedMode::LIST_JSON_LINES;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Process one request in server mode
+ *
+ * A request consists of a listing option (-l, -m, -j or -J) and the names of
+ * the files to list. If descriptors were passed along with the request, the
+ * first names belong to those, in order; the names give their types, so
+ * ‘-’ is rejected. Called from worker threads.
+ *
+ * @param   cache   the listing cache; nullptr if none is used
+ * @param   req     the request to process
+ * @param   out     where to store the request's records
+ * @param   err     where to store the request's diagnostics
+ *
+ * @return      EXIT_SUCCESS if the request was processed;
+ *              EXIT_FAILURE if it was malformed.
+ */
+static int
+server_request(Amded::ListCache *cache, const Amded::ServerRequest &req,
+               std::string &out, std::string &err)
+{
+    AmdedMode mode;
+
+    if (req.args.empty() || !request_mode(req.args[0], mode)) {
+        err = PROJECT ": Requests have to start with -l, -m, -j or -J.\n";
+        return EXIT_FAILURE;
+    }
+    if (req.fds.size() > req.args.size() - 1) {
+        err = PROJECT ": Request carries more descriptors than file names.\n";
+        return EXIT_FAILURE;
+    }
+
+    std::ostringstream records;
+    bool first = true;
+    /* JSON objects may not have two members with the same name. */
+    std::set<std::string> listed;
+    if (mode == AmdedMode::LIST_JSON) {
+        amded_json_begin(records);
+    }
+    for (std::size_t i = 1; i < req.args.size(); ++i) {
+        const std::string &name = req.args[i];
+        const int fd = i - 1 < req.fds.size() ? req.fds[i - 1] : -1;
+        /*
+         * The server's stdin is not the client's, and its ‘-T’ does not
+         * tell the type of a client's data. Descriptors are named like
+         * files instead, which gives them their type.
+         */
+        if (name == "-") {
+            err += PROJECT ": `-' cannot be listed in requests; name passed"
+                " descriptors with a file name extension instead.\n";
+            continue;
+        }
+        if (mode == AmdedMode::LIST_JSON && !listed.insert(name).second) {
+            continue;
+        }
+        struct amded_listing data;
+        if (!get_listing(cache, name, fd, data)) {
+            err += PROJECT ": Could not list file: `" + name + "'\n";
+            continue;
+        }
+        list_separator(mode, first, records);
+        list_file(mode, name, data, records);
+    }
+    if (mode == AmdedMode::LIST_JSON) {
+        amded_json_end(records);
+    }
+    out = records.str();
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Serve listing requests on the socket given via ‘-U’
+ *
+ * @return      EXIT_SUCCESS after the server was shut down;
+ *              EXIT_FAILURE if it could not be started.
+ */
+static int
+run_server(void)
+{
+    if (read_map.empty()) {
+        setup_readmap("");
+    }
+
+    Amded::ListCache cache;
+    Amded::ListCache *cachep = open_cache(cache);
+    int rc = amded_serve(get_server_socket(), get_jobs(),
+                         [cachep](const Amded::ServerRequest &req,
+                                  std::string &out, std::string &err) {
+                             return server_request(cachep, req, out, err);
+                         });
+    close_cache(cachep);
+    return rc;
+}
+
+/**
+ * Process the files named in ‘argv’, as configured by the options in there
  *
  * @param   argc    number of entries in *argv[]
- * @param   argv[]  list of arguments at startup.
+ * @param   argv[]  list of arguments
  *
  * @return      EXIT_SUCCESS on normal execution;
  *              EXIT_FAILURE upon failure.
- * @sideeffects none
  */
-int
-main(int argc, char *argv[])
+static int
+amded_run(int argc, char *argv[])
 {
     if (argc < 2) {
         amded_usage();
@@ -228,11 +874,53 @@ main(int argc, char *argv[])
 
     parse_options(argc, argv);
 
-    if (optind == argc) {
+    if (amded_mode.is_list_mode() || amded_batch_mode()
+        || !get_server_socket().empty())
+    {
+        check_frame_limit();
+    }
+
+    if (!get_server_socket().empty()) {
+        if (!amded_mode.is_invalid() || optind != argc
+            || !get_file_list().empty() || amded_batch_mode())
+        {
+            std::cerr << PROJECT ": -U cannot be combined with actions,"
+                      << " files or batch mode." << std::endl;
+            return EXIT_FAILURE;
+        }
+        return run_server();
+    }
+
+    if (optind == argc && get_file_list().empty() && get_archive().empty()) {
         amded_usage();
         return EXIT_FAILURE;
     }
 
+    if (amded_batch_mode() && get_file_list() == "-") {
+        std::cerr << PROJECT ": Cannot read a file list from stdin"
+                  << " in batch mode." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (get_stdin_type() != FILE_T_INVALID
+        && (amded_batch_mode() || get_file_list() == "-"))
+    {
+        std::cerr << PROJECT ": Cannot read audio data from stdin"
+                  << " in batch mode or with a file list on stdin."
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (get_archive() == "-"
+        && (amded_batch_mode() || get_file_list() == "-"
+            || get_stdin_type() != FILE_T_INVALID))
+    {
+        std::cerr << PROJECT ": Cannot read an archive from stdin"
+                  << " in batch mode, with a file list or audio data"
+                  << " on stdin." << std::endl;
+        return EXIT_FAILURE;
+    }
+
     if (amded_mode.is_list_mode()) {
         if (read_map.empty()) {
             setup_readmap("");
@@ -243,59 +931,181 @@ main(int argc, char *argv[])
         }
     }
 
-    bool first = true;
-    for (int i = optind; i < argc; ++i) {
-        struct amded_file file;
-        file.name = argv[i];
-        file.type = get_ext_type(argv[i]);
-        if (file.type.get_id() == FILE_T_INVALID) {
-            std::cerr << PROJECT ": Unsupported filetype: `"
-                      << file.name << "'" << std::endl;
-            continue;
+    if (amded_mode.is_invalid()) {
+        std::cout << "Please use one action option (-m, -l, -t or -S)."
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Amded::FileSource files(argv + optind, argc - optind);
+    if (get_opt(AMDED_RECURSIVE)) {
+        files.set_recursive(get_walk_threads());
+    }
+    /* JSON objects may not have two members with the same name. */
+    if (amded_mode.get() == AmdedMode::LIST_JSON) {
+        files.set_unique();
+    }
+    if (!get_file_list().empty()) {
+        const char delim = get_opt(AMDED_FILE_LIST_NUL) ? '\0' : '\n';
+        if (!files.open_list(get_file_list(), delim)) {
+            std::cerr << PROJECT ": Could not open file list: `"
+                      << get_file_list() << "'" << std::endl;
+            return EXIT_FAILURE;
         }
-        if (!amded_open(file)) {
-            continue;
+    }
+
+    if (!get_picture_store().empty()) {
+        if (!amded_mode.is_list_mode()) {
+            std::cerr << PROJECT ": picture-store only works with listing"
+                      << " modes." << std::endl;
+            return EXIT_FAILURE;
         }
-        switch (amded_mode.get()) {
-        case AmdedMode::LIST_HUMAN:
-            if (!first) {
-                std::cout << std::endl;
-            } else {
-                first = false;
+        if (!amded_picture_store_ok(get_picture_store())) {
+            std::cerr << PROJECT ": Picture store is not a writable"
+                      << " directory: `" << get_picture_store() << "'"
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    Amded::TarReader tar;
+    if (!get_archive().empty()) {
+        if (!amded_mode.is_list_mode()) {
+            std::cerr << PROJECT ": -a only works with listing modes."
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (!tar.open(get_archive())) {
+            std::cerr << PROJECT ": Could not open archive: `"
+                      << get_archive() << "'" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    Amded::ListCache cache;
+    Amded::ListCache *cachep = nullptr;
+    if (amded_mode.is_list_mode()) {
+        cachep = open_cache(cache);
+    }
+
+    if (amded_mode.get() == AmdedMode::LIST_JSON) {
+        amded_json_begin(std::cout);
+    }
+
+    bool first = true;
+    if (amded_mode.is_list_mode() && get_jobs() > 1) {
+        auto emit = [&first](const std::string &record) {
+            list_separator(amded_mode.get(), first, std::cout);
+            std::cout << record;
+            list_record_done();
+        };
+        auto work = [cachep](const std::string &name, std::string &record) {
+            struct amded_listing data;
+            if (!get_listing(cachep, name, -1, data)) {
+                return false;
             }
-            amded_list_human(file);
-            break;
-        case AmdedMode::LIST_JSON:
-            if (first) {
-                first = false;
+            std::ostringstream out;
+            list_file(amded_mode.get(), name, data, out);
+            record = out.str();
+            return true;
+        };
+        amded_list_parallel(files, get_jobs(),
+                            !get_opt(AMDED_COMPLETION_ORDER), work, emit);
+    } else {
+        Amded::Prefetcher prefetcher(files, get_prefetch());
+        std::string name;
+        while (prefetcher.next(name)) {
+            if (amded_mode.is_list_mode()) {
+                struct amded_listing data;
+                if (get_listing(cachep, name, -1, data)) {
+                    list_separator(amded_mode.get(), first, std::cout);
+                    list_file(amded_mode.get(), name, data, std::cout);
+                    list_record_done();
+                }
+                continue;
             }
-            amded_push_json(file);
-            break;
-        case AmdedMode::LIST_MACHINE:
-            if (!first) {
-                std::cout << ASCII_EOT;
+            if (amded_is_url(name)) {
+                std::cerr << PROJECT ": Cannot modify remote file: `"
+                          << name << "'" << std::endl;
+                continue;
+            }
+            struct amded_file file;
+            /* Data from stdin is modified in memory and put onto stdout. */
+            std::unique_ptr<TagLib::ByteVectorStream> input;
+            if (!stdin_usable(name, -1)) {
+                continue;
+            }
+            if (name == "-") {
+                Amded::IOStats stats;
+                input = amded_stdin_stream(stats);
+                file.stream = input.get();
+            }
+            /* Write modes have no use for audio properties. */
+            if (!open_file(file, name, false)) {
+                continue;
+            }
+            if (amded_mode.get() == AmdedMode::TAG) {
+                amded_tag(file);
             } else {
-                first = false;
+                amded_strip(file);
+            }
+            delete file.fh;
+            if (input) {
+                const TagLib::ByteVector *data = input->data();
+                std::cout.write(data->data(), data->size());
+                std::cout.flush();
             }
-            amded_list_machine(file);
-            break;
-        case AmdedMode::TAG:
-            amded_tag(file);
-            break;
-        case AmdedMode::STRIP:
-            amded_strip(file);
-            break;
-        default:
-            std::cout << "Please use one action option (-m, -l, -t or -S)."
-                      << std::endl;
-            return EXIT_FAILURE;
         }
-        delete file.fh;
+    }
+
+    if (!get_archive().empty()) {
+        list_archive(tar, get_archive(), files, first);
     }
 
     if (amded_mode.get() == AmdedMode::LIST_JSON) {
-        amded_list_json();
+        amded_json_end(std::cout);
     }
 
+    close_cache(cachep);
+    amded_rss_report();
     return EXIT_SUCCESS;
 }
+
+/**
+ * Process one request in batch mode
+ *
+ * Nothing is carried over from previous requests: The setup is returned to
+ * its defaults, and option parsing starts over.
+ */
+static int
+batch_request(int argc, char *argv[])
+{
+    amded_mode = {};
+    reset_setup();
+    optind = 1;
+    optreset = 1;
+    return amded_run(argc, argv);
+}
+
+/**
+ * amded: command line utility for listing and modifying meta
+ *         information in audio files
+ *
+ * Interfacing KDE's taglib:
+ *   <http://taglib.github.io>
+ *
+ * @param   argc    number of entries in *argv[]
+ * @param   argv[]  list of arguments at startup.
+ *
+ * @return      EXIT_SUCCESS on normal execution;
+ *              EXIT_FAILURE upon failure.
+ * @sideeffects none
+ */
+int
+main(int argc, char *argv[])
+{
+    if (argc == 2 && strcmp(argv[1], "-B") == 0) {
+        return amded_batch(batch_request);
+    }
+    return amded_run(argc, argv);
+}
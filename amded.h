@@ -12,12 +12,17 @@
 #define INC_AMDED_H
 
 #include <cstdint>
+#include <string>
 
 #include <tfile.h>
 
 #include "file-type.h"
 #include "tag-implementation.h"
 
+namespace Amded {
+    struct NativeTags;
+}
+
 /** the project's (and executable's) name */
 #define PROJECT "amded"
 
@@ -60,8 +65,66 @@
 #define AMDED_JSON_DONT_USE_BASE64     (1 << 2)
 #define AMDED_MACHINE_DONT_USE_BASE64  (1 << 3)
 
+/**
+ * With parallel listing (‘-P’), print records as soon as a worker finishes
+ * them, instead of in command line order.
+ */
+#define AMDED_COMPLETION_ORDER         (1 << 4)
+
+/** File names in the ‘-f’ list are terminated by NUL bytes (‘-0’). */
+#define AMDED_FILE_LIST_NUL            (1 << 5)
+
+/** Search directories for supported files (‘-r’). */
+#define AMDED_RECURSIVE                (1 << 6)
+
+/** Drop cache records of files, that were not listed in this run. */
+#define AMDED_CACHE_PRUNE              (1 << 7)
+
+/** Do not read audio properties (bit-rate, length, ...) in listing modes. */
+#define AMDED_NO_PROPERTIES            (1 << 8)
+
+/** Read tags without TagLib's file classes where possible (see native.cpp). */
+#define AMDED_NATIVE_READERS           (1 << 9)
+
+/** Check native readers' listings against TagLib's, and report differences. */
+#define AMDED_NATIVE_VERIFY            (1 << 10)
+
+/** Report read system calls and bytes read for every listed file. */
+#define AMDED_IO_STATS                 (1 << 11)
+
+/** Report the peak resident set size at the end of a run. */
+#define AMDED_PEAK_RSS                 (1 << 12)
+
+/** List the fields of every tag of multi-tag files, not just the selected. */
+#define AMDED_ALL_TAG_BLOCKS           (1 << 13)
+
+/** List the complete property map of the selected tag, too. */
+#define AMDED_RAW_PROPERTIES           (1 << 14)
+
+/** List a hash of each file's audio payload (see payload.cpp). */
+#define AMDED_PAYLOAD_HASH             (1 << 15)
+
+/** List the MD5 of the audio data, that flac files carry. */
+#define AMDED_STREAM_MD5               (1 << 16)
+
+/** Measure mp3 files by scanning all frames (see mp3-scan.cpp). */
+#define AMDED_ACCURATE_LENGTH          (1 << 17)
+
 #define AMDED_TAG_MAXLENGTH 14
 
+/** Upper bound for worker and walker thread counts (‘-P’, ‘walk-threads’) */
+#define AMDED_MAX_THREADS 1024
+
+/** Upper bound for the number of files prefetched ahead (‘prefetch’) */
+#define AMDED_MAX_PREFETCH 4096
+
+/** How listing modes read files (see ‘io=BACKEND’) */
+enum io_backend {
+    IO_BACKEND_TAGLIB,
+    IO_BACKEND_PREAD,
+    IO_BACKEND_MMAP
+};
+
 enum tag_type {
     TAG_INVALID = -1,
     TAG_STRING,
@@ -93,11 +156,15 @@ enum tag_id {
 };
 
 struct amded_file {
-    char *name;
+    std::string name;
     Amded::FileType type;
     Amded::TagImplementation tagimpl;
     bool multi_tag;
-    TagLib::File *fh;
+    TagLib::File *fh = nullptr;
+    /** If set, the file is read from here instead of being opened by name */
+    TagLib::IOStream *stream = nullptr;
+    /** If set, tags were read by a native reader and ‘fh’ is not used */
+    Amded::NativeTags *native = nullptr;
 };
 
 struct amded_broken_tag_def {};
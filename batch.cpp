@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file batch.cpp
+ * @brief Batch mode: Serving a stream of requests from one process
+ *
+ * With ‘-B’, amded does not process files named on its command line.
+ * Instead, it reads requests from stdin and answers each of them on stdout,
+ * until stdin is closed. Frontends can keep one amded process around as a
+ * coprocess that way, instead of starting a new one for every operation.
+ *
+ * A request is the list of arguments, that would be passed to amded on the
+ * command line (without the program name), every one of them terminated by a
+ * NUL byte. An empty argument ends the request. For example:
+ *
+ * \code
+ * -m\0-o\0show-empty\0foo.mp3\0\0
+ * -t\0artist=Foo\0foo.mp3\0\0
+ * \endcode
+ *
+ * Every request is processed exactly like a separate run of amded with those
+ * arguments would be. No options carry over from one request to the next.
+ * The response to a request is a header line, followed by two blocks of
+ * data:
+ *
+ * \code
+ * <status> <stdout-length> <stderr-length>\n<stdout-data><stderr-data>
+ * \endcode
+ *
+ * ‘status’ is the exit status of the equivalent amded run. The data blocks
+ * hold what that run would have written to stdout and stderr respectively.
+ * Their lengths are given in bytes.
+ *
+ * To make that work, everything that would end the process in a normal run
+ * (like errors in option arguments) calls amded_exit(), which ends only the
+ * current request in batch mode.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "amded.h"
+#include "batch.h"
+
+namespace {
+
+/**
+ * String buffer, that may be written to from multiple threads
+ *
+ * Listing workers (see ‘-P’) write diagnostics to stderr, which is
+ * redirected into one of these while a request is processed.
+ */
+class SyncStringBuf : public std::streambuf {
+public:
+    std::string
+    str(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return data;
+    };
+
+protected:
+    int_type
+    overflow(int_type c) override
+    {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            std::lock_guard<std::mutex> guard(lock);
+            data += traits_type::to_char_type(c);
+        }
+        return traits_type::not_eof(c);
+    };
+
+    std::streamsize
+    xsputn(const char *s, std::streamsize n) override
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        data.append(s, n);
+        return n;
+    };
+
+private:
+    std::string data;
+    std::mutex lock;
+};
+
+} /* anonymous namespace */
+
+static bool batch_active = false;
+
+/**
+ * Terminate the current run of amded
+ *
+ * In batch mode, only the current request is ended.
+ *
+ * @param  status   the run's exit status
+ *
+ * @return Does not return.
+ */
+void
+amded_exit(int status)
+{
+    if (batch_active) {
+        throw Amded::BatchExit{ status };
+    }
+    exit(status);
+}
+
+/**
+ * Tell whether amded runs in batch mode
+ *
+ * @return true while requests are read from stdin; false otherwise.
+ */
+bool
+amded_batch_mode(void)
+{
+    return batch_active;
+}
+
+/**
+ * Read the next request from ‘in’
+ *
+ * @return true if a complete request was read; false at the end of input.
+ */
+static bool
+read_request(std::istream &in, std::vector<std::string> &args)
+{
+    std::string arg;
+
+    args.clear();
+    while (std::getline(in, arg, '\0')) {
+        if (arg.empty()) {
+            return true;
+        }
+        args.push_back(arg);
+    }
+    return false;
+}
+
+/**
+ * Serve requests from stdin until it is closed
+ *
+ * @param  run     function that processes a request; called like main()
+ *
+ * @return EXIT_SUCCESS
+ */
+int
+amded_batch(Amded::BatchRunner run)
+{
+    std::streambuf *out = std::cout.rdbuf();
+    std::streambuf *err = std::cerr.rdbuf();
+    std::vector<std::string> args;
+
+    batch_active = true;
+    while (read_request(std::cin, args)) {
+        std::vector<char *> argv;
+        argv.push_back(const_cast<char *>(PROJECT));
+        for (auto &iter : args) {
+            argv.push_back(&iter[0]);
+        }
+        argv.push_back(nullptr);
+
+        std::stringbuf outbuf;
+        SyncStringBuf errbuf;
+        int status;
+
+        std::cout.rdbuf(&outbuf);
+        std::cerr.rdbuf(&errbuf);
+        try {
+            status = run(argv.size() - 1, argv.data());
+        }
+        catch (const Amded::BatchExit &e) {
+            status = e.status;
+        }
+        std::cout.rdbuf(out);
+        std::cerr.rdbuf(err);
+
+        const std::string o = outbuf.str();
+        const std::string e = errbuf.str();
+        std::cout << status << ' ' << o.size() << ' ' << e.size() << '\n'
+                  << o << e;
+        std::cout.flush();
+    }
+    batch_active = false;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file batch.h
+ * @brief API for amded's batch mode
+ */
+
+#ifndef INC_BATCH_H
+#define INC_BATCH_H
+
+namespace Amded {
+
+    /** Thrown by amded_exit() in batch mode, to end the current request */
+    struct BatchExit {
+        int status;
+    };
+
+    /** Runs one request, with the request's arguments as argc and argv. */
+    using BatchRunner = int (*)(int, char *[]);
+
+}
+
+[[noreturn]] void amded_exit(int);
+bool amded_batch_mode(void);
+int amded_batch(Amded::BatchRunner);
+
+#endif /* INC_BATCH_H */
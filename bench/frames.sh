@@ -0,0 +1,43 @@
+#!/bin/sh
+# Microbenchmark of tag lookups in tags with many frames (see list.cpp)
+#
+# Lists mp3, FLAC, Ogg Vorbis and M4A files, each with a tag holding 500
+# frames or fields besides the usual ones, and prints wall time and peak RSS
+# for each format: The whole listing, and a listing of two fields (-F). Audio
+# properties are left out, so looking up tags is most of the work. Given a
+# second binary, built before listings looked up only the keys they need,
+# the same runs are done with it, to compare against building the complete
+# property map of every tag:
+#
+#   % rev_="$(git log --format=%H --grep='Look up only the listed keys' -1)"
+#   % git worktree add ../amded-propertymap "${rev_}^"
+#   % make -C ../amded-propertymap
+#   % sh bench/frames.sh ./amded ../amded-propertymap/amded
+#
+# Usage: frames.sh [path-to-amded] [path-to-baseline-amded]
+# The environment variables FRAMES and COUNT override the number of frames
+# per tag (500) and the number of files per format (2000).
+
+amded_="${1:-./amded}"
+baseline_="$2"
+here_="$(dirname "$0")"
+dir_="$(mktemp -d)" || exit 1
+trap 'rm -rf "${dir_}"' EXIT INT TERM
+
+frames_="${FRAMES:-500}"
+count_="${COUNT:-2000}"
+python3 "${here_}/../test/fixtures.py" frames "${dir_}" \
+        "${frames_}" "${count_}" || exit 1
+
+for type_ in mp3 flac ogg m4a; do
+    label_="${count_} ${type_} files, ${frames_} frames"
+    for bin_ in "${amded_}" ${baseline_}; do
+        python3 "${here_}/run.py" --files "${dir_}/${type_}" \
+                "${bin_} -j, ${label_}" \
+                "${bin_}" -j -o no-properties || exit 1
+        python3 "${here_}/run.py" --files "${dir_}/${type_}" \
+                "${bin_} -F, ${label_}" \
+                "${bin_}" -j -o no-properties \
+                -F artist,catalog-number || exit 1
+    done
+done
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Benchmark of JSON output over many files (see list-json.cpp)
+#
+# Lists 1000, 10000 and 100000 copies of a tagged mp3 file with -j, and
+# prints wall time and peak RSS for each run. The streaming writer's peak
+# RSS should barely grow with the number of files; the only state it keeps
+# per file is the hash of its name. Given a second binary, built before
+# JSON output was streamed, the same runs are done with it, to compare
+# against jsoncpp, which holds all output in memory until the end:
+#
+#   % rev_="$(git log --format=%H --grep='Stream JSON output' -1)"
+#   % git worktree add ../amded-jsoncpp "${rev_}^"
+#   % make -C ../amded-jsoncpp
+#   % sh bench/json.sh ./amded ../amded-jsoncpp/amded
+#
+# Usage: json.sh [path-to-amded] [path-to-baseline-amded]
+# The COUNTS environment variable overrides the numbers of files.
+
+amded_="${1:-./amded}"
+baseline_="$2"
+here_="$(dirname "$0")"
+dir_="$(mktemp -d)" || exit 1
+trap 'rm -rf "${dir_}"' EXIT INT TERM
+
+for count_ in ${COUNTS:-1000 10000 100000}; do
+    python3 "${here_}/../test/fixtures.py" copies "${dir_}/${count_}" \
+            "${count_}" v23-padded.mp3 || exit 1
+    for bin_ in "${amded_}" ${baseline_}; do
+        python3 "${here_}/run.py" --files "${dir_}/${count_}" \
+                "${bin_} -j, ${count_} files" "${bin_}" -j || exit 1
+    done
+    rm -rf "${dir_:?}/${count_}"
+done
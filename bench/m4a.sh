@@ -0,0 +1,43 @@
+#!/bin/sh
+# Benchmark of the native MP4 reader on large files (see native-mp4.cpp)
+#
+# Lists M4A files with their ‘moov’ atom behind 64 MiB of audio data, once
+# through TagLib and once with ‘native-readers’, and prints wall time and
+# peak RSS for each. Then it prints the reads and bytes each way takes for
+# one of the files (with ‘io=pread’, so TagLib's reads are counted, too).
+#
+# The audio data is written as a hole, so the files are cheap to make, but
+# reading them costs little, too. Set TMPDIR to put them on the storage in
+# question; seeks only really cost on disks and network file systems.
+#
+# Usage: m4a.sh [path-to-amded]
+# The environment variables COUNT and MIB override the number of files (20)
+# and their size in mebibytes (64).
+
+amded_="${1:-./amded}"
+here_="$(dirname "$0")"
+dir_="$(mktemp -d)" || exit 1
+trap 'rm -rf "${dir_}"' EXIT INT TERM
+
+count_="${COUNT:-20}"
+mib_="${MIB:-64}"
+python3 "${here_}/../test/fixtures.py" large-m4a "${dir_}/files" \
+        "${count_}" "${mib_}" || exit 1
+
+label_="${count_} files of ${mib_} MiB"
+python3 "${here_}/run.py" --files "${dir_}/files" \
+        "TagLib, ${label_}" \
+        "${amded_}" -j -o no-properties || exit 1
+python3 "${here_}/run.py" --files "${dir_}/files" \
+        "native-readers, ${label_}" \
+        "${amded_}" -j -o native-readers,no-properties || exit 1
+python3 "${here_}/run.py" --files "${dir_}/files" \
+        "TagLib with properties, ${label_}" \
+        "${amded_}" -j || exit 1
+
+for params_ in io=pread,io-stats,no-properties \
+               io=pread,io-stats,native-readers,no-properties; do
+    printf '%s: ' "${params_}"
+    "${amded_}" -j -o "${params_}" "${dir_}/files/0.m4a" 2>&1 > /dev/null \
+        | sed -e 's/^.*: //'
+done
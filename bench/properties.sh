@@ -0,0 +1,42 @@
+#!/bin/sh
+# Benchmark of reading audio properties, per file type (see amded_open())
+#
+# Lists mp3 (without a Xing header), FLAC, Ogg Vorbis and M4A files of
+# 4 MiB each with ‘no-properties’ and with each ‘properties’ style, and
+# prints wall time and peak RSS for each. Then it prints the reads and
+# bytes it takes to list one file of each type that way (with ‘io=pread’,
+# so TagLib's reads are counted). Files are hard links to one file per
+# type, so after the first run, they are read from the page cache: The
+# numbers of reads tell how the styles differ on cold storage.
+#
+# Usage: properties.sh [path-to-amded]
+# The environment variables COUNT and MIB override the number of files per
+# type (500) and their size in mebibytes (4).
+
+amded_="${1:-./amded}"
+here_="$(dirname "$0")"
+dir_="$(mktemp -d)" || exit 1
+trap 'rm -rf "${dir_}"' EXIT INT TERM
+
+count_="${COUNT:-500}"
+mib_="${MIB:-4}"
+python3 "${here_}/../test/fixtures.py" properties "${dir_}" \
+        "${mib_}" "${count_}" || exit 1
+
+styles_='no-properties properties=fast properties=average properties=accurate'
+for type_ in mp3 flac ogg m4a; do
+    for style_ in ${styles_}; do
+        python3 "${here_}/run.py" --files "${dir_}/${type_}" \
+                "${style_}, ${count_} ${type_} files" \
+                "${amded_}" -j -o "${style_}" || exit 1
+    done
+done
+
+for type_ in mp3 flac ogg m4a; do
+    for style_ in ${styles_}; do
+        printf '%s, one %s file: ' "${style_}" "${type_}"
+        "${amded_}" -j -o "io=pread,io-stats,${style_}" \
+                    "${dir_}/${type_}/0.${type_}" 2>&1 > /dev/null \
+            | sed -e 's/^.*: //'
+    done
+done
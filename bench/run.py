@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Time a command, and measure its peak resident set size.
+
+The command runs REPEAT times, with its output discarded; the best wall
+time and the largest peak RSS of the runs are printed after LABEL. With
+--files, the names of all files in DIR are appended to the command, which
+then runs in DIR: Lists of 100000 and more names exceed the usual limit on
+the size of a command line, so the stack limit, that sets it, is raised.
+
+Usage: run.py [--repeat N] [--files DIR] LABEL COMMAND [ARGUMENT...]
+"""
+
+import os
+import resource
+import subprocess
+import sys
+import time
+
+
+def raise_arg_max():
+    # Linux allows a quarter of the stack limit for arguments.
+    soft, hard = resource.getrlimit(resource.RLIMIT_STACK)
+    want = 256 * 1024 * 1024
+    if soft != resource.RLIM_INFINITY and soft < want:
+        if hard == resource.RLIM_INFINITY or hard >= want:
+            resource.setrlimit(resource.RLIMIT_STACK, (want, hard))
+
+
+def run_once(command, cwd):
+    start = time.monotonic()
+    pid = os.fork()
+    if pid == 0:
+        try:
+            if cwd is not None:
+                os.chdir(cwd)
+                raise_arg_max()
+            devnull = os.open(os.devnull, os.O_WRONLY)
+            os.dup2(devnull, 1)
+            os.execvp(command[0], command)
+        finally:
+            os._exit(127)
+    _, status, usage = os.wait4(pid, 0)
+    elapsed = time.monotonic() - start
+    return os.waitstatus_to_exitcode(status), elapsed, usage.ru_maxrss
+
+
+def main(argv):
+    args = argv[1:]
+    repeat = 3
+    directory = None
+    while args and args[0].startswith('--'):
+        if args[0] == '--repeat' and len(args) > 1:
+            repeat = int(args[1])
+        elif args[0] == '--files' and len(args) > 1:
+            directory = args[1]
+        else:
+            break
+        args = args[2:]
+    if len(args) < 2:
+        sys.stderr.write(__doc__)
+        return 1
+    label, command = args[0], args[1:]
+    if directory is not None:
+        if os.sep in command[0]:
+            command[0] = os.path.abspath(command[0])
+        command += sorted(os.listdir(directory))
+
+    best = None
+    peak = 0
+    for _ in range(repeat):
+        code, elapsed, rss = run_once(command, directory)
+        if code != 0:
+            print('%s: exit status %d' % (label, code), flush=True)
+            return 1
+        best = elapsed if best is None else min(best, elapsed)
+        peak = max(peak, rss)
+    print('%-48s %9.3f s %9d KiB' % (label + ':', best, peak), flush=True)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
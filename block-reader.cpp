@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file block-reader.cpp
+ * @brief Reading through TagLib files in large blocks
+ *
+ * Walking all of a file's audio data (see payload.cpp and mp3-scan.cpp)
+ * through TagLib's streams in small pieces would take a system call (or
+ * an HTTP request) for each. This reads blocks of one MiB instead, and
+ * hands out pieces of those.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include <tbytevector.h>
+#include <tfile.h>
+
+#include "block-reader.h"
+#include "hash.h"
+
+namespace {
+
+    /** Size of the blocks data is read in */
+    const std::size_t block_size = 1024 * 1024;
+
+}
+
+namespace Amded {
+
+    /**
+     * Set up reading a range of a file
+     *
+     * @param   f       the file to read from
+     * @param   start   offset of the first byte to read
+     * @param   end     offset of the byte after the last one to read
+     */
+    BlockReader::BlockReader(TagLib::File *f, uint64_t start, uint64_t end)
+        : fh(f), stop(end), pos(start), at(0)
+    {
+    }
+
+    /**
+     * Make bytes available at ‘data()’
+     *
+     * @param   n   the number of bytes needed
+     *
+     * @return true if ‘n’ bytes are available; false if the range ends
+     *         before, or the file could not be read.
+     */
+    bool
+    BlockReader::need(std::size_t n)
+    {
+        if (buf.size() - at >= n) {
+            return true;
+        }
+        buf = buf.mid(at);
+        pos += at;
+        at = 0;
+        while (buf.size() < n) {
+            const uint64_t next = pos + buf.size();
+            if (next >= stop) {
+                return false;
+            }
+            const uint64_t want = std::min<uint64_t>(
+                std::max(block_size, n - buf.size()), stop - next);
+            fh->seek(next);
+            const TagLib::ByteVector block = fh->readBlock(want);
+            if (block.isEmpty()) {
+                return false;
+            }
+            buf.append(block);
+        }
+        return true;
+    }
+
+    const char *
+    BlockReader::data(void) const
+    {
+        return buf.data() + at;
+    }
+
+    /** Number of bytes at ‘data()’, without reading more */
+    std::size_t
+    BlockReader::available(void) const
+    {
+        return buf.size() - at;
+    }
+
+    /** File offset of the byte at ‘data()’ */
+    uint64_t
+    BlockReader::offset(void) const
+    {
+        return pos + at;
+    }
+
+    void
+    BlockReader::skip(uint64_t n)
+    {
+        if (n <= buf.size() - at) {
+            at += n;
+            return;
+        }
+        pos += at + n;
+        buf.clear();
+        at = 0;
+    }
+
+    /**
+     * Feed the next bytes into a hash
+     *
+     * @param   h   the hash to feed
+     * @param   n   the number of bytes to hash
+     *
+     * @return true if all was hashed; false if the range ended before.
+     */
+    bool
+    BlockReader::hash(Hash64 &h, uint64_t n)
+    {
+        while (n > 0) {
+            if (buf.size() == at && !need(1)) {
+                return false;
+            }
+            const std::size_t take = std::min<uint64_t>(n, buf.size() - at);
+            h.update(data(), take);
+            at += take;
+            n -= take;
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file block-reader.h
+ * @brief API for reading through TagLib files in large blocks
+ */
+
+#ifndef INC_BLOCK_READER_H
+#define INC_BLOCK_READER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <tbytevector.h>
+#include <tfile.h>
+
+#include "hash.h"
+
+namespace Amded {
+
+    /**
+     * Sequential reads from a TagLib file, in large blocks
+     *
+     * Callers ask for the number of bytes they need to look at next
+     * (see ‘need()’), and get them from the block buffer.
+     */
+    class BlockReader {
+    private:
+        TagLib::File *fh;
+        uint64_t stop;
+        /** File offset of the first byte in ‘buf’ */
+        uint64_t pos;
+        TagLib::ByteVector buf;
+        std::size_t at;
+
+    public:
+        BlockReader(TagLib::File *, uint64_t, uint64_t);
+        bool need(std::size_t);
+        const char *data(void) const;
+        std::size_t available(void) const;
+        uint64_t offset(void) const;
+        void skip(uint64_t);
+        bool hash(Hash64 &, uint64_t);
+    };
+
+}
+
+#endif /* INC_BLOCK_READER_H */
@@ -0,0 +1,694 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file cache.cpp
+ * @brief Persistent cache for listing data
+ *
+ * With the ‘cache=FILE’ parameter, the data listing modes print about a file
+ * is stored on disk. Later runs look files up there, and only hand files to
+ * TagLib if they are not in the cache or changed since they were cached.
+ * Answering a file from the cache takes one statx(2) call, and no open(2).
+ *
+ * Files are identified by device and inode number. Their size and
+ * modification time (in nanoseconds), as well as the file type derived from
+ * their name, have to match the cached record for it to be used.
+ *
+ * The cache file starts with a header, that carries a hash of everything
+ * besides the file itself, that influences listing data: amded's and TagLib's
+ * version, the read-map and the parameters, that affect the data (like
+ * ‘show-empty’ and ‘properties’). If that does not match the current setup,
+ * the cache is thrown away and rebuilt.
+ *
+ * The header is followed by a sequence of records, each of which holds a
+ * file's key and its listing data. Numbers are stored in host byte order:
+ * The cache is not meant to be moved between machines. When a cache is
+ * opened, it is mapped into memory and an index of the latest record for
+ * every inode is built. New records are appended to the end of the file with
+ * a single write(2) each. A record, that got cut short (if amded was killed
+ * while writing it, say) is removed when the cache is opened next time.
+ *
+ * Records of files, that changed, are superseded by the newer record for the
+ * same inode. When a run ends, and there are more superseded records in the
+ * file than current ones, the cache is compacted: Current records are copied
+ * into a new file, which then replaces the old one. With ‘cache-prune’, only
+ * records of files, that were listed in the current run, are kept. That gets
+ * rid of records of files, that were removed.
+ *
+ * A cache file is locked while amded uses it. If another amded process holds
+ * the lock, the cache is not used.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <taglib.h>
+
+#include "amded.h"
+#include "cache.h"
+#include "file-spec.h"
+#include "setup.h"
+#include "value.h"
+
+/** Identifies amded cache files, and their format version */
+#define CACHE_MAGIC "amdedlc1"
+
+/** Size of the magic string at the start of the cache */
+#define CACHE_MAGIC_SIZE 8
+
+/** Written in host byte order, to detect caches from foreign machines */
+#define CACHE_BYTE_ORDER 0x01020304U
+
+/** Size of the cache's header: Magic, byte order mark, setup hash */
+#define CACHE_HEADER_SIZE (CACHE_MAGIC_SIZE + 4 + 4 + 8)
+
+/** Size of a record's key: Device, inode, size, mtime, file type */
+#define CACHE_KEY_SIZE (4 * 8 + 4)
+
+/** Amount of data to collect before writing it while compacting */
+#define CACHE_WRITE_CHUNK (1024 * 1024)
+
+static void
+put_raw(std::string &buf, const void *data, std::size_t len)
+{
+    buf.append(static_cast<const char *>(data), len);
+}
+
+static void
+put_u32(std::string &buf, uint32_t n)
+{
+    put_raw(buf, &n, sizeof(n));
+}
+
+static void
+put_u64(std::string &buf, uint64_t n)
+{
+    put_raw(buf, &n, sizeof(n));
+}
+
+static void
+put_bytes(std::string &buf, const std::string &s)
+{
+    put_u32(buf, s.size());
+    buf += s;
+}
+
+static void
+put_map(std::string &buf, const std::map< std::string, Value > &m)
+{
+    put_u32(buf, m.size());
+    for (auto &iter : m) {
+        int32_t i;
+        buf += static_cast<char>(iter.second.get_type());
+        put_bytes(buf, iter.first);
+        switch (iter.second.get_type()) {
+        case TAG_BOOLEAN:
+            buf += static_cast<char>(iter.second.get_bool());
+            break;
+        case TAG_INTEGER:
+            i = iter.second.get_int();
+            put_raw(buf, &i, sizeof(i));
+            break;
+        case TAG_STRING:
+            put_bytes(buf, iter.second.get_str().to8Bit(true));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/** Bounds-checked reading of records from the cache's mapping */
+class CacheReader {
+public:
+    CacheReader(const char *data, std::size_t len)
+        : p(data), end(data + len) {};
+
+    bool
+    raw(void *data, std::size_t len)
+    {
+        if (static_cast<std::size_t>(end - p) < len) {
+            return false;
+        }
+        memcpy(data, p, len);
+        p += len;
+        return true;
+    };
+
+    bool
+    bytes(std::string &s)
+    {
+        uint32_t len;
+        if (!raw(&len, sizeof(len))
+            || static_cast<std::size_t>(end - p) < len)
+        {
+            return false;
+        }
+        s.assign(p, len);
+        p += len;
+        return true;
+    };
+
+    bool
+    key(Amded::CacheKey &k)
+    {
+        return raw(&k.dev, sizeof(k.dev))
+            && raw(&k.ino, sizeof(k.ino))
+            && raw(&k.size, sizeof(k.size))
+            && raw(&k.mtime, sizeof(k.mtime))
+            && raw(&k.type, sizeof(k.type));
+    };
+
+    bool
+    map(std::map< std::string, Value > &m)
+    {
+        uint32_t n;
+        if (!raw(&n, sizeof(n))) {
+            return false;
+        }
+        m.clear();
+        for (uint32_t i = 0; i < n; ++i) {
+            char type;
+            std::string name, s;
+            int32_t integer;
+            if (!raw(&type, 1) || !bytes(name)) {
+                return false;
+            }
+            switch (type) {
+            case TAG_BOOLEAN:
+                if (!raw(&type, 1)) {
+                    return false;
+                }
+                m[name] = type != 0;
+                break;
+            case TAG_INTEGER:
+                if (!raw(&integer, sizeof(integer))) {
+                    return false;
+                }
+                m[name] = static_cast<int>(integer);
+                break;
+            case TAG_STRING:
+                if (!bytes(s)) {
+                    return false;
+                }
+                m[name] = s;
+                break;
+            default:
+                return false;
+            }
+        }
+        return true;
+    };
+
+private:
+    const char *p;
+    const char *end;
+};
+
+static std::string
+encode_record(const Amded::CacheKey &key, const struct amded_listing &data)
+{
+    std::string body;
+    put_u64(body, key.dev);
+    put_u64(body, key.ino);
+    put_u64(body, key.size);
+    put_u64(body, key.mtime);
+    put_raw(body, &key.type, sizeof(key.type));
+    put_map(body, data.amded);
+    put_map(body, data.tags);
+    put_map(body, data.props);
+
+    std::string rv;
+    rv.reserve(body.size() + 4);
+    put_u32(rv, body.size());
+    rv += body;
+    return rv;
+}
+
+static bool
+same_state(const Amded::CacheKey &a, const Amded::CacheKey &b)
+{
+    return a.size == b.size && a.mtime == b.mtime && a.type == b.type;
+}
+
+/** FNV-1a hash of everything, that affects listing data */
+static uint64_t
+setup_hash(void)
+{
+    std::string desc = VERSION;
+
+    desc += ':' + std::to_string(TAGLIB_MAJOR_VERSION)
+        + '.' + std::to_string(TAGLIB_MINOR_VERSION)
+        + '.' + std::to_string(TAGLIB_PATCH_VERSION);
+    desc += get_opt(AMDED_LIST_ALLOW_EMPTY_TAGS) ? ":empty" : ":";
+    desc += get_opt(AMDED_NO_PROPERTIES) ? ":noprops" : ":props";
+    desc += std::to_string(get_properties_style());
+    /* Native readers list the same as TagLib, unless frames are skipped. */
+    desc += ":maxframe=" + std::to_string(get_max_frame_bytes());
+    desc += get_opt(AMDED_PAYLOAD_HASH) ? ":payload" : ":";
+    desc += get_opt(AMDED_STREAM_MD5) ? ":md5" : ":";
+    desc += get_opt(AMDED_ACCURATE_LENGTH) ? ":accurate" : ":";
+    for (auto &iter : read_map) {
+        desc += ':' + std::to_string(iter.first) + '=';
+        for (auto &ti : iter.second) {
+            desc += std::to_string(ti) + ',';
+        }
+    }
+
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (auto c : desc) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static std::string
+cache_header(void)
+{
+    std::string rv = CACHE_MAGIC;
+    put_u32(rv, CACHE_BYTE_ORDER);
+    put_u32(rv, 0);
+    put_u64(rv, setup_hash());
+    return rv;
+}
+
+static bool
+write_all(int fd, const std::string &data)
+{
+    const char *p = data.data();
+    std::size_t left = data.size();
+
+    while (left > 0) {
+        ssize_t rc = write(fd, p, left);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += rc;
+        left -= rc;
+    }
+    return true;
+}
+
+namespace Amded {
+
+    ListCache::ListCache()
+    {
+        fd = -1;
+        map = nullptr;
+        map_size = 0;
+        records = 0;
+        prune = false;
+        appended = false;
+        broken = false;
+        hits = 0;
+        misses = 0;
+    }
+
+    ListCache::~ListCache()
+    {
+        close();
+    }
+
+    /**
+     * Take the cache file's lock
+     *
+     * If the file was replaced while waiting for the lock (because another
+     * process compacted it), the new file is opened instead.
+     */
+    bool
+    ListCache::lock_file(void)
+    {
+        for (;;) {
+            struct stat fst, pst;
+
+            if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+                std::cerr << PROJECT ": Cache `" << path
+                          << "' is in use; not using it." << std::endl;
+                return false;
+            }
+            if (fstat(fd, &fst) == 0 && stat(path.c_str(), &pst) == 0
+                && fst.st_dev == pst.st_dev && fst.st_ino == pst.st_ino)
+            {
+                return true;
+            }
+            ::close(fd);
+            fd = ::open(path.c_str(),
+                        O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                return false;
+            }
+        }
+    }
+
+    /** Map the cache file, as far as it currently extends, into memory */
+    bool
+    ListCache::map_file(void)
+    {
+        struct stat st;
+
+        if (fstat(fd, &st) < 0) {
+            return false;
+        }
+        map_size = st.st_size;
+        if (map_size == 0) {
+            return true;
+        }
+        void *m = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (m == MAP_FAILED) {
+            map_size = 0;
+            return false;
+        }
+        map = static_cast<const char *>(m);
+        return true;
+    }
+
+    void
+    ListCache::unmap(void)
+    {
+        if (map != nullptr) {
+            munmap(const_cast<char *>(map), map_size);
+        }
+        map = nullptr;
+        map_size = 0;
+    }
+
+    /**
+     * Index all records in the mapping
+     *
+     * @return The offset behind the last complete record.
+     */
+    std::size_t
+    ListCache::scan(void)
+    {
+        std::size_t pos = CACHE_HEADER_SIZE;
+
+        index.clear();
+        records = 0;
+        while (map_size - pos >= 4) {
+            uint32_t len;
+            CacheKey key;
+
+            memcpy(&len, map + pos, sizeof(len));
+            if (len < CACHE_KEY_SIZE || map_size - pos - 4 < len) {
+                break;
+            }
+            CacheReader r(map + pos + 4, len);
+            r.key(key);
+            index[{ key.dev, key.ino }] = { key, pos + 4, len };
+            ++records;
+            pos += 4 + len;
+        }
+        return pos;
+    }
+
+    /** Throw away all records, and start over with a fresh header */
+    bool
+    ListCache::reset(void)
+    {
+        unmap();
+        index.clear();
+        records = 0;
+        return ftruncate(fd, 0) == 0 && write_all(fd, cache_header());
+    }
+
+    /**
+     * Open a cache file; it is created, if it does not exist
+     *
+     * @param  name      name of the cache file
+     * @param  prune_    only keep records of files looked up in this run
+     *
+     * @return true if the cache is usable; false otherwise.
+     * @sideeffects Prints a diagnostic to stderr on failure.
+     */
+    bool
+    ListCache::open(const std::string &name, bool prune_)
+    {
+        path = name;
+        prune = prune_;
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+                    0644);
+        if (fd < 0 || !lock_file() || !map_file()) {
+            if (errno != EWOULDBLOCK) {
+                std::cerr << PROJECT ": Could not open cache `" << path
+                          << "': " << strerror(errno) << std::endl;
+            }
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+            return false;
+        }
+
+        if (map_size > 0 && (map_size < CACHE_MAGIC_SIZE
+                             || memcmp(map, CACHE_MAGIC, CACHE_MAGIC_SIZE)))
+        {
+            std::cerr << PROJECT ": `" << path
+                      << "' is not an amded cache; not using it." << std::endl;
+            unmap();
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+
+        const std::string header = cache_header();
+        if (map_size < CACHE_HEADER_SIZE
+            || memcmp(map, header.data(), CACHE_HEADER_SIZE) != 0)
+        {
+            if (!reset()) {
+                std::cerr << PROJECT ": Could not reset cache `" << path
+                          << "': " << strerror(errno) << std::endl;
+                ::close(fd);
+                fd = -1;
+                return false;
+            }
+            return true;
+        }
+
+        std::size_t good = scan();
+        if (good < map_size) {
+            /* Cut off a record, that was not written completely. */
+            if (ftruncate(fd, good) < 0) {
+                broken = true;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Determine the cache key of a file
+     *
+     * @param  name    name of the file
+     * @param  fd      descriptor of the opened file; -1 to look the file up
+     *                 by name
+     * @param  k       where to store the key
+     *
+     * @return true if ‘k’ was filled in; false if the file cannot be cached,
+     *         because it is of unsupported type or cannot be stat(2)ed.
+     */
+    bool
+    ListCache::key(const std::string &name, int fd, CacheKey &k) const
+    {
+        struct statx stx;
+        int rc;
+
+        k.type = get_ext_type(name);
+        if (k.type == FILE_T_INVALID) {
+            return false;
+        }
+        if (fd >= 0) {
+            rc = statx(fd, "", AT_EMPTY_PATH | AT_STATX_SYNC_AS_STAT,
+                       STATX_INO | STATX_SIZE | STATX_MTIME, &stx);
+        } else {
+            rc = statx(AT_FDCWD, name.c_str(), AT_STATX_SYNC_AS_STAT,
+                       STATX_INO | STATX_SIZE | STATX_MTIME, &stx);
+        }
+        if (rc < 0 || !S_ISREG(stx.stx_mode)) {
+            return false;
+        }
+        k.dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        k.ino = stx.stx_ino;
+        k.size = stx.stx_size;
+        k.mtime = static_cast<uint64_t>(stx.stx_mtime.tv_sec) * 1000000000ULL
+            + stx.stx_mtime.tv_nsec;
+        return true;
+    }
+
+    /**
+     * Look up a file's listing data
+     *
+     * @param  k       the file's key, as returned by key()
+     * @param  data    where to store the listing data
+     *
+     * @return true if the file was found; false otherwise.
+     */
+    bool
+    ListCache::lookup(const CacheKey &k, struct amded_listing &data)
+    {
+        bool found = false;
+        entry e;
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto iter = index.find({ k.dev, k.ino });
+            if (iter != index.end() && same_state(iter->second.key, k)) {
+                e = iter->second;
+                found = true;
+            }
+        }
+
+        if (found) {
+            /* The mapping is never changed while lookups may happen. */
+            CacheReader r(map + e.offset, e.length);
+            CacheKey skip;
+            found = r.key(skip)
+                && r.map(data.amded) && r.map(data.tags) && r.map(data.props);
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (found) {
+            ++hits;
+            if (prune) {
+                used.insert({ k.dev, k.ino });
+            }
+        } else {
+            ++misses;
+        }
+        return found;
+    }
+
+    /**
+     * Add a file's listing data to the cache
+     *
+     * @param  k       the file's key, as returned by key() before the file
+     *                 was read
+     * @param  data    the file's listing data
+     *
+     * @return void
+     */
+    void
+    ListCache::store(const CacheKey &k, const struct amded_listing &data)
+    {
+        const std::string record = encode_record(k, data);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (broken) {
+            return;
+        }
+        if (!write_all(fd, record)) {
+            std::cerr << PROJECT ": Could not write to cache `" << path
+                      << "': " << strerror(errno) << std::endl;
+            broken = true;
+            return;
+        }
+        appended = true;
+        if (prune) {
+            used.insert({ k.dev, k.ino });
+        }
+    }
+
+    /** Rewrite the cache file, if it holds too many superseded records */
+    void
+    ListCache::compact(void)
+    {
+        if (broken) {
+            return;
+        }
+        if (appended) {
+            unmap();
+            if (!map_file()) {
+                return;
+            }
+            scan();
+        }
+
+        std::vector<entry> live;
+        for (auto &iter : index) {
+            if (!prune || used.count(iter.first) > 0) {
+                live.push_back(iter.second);
+            }
+        }
+        if (live.size() == records
+            || (!prune && records - live.size() <= live.size()))
+        {
+            return;
+        }
+        std::sort(live.begin(), live.end(),
+                  [](const entry &a, const entry &b) {
+                      return a.offset < b.offset;
+                  });
+
+        const std::string tmp = path + ".tmp";
+        int tfd = ::open(tmp.c_str(),
+                         O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (tfd < 0) {
+            return;
+        }
+        std::string buf(map, CACHE_HEADER_SIZE);
+        bool ok = true;
+        for (auto &iter : live) {
+            put_u32(buf, iter.length);
+            buf.append(map + iter.offset, iter.length);
+            if (buf.size() >= CACHE_WRITE_CHUNK) {
+                ok = ok && write_all(tfd, buf);
+                buf.clear();
+            }
+        }
+        ok = ok && write_all(tfd, buf);
+        ok = (::close(tfd) == 0) && ok;
+        if (!ok || rename(tmp.c_str(), path.c_str()) < 0) {
+            std::cerr << PROJECT ": Could not compact cache `" << path
+                      << "': " << strerror(errno) << std::endl;
+            unlink(tmp.c_str());
+        }
+    }
+
+    /**
+     * Print the number of cache hits and misses
+     *
+     * @param  out     stream to print to
+     *
+     * @return void
+     */
+    void
+    ListCache::report(std::ostream &out)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        out << PROJECT ": cache: " << hits << " hits, "
+            << misses << " misses" << std::endl;
+    }
+
+    /**
+     * Finish using the cache; compacts it if needed and releases its lock
+     *
+     * @return void
+     */
+    void
+    ListCache::close(void)
+    {
+        if (fd < 0) {
+            return;
+        }
+        compact();
+        unmap();
+        ::close(fd);
+        fd = -1;
+    }
+
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file cache.h
+ * @brief API for the persistent listing cache
+ */
+
+#ifndef INC_CACHE_H
+#define INC_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "list.h"
+
+namespace Amded {
+
+    /** What identifies a file's state in the cache */
+    struct CacheKey {
+        uint64_t dev;
+        uint64_t ino;
+        uint64_t size;
+        uint64_t mtime;
+        int32_t type;
+    };
+
+    class ListCache {
+    private:
+        /** Where the latest record of a file lives in the mapping */
+        struct entry {
+            CacheKey key;
+            std::size_t offset;
+            std::size_t length;
+        };
+
+        struct inode_hash {
+            std::size_t
+            operator()(const std::pair<uint64_t, uint64_t> &i) const
+            {
+                return std::hash<uint64_t>()(i.first * 0x9e3779b97f4a7c15ULL
+                                             ^ i.second);
+            };
+        };
+
+        using inode = std::pair<uint64_t, uint64_t>;
+
+        std::string path;
+        int fd;
+        const char *map;
+        std::size_t map_size;
+        std::size_t records;
+        bool prune;
+        bool appended;
+        bool broken;
+        std::size_t hits;
+        std::size_t misses;
+        std::unordered_map<inode, entry, inode_hash> index;
+        std::unordered_set<inode, inode_hash> used;
+        std::mutex lock;
+
+        bool lock_file(void);
+        bool map_file(void);
+        std::size_t scan(void);
+        bool reset(void);
+        void unmap(void);
+        void compact(void);
+
+    public:
+        ListCache();
+        ~ListCache();
+
+        bool open(const std::string&, bool);
+        bool key(const std::string&, int, CacheKey&) const;
+        bool lookup(const CacheKey&, struct amded_listing&);
+        void store(const CacheKey&, const struct amded_listing&);
+        void report(std::ostream&);
+        void close(void);
+    };
+
+}
+
+#endif /* INC_CACHE_H */
@@ -8,15 +8,20 @@
  * @brief Command line argument processing
  */
 
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <map>
 #include <stdexcept>
 #include <string>
 
+#include <audioproperties.h>
+
 #include "amded.h"
+#include "batch.h"
 #include "cmdline.h"
 #include "file-spec.h"
+#include "list.h"
 #include "setup.h"
 #include "tag.h"
 
@@ -193,19 +198,19 @@ setup_map(std::map<enum file_type, std::vector< enum tag_impl>> &m,
             std::cerr << PROJECT << ": Broken map-definition: "
                       << '"' << di << '"'
                       << std::endl;
-            exit(EXIT_FAILURE);
+            amded_exit(EXIT_FAILURE);
         }
         Amded::FileType ft(entry.first);
 
         if (ft.get_id() == FILE_T_INVALID) {
             std::cerr << PROJECT << ": Invalid file type: "
                       << entry.first << std::endl;
-            exit(EXIT_FAILURE);
+            amded_exit(EXIT_FAILURE);
         }
         if (!is_multitag_type(ft.get_id())) {
             std::cerr << PROJECT << ": File type is not a multi-tag type: "
                       << entry.first << std::endl;
-            exit(EXIT_FAILURE);
+            amded_exit(EXIT_FAILURE);
         }
 
         std::vector<std::string> types = split(entry.second, ",");
@@ -216,13 +221,13 @@ setup_map(std::map<enum file_type, std::vector< enum tag_impl>> &m,
             {
                 std::cerr << PROJECT << ": Invalid tag type: "
                           << ei << std::endl;
-                exit(EXIT_FAILURE);
+                amded_exit(EXIT_FAILURE);
             }
             if (!tag_impl_allowed_for_file_type(ft.get_id(), ti.get_id())) {
                 std::cerr << PROJECT << ": Tag type ("
                           << ti.get_label() << ") not allowed for file type: "
                           << ft.get_label() << std::endl;
-                exit(EXIT_FAILURE);
+                amded_exit(EXIT_FAILURE);
             }
             ttypes.push_back(ti.get_id());
         }
@@ -251,15 +256,204 @@ setup_writemap(const std::string &def)
     }
 }
 
+/**
+ * Restrict listings to a set of fields
+ *
+ * The definition is a comma separated list of field names, like
+ * "track-title,length". Every name has to be one of the fields, that
+ * listings may contain. Repeated definitions add to the set.
+ *
+ * @param  def   field list definition string
+ *
+ * @return void
+ * @sideeffects Exits with EXIT_FAILURE on unknown field names.
+ */
+void
+setup_fields(const std::string &def)
+{
+    for (auto &name : split(def, ",")) {
+        if (!amded_list_known_field(name)) {
+            std::cerr << PROJECT << ": Unknown field: `"
+                      << name << "'" << std::endl;
+            amded_exit(EXIT_FAILURE);
+        }
+        add_field(name);
+    }
+}
+
+/**
+ * Set the type of the audio data read from stdin
+ *
+ * Data read from stdin (given as file name ‘-’) has no extension, that
+ * would tell its type.
+ *
+ * @param  def   a file type label, like "flac" or "ogg-vorbis"
+ *
+ * @return void
+ * @sideeffects Exits with EXIT_FAILURE on unknown file types.
+ */
+void
+setup_stdin_type(const std::string &def)
+{
+    Amded::FileType type(def);
+    if (type.get_id() == FILE_T_INVALID) {
+        std::cerr << PROJECT << ": Unknown file type: `"
+                  << def << "'" << std::endl;
+        amded_exit(EXIT_FAILURE);
+    }
+    set_stdin_type(type.get_id());
+}
+
+/**
+ * Convert the value of a numeric parameter
+ *
+ * Only plain decimal digits are accepted: std::stoul() would take "-1" and
+ * wrap it around to a huge number.
+ *
+ * @param  param   the parameter's definition, like "walk-threads=4"
+ * @param  value   the part after the equal sign
+ * @param  min     the smallest value allowed
+ * @param  max     the largest value allowed
+ *
+ * @return The parameter's value.
+ * @sideeffects Exits with EXIT_FAILURE if ‘value’ is not a number between
+ *              ‘min’ and ‘max’.
+ */
+static unsigned long long
+parameter_number(const std::string &param, const std::string &value,
+                 unsigned long long min, unsigned long long max)
+{
+    try {
+        std::size_t idx;
+        if (!value.empty() && value[0] >= '0' && value[0] <= '9') {
+            unsigned long long rv = std::stoull(value, &idx);
+            if (idx == value.size() && rv >= min && rv <= max) {
+                return rv;
+            }
+        }
+    }
+    catch (const std::exception &e) {
+        /* Handled below */
+    }
+    std::cerr << PROJECT << ": Invalid numeric parameter: `"
+              << param << "'" << std::endl;
+    amded_exit(EXIT_FAILURE);
+}
+
+/**
+ * Convert the value of the ‘properties’ parameter
+ *
+ * @param  param   the parameter's definition, like "properties=fast"
+ * @param  value   the part after the equal sign
+ *
+ * @return The read style to use for audio properties.
+ * @sideeffects Exits with EXIT_FAILURE if ‘value’ is not a read style.
+ */
+static TagLib::AudioProperties::ReadStyle
+parameter_style(const std::string &param, const std::string &value)
+{
+    if (value == "fast") {
+        return TagLib::AudioProperties::Fast;
+    } else if (value == "average") {
+        return TagLib::AudioProperties::Average;
+    } else if (value == "accurate") {
+        return TagLib::AudioProperties::Accurate;
+    }
+    std::cerr << PROJECT << ": Invalid read style: `"
+              << param << "'" << std::endl;
+    amded_exit(EXIT_FAILURE);
+}
+
+/**
+ * Convert the value of the ‘io’ parameter
+ *
+ * @param  param   the parameter's definition, like "io=pread"
+ * @param  value   the part after the equal sign
+ *
+ * @return The I/O backend to use in listing modes.
+ * @sideeffects Exits with EXIT_FAILURE if ‘value’ is not a backend.
+ */
+static enum io_backend
+parameter_io(const std::string &param, const std::string &value)
+{
+    if (value == "taglib") {
+        return IO_BACKEND_TAGLIB;
+    } else if (value == "pread") {
+        return IO_BACKEND_PREAD;
+    } else if (value == "mmap") {
+        return IO_BACKEND_MMAP;
+    }
+    std::cerr << PROJECT << ": Invalid I/O backend: `"
+              << param << "'" << std::endl;
+    amded_exit(EXIT_FAILURE);
+}
+
 void
 amded_parameters(const std::string &def)
 {
     for (auto &iter : split(def, ",")) {
+        std::pair<std::string, std::string> kv;
+
         if (iter.empty()) {
             continue;
         }
 
-        if (iter == "show-empty") {
+        if (iter.find('=') != std::string::npos) {
+            try {
+                kv = tag_arg_to_pair(iter);
+            }
+            catch (amded_broken_tag_def) {
+                std::cerr << PROJECT << ": Broken parameter: `"
+                          << iter << "'" << std::endl;
+                amded_exit(EXIT_FAILURE);
+            }
+        }
+
+        if (kv.first == "walk-threads") {
+            set_walk_threads(parameter_number(iter, kv.second, 0,
+                                              AMDED_MAX_THREADS));
+        } else if (kv.first == "cache") {
+            set_cache_file(kv.second);
+        } else if (iter == "cache-prune") {
+            set_opt(AMDED_CACHE_PRUNE);
+        } else if (kv.first == "properties") {
+            set_properties_style(parameter_style(iter, kv.second));
+        } else if (iter == "no-properties") {
+            set_opt(AMDED_NO_PROPERTIES);
+        } else if (kv.first == "prefetch") {
+            set_prefetch(parameter_number(iter, kv.second, 0,
+                                          AMDED_MAX_PREFETCH));
+        } else if (kv.first == "io") {
+            set_io_backend(parameter_io(iter, kv.second));
+        } else if (kv.first == "io-block-size") {
+            set_io_block_size(parameter_number(iter, kv.second, 1,
+                                               SIZE_MAX));
+        } else if (iter == "io-stats") {
+            set_opt(AMDED_IO_STATS);
+        } else if (kv.first == "max-frame-bytes") {
+            set_opt(AMDED_NATIVE_READERS);
+            set_max_frame_bytes(parameter_number(iter, kv.second, 1,
+                                                 UINT64_MAX));
+        } else if (iter == "peak-rss") {
+            set_opt(AMDED_PEAK_RSS);
+        } else if (iter == "native-readers") {
+            set_opt(AMDED_NATIVE_READERS);
+        } else if (iter == "native-verify") {
+            set_opt(AMDED_NATIVE_READERS);
+            set_opt(AMDED_NATIVE_VERIFY);
+        } else if (iter == "accurate-length") {
+            set_opt(AMDED_ACCURATE_LENGTH);
+        } else if (iter == "all-tag-blocks") {
+            set_opt(AMDED_ALL_TAG_BLOCKS);
+        } else if (iter == "raw-properties") {
+            set_opt(AMDED_RAW_PROPERTIES);
+        } else if (iter == "payload-hash") {
+            set_opt(AMDED_PAYLOAD_HASH);
+        } else if (iter == "stream-md5") {
+            set_opt(AMDED_STREAM_MD5);
+        } else if (kv.first == "picture-store") {
+            set_picture_store(kv.second);
+        } else if (iter == "show-empty") {
             set_opt(AMDED_LIST_ALLOW_EMPTY_TAGS);
         } else if (iter == "keep-unsupported") {
             set_opt(AMDED_KEEP_UNSUPPORTED_TAGS);
@@ -267,10 +461,12 @@ amded_parameters(const std::string &def)
             set_opt(AMDED_JSON_DONT_USE_BASE64);
         } else if (iter == "machine-dont-use-base64") {
             set_opt(AMDED_MACHINE_DONT_USE_BASE64);
+        } else if (iter == "completion-order") {
+            set_opt(AMDED_COMPLETION_ORDER);
         } else {
             std::cerr << PROJECT << ": Unknown parameter: `"
                       << iter << "'" << std::endl;
-            exit(EXIT_FAILURE);
+            amded_exit(EXIT_FAILURE);
         }
     }
 }
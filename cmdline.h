@@ -23,6 +23,8 @@ Value tag_value_from_value(enum tag_type, const std::string&);
 void list_tags(void);
 void setup_readmap(const std::string&);
 void setup_writemap(const std::string&);
+void setup_fields(const std::string&);
+void setup_stdin_type(const std::string&);
 void amded_parameters(const std::string&);
 
 #endif /* INC_CMDLINE_H */
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file file-source.cpp
+ * @brief Supply of file names to process
+ *
+ * File names are taken from the non-option arguments on the command line
+ * first. After those, they are read from the file list given via ‘-f’, if
+ * any. File lists are read one name at a time, while the files are being
+ * processed, so the length of a list has no effect on amded's memory use.
+ *
+ * Names in a list are terminated by line feeds, or by NUL bytes with ‘-0’
+ * (like the output of ‘find -print0’). Empty names are skipped.
+ *
+ * With ‘-r’, names that refer to directories are replaced by the supported
+ * files found in them and their subdirectories (see walk.cpp).
+ *
+ * JSON output (‘-j’) is a single object keyed by file name, so names that
+ * come up more than once must only be listed once there. For that, the
+ * source can remember the names it handed out, and skip repeats (see
+ * ‘set_unique()’). Only the XXH64 hashes of names are kept, not the names
+ * themselves: That still grows with the number of files, but by a small,
+ * fixed amount per file (roughly 40 bytes, with the hash table's overhead),
+ * no matter how long paths get. Two different names with the same hash
+ * would make the second one go unlisted; at 64 bits, that is not expected
+ * to happen in practice.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <sys/stat.h>
+
+#include "file-source.h"
+#include "hash.h"
+#include "walk.h"
+
+namespace Amded {
+
+    FileSource::FileSource(char *args[], int n)
+    {
+        argv = args;
+        argc = n;
+        argidx = 0;
+        list = nullptr;
+        delim = '\n';
+        recursive = false;
+        walk_threads = 0;
+        unique = false;
+    }
+
+    FileSource::~FileSource() = default;
+
+    /**
+     * Read further file names from ‘name’
+     *
+     * @param  name    name of the file list; "-" means stdin
+     * @param  d       character that terminates names in the list
+     *
+     * @return true if the list could be opened; false otherwise.
+     */
+    bool
+    FileSource::open_list(const std::string &name, char d)
+    {
+        delim = d;
+        if (name == "-") {
+            list = &std::cin;
+            return true;
+        }
+        list_file.open(name, std::ios::in | std::ios::binary);
+        if (!list_file.is_open()) {
+            return false;
+        }
+        list = &list_file;
+        return true;
+    }
+
+    /**
+     * Descend into directories
+     *
+     * @param  threads  number of threads to walk directory trees with
+     *
+     * @return void
+     */
+    void
+    FileSource::set_recursive(unsigned int threads)
+    {
+        recursive = true;
+        walk_threads = threads;
+    }
+
+    /**
+     * Hand out every name only once
+     *
+     * @return void
+     */
+    void
+    FileSource::set_unique(void)
+    {
+        unique = true;
+    }
+
+    /**
+     * Take note of a name, that is about to be processed
+     *
+     * Names from other places, like archive members, share the record of
+     * names handed out, so they can be checked against it, too.
+     *
+     * @param  name    the name to process
+     *
+     * @return true if ‘name’ may be processed; false if it is a repeat, and
+     *         names are handed out only once.
+     */
+    bool
+    FileSource::claim(const std::string &name)
+    {
+        return !unique
+            || seen.insert(amded_hash64(name.data(), name.size())).second;
+    }
+
+    /**
+     * Fetch the next name from the command line or the file list
+     */
+    bool
+    FileSource::next_name(std::string &name)
+    {
+        if (argidx < argc) {
+            name = argv[argidx++];
+            return true;
+        }
+        if (list == nullptr) {
+            return false;
+        }
+        while (std::getline(*list, name, delim)) {
+            if (!name.empty()) {
+                return true;
+            }
+        }
+        list = nullptr;
+        return false;
+    }
+
+    /**
+     * Fetch the next file name to process
+     *
+     * @param  name    where to store the file name
+     *
+     * @return true if a name was stored in ‘name’; false if all names were
+     *         handed out already.
+     */
+    bool
+    FileSource::next(std::string &name)
+    {
+        struct stat st;
+
+        for (;;) {
+            if (walker) {
+                if (walker->next(name)) {
+                    if (!claim(name)) {
+                        continue;
+                    }
+                    return true;
+                }
+                walker.reset();
+            }
+            if (!next_name(name)) {
+                return false;
+            }
+            if (recursive && stat(name.c_str(), &st) == 0
+                && S_ISDIR(st.st_mode))
+            {
+                walker = new_dir_walker(name, walk_threads);
+                continue;
+            }
+            if (!claim(name)) {
+                continue;
+            }
+            return true;
+        }
+    }
+
+} /* namespace Amded */
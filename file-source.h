@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file file-source.h
+ * @brief API for the supply of file names to process
+ */
+
+#ifndef INC_FILE_SOURCE_H
+#define INC_FILE_SOURCE_H
+
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+#include "walk.h"
+
+namespace Amded {
+
+    class FileSource {
+    private:
+        char **argv;
+        int argc;
+        int argidx;
+        std::istream *list;
+        std::ifstream list_file;
+        char delim;
+        bool recursive;
+        unsigned int walk_threads;
+        std::unique_ptr<DirWalker> walker;
+        bool unique;
+        /** Hashes of the names handed out, with ‘unique’ */
+        std::unordered_set<uint64_t> seen;
+
+        bool next_name(std::string&);
+
+    public:
+        FileSource(char *[], int);
+        ~FileSource();
+
+        bool open_list(const std::string&, char);
+        void set_recursive(unsigned int);
+        void set_unique(void);
+        bool claim(const std::string&);
+        bool next(std::string&);
+    };
+
+}
+
+#endif /* INC_FILE_SOURCE_H */
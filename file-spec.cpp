@@ -18,9 +18,11 @@
 #include <id3v1tag.h>
 #include <id3v2tag.h>
 #include <mp4file.h>
+#include <mp4itemfactory.h>
 #include <mpegfile.h>
 #include <oggflacfile.h>
 #include <opusfile.h>
+#include <textidentificationframe.h>
 #include <tfile.h>
 #include <tpropertymap.h>
 #include <vorbisfile.h>
@@ -28,6 +30,7 @@
 #include "amded.h"
 #include "file-spec.h"
 #include "file-type.h"
+#include "native.h"
 #include "setup.h"
 #include "tag-implementation.h"
 #include "tag.h"
@@ -105,6 +108,9 @@ mp3_has_tag_type(TagLib::MPEG::File *fh, enum tag_impl type)
 static bool
 has_tag_type(const struct amded_file &file, enum tag_impl type)
 {
+    if (file.native != nullptr) {
+        return file.native->types.count(type) > 0;
+    }
     switch (file.type.get_id()) {
     case FILE_T_MP3:
         return
@@ -169,24 +175,52 @@ get_prefered_tag_impl(const struct amded_file &file)
     return TAG_T_NONE;
 }
 
+/**
+ * Construct a TagLib file object of type ‘T’
+ *
+ * Files are read from ‘file.stream’ if that is set, and by name otherwise.
+ * Audio properties are only parsed if ‘properties’ is set, using the read
+ * style from the setup (see the ‘properties’ parameter).
+ */
+template <class T>
+static TagLib::File *
+new_taglib_file(const struct amded_file &file, bool properties)
+{
+    const auto style = get_properties_style();
+    if (file.stream != nullptr) {
+        return new T(file.stream, properties, style);
+    }
+    return new T(file.name.c_str(), properties, style);
+}
+
+/**
+ * Open a file with TagLib
+ *
+ * @param  file        amded file handle; ‘name’ and ‘type’ need to be set
+ * @param  properties  parse the file's audio properties if true. Listing
+ *                     modes need them, write modes do not.
+ *
+ * @return true if the file is ready for processing; false otherwise.
+ */
 bool
-amded_open(struct amded_file &file)
+amded_open(struct amded_file &file, bool properties)
 {
     switch (file.type.get_id()) {
     case FILE_T_MP3:
-        file.fh = new TagLib::MPEG::File(file.name);
+        file.fh = new_taglib_file<TagLib::MPEG::File>(file, properties);
         break;
     case FILE_T_FLAC:
-        file.fh = new TagLib::FLAC::File(file.name);
+        file.fh = new_taglib_file<TagLib::FLAC::File>(file, properties);
         break;
     case FILE_T_OGG_VORBIS:
-        file.fh = new TagLib::Ogg::Vorbis::File(file.name);
+        file.fh = new_taglib_file<TagLib::Ogg::Vorbis::File>(file,
+                                                             properties);
         break;
     case FILE_T_M4A:
-        file.fh = new TagLib::MP4::File(file.name);
+        file.fh = new_taglib_file<TagLib::MP4::File>(file, properties);
         break;
     case FILE_T_OPUS:
-        file.fh = new TagLib::Ogg::Opus::File(file.name);
+        file.fh = new_taglib_file<TagLib::Ogg::Opus::File>(file, properties);
         break;
     default:
         std::cerr << "BUG: Missing implementation for file type: "
@@ -206,23 +240,39 @@ amded_open(struct amded_file &file)
                   << file.name << "'" << std::endl;
         goto error;
     }
-    if (file.fh->tag() == nullptr) {
+    if (properties && file.fh->audioProperties() == nullptr) {
         std::cerr << PROJECT ": Could not get audio properties for file: `"
                   << file.name << "'" << std::endl;
         goto error;
     }
 
+    amded_select_tag_impl(file);
+    return true;
+error:
+    delete file.fh;
+    file.fh = nullptr;
+    return false;
+}
+
+/**
+ * Pick the tag type to read from an opened file
+ *
+ * For file types, that support more than one tag type, this is the first
+ * one from the read-map, that is present in the file.
+ *
+ * @param  file   amded file handle; either ‘fh’ or ‘native’ needs to be set
+ *
+ * @return void
+ */
+void
+amded_select_tag_impl(struct amded_file &file)
+{
     if (is_multitag_type(file.type.get_id())) {
         file.multi_tag = true;
         file.tagimpl = get_prefered_tag_impl(file);
     } else {
         file.multi_tag = false;
     }
-
-    return true;
-error:
-    delete file.fh;
-    return false;
 }
 
 std::string
@@ -245,10 +295,185 @@ get_tag_types(const struct amded_file &file)
     return first ? "none" : rv;
 }
 
+/**
+ * Determine the tag types present in a multi-tag file
+ *
+ * @param   file    the file to look at
+ *
+ * @return The tag types, in the order of the file type's tag map.
+ */
+std::vector<enum tag_impl>
+get_present_tag_types(const struct amded_file &file)
+{
+    std::vector<enum tag_impl> rv;
+    for (auto &iter : get_multitag_vector(file.type.get_id())) {
+        if (has_tag_type(file, iter)) {
+            rv.push_back(iter);
+        }
+    }
+    return rv;
+}
+
+/**
+ * Add the entries named in ‘keys’ from one property map to another
+ *
+ * Values of keys, that are already present in ‘dst’, are appended to the
+ * existing ones, just like ‘TagLib::PropertyMap::merge()’ does.
+ */
+static void
+merge_properties(TagLib::PropertyMap &dst, const TagLib::PropertyMap &src,
+                 const TagLib::StringList &keys)
+{
+    for (auto &iter : src) {
+        if (keys.contains(iter.first)) {
+            dst.insert(iter.first, iter.second);
+        }
+    }
+}
+
+/**
+ * Check if an ID3v2 frame's property key depends on the frame's content
+ *
+ * Comments, user defined URLs, unique file identifiers and people lists may
+ * map to different keys, depending on their description or owner.
+ * User defined text frames are handled separately.
+ */
+static bool
+id3v2_content_keyed(const TagLib::ByteVector &id)
+{
+    return id == "COMM" || id == "WXXX" || id == "UFID"
+        || id == "TIPL" || id == "TMCL";
+}
+
+/**
+ * Check if an ID3v2 frame may carry one of a set of properties
+ *
+ * @param  id     the frame's ID
+ * @param  keys   TagLib property keys to look for
+ *
+ * @return true if the frame needs to be converted to find out.
+ */
+bool
+amded_id3v2_frame_wanted(const TagLib::ByteVector &id,
+                         const TagLib::StringList &keys)
+{
+    return id == "TXXX" || id3v2_content_keyed(id)
+        || keys.contains(TagLib::ID3v2::Frame::frameIDToKey(id));
+}
+
+/**
+ * Add the properties named in ‘keys’ from an ID3v2 frame to a map
+ *
+ * User defined text frames are only converted, if their description maps
+ * to one of ‘keys’.
+ *
+ * @param  rv     property map to add to
+ * @param  frame  the frame to look at
+ * @param  keys   TagLib property keys to look for
+ *
+ * @return void
+ */
+void
+amded_id3v2_frame_properties(TagLib::PropertyMap &rv,
+                             const TagLib::ID3v2::Frame *frame,
+                             const TagLib::StringList &keys)
+{
+    if (frame->frameID() == "TXXX") {
+        auto txxx =
+            dynamic_cast<const TagLib::ID3v2::UserTextIdentificationFrame *>(
+                frame);
+        if (txxx == nullptr || !keys.contains(
+                TagLib::ID3v2::Frame::txxxToKey(txxx->description())))
+        {
+            return;
+        }
+    }
+    merge_properties(rv, frame->asProperties(), keys);
+}
+
+/**
+ * Look up properties in an ID3v2 tag
+ *
+ * ‘ID3v2::Tag::properties()’ converts every frame in the tag, including
+ * pictures and all sorts of private data. Here, only frames that may carry
+ * one of ‘keys’ are converted. Frames are still visited in tag order, so
+ * the values of every key end up exactly as in the full map.
+ */
+TagLib::PropertyMap
+amded_id3v2_properties(const TagLib::ID3v2::Tag *tag,
+                       const TagLib::StringList &keys)
+{
+    TagLib::PropertyMap rv;
+    for (auto frame : tag->frameList()) {
+        if (amded_id3v2_frame_wanted(frame->frameID(), keys)) {
+            amded_id3v2_frame_properties(rv, frame, keys);
+        }
+    }
+    return rv;
+}
+
+/**
+ * Look up properties in a Xiph comment
+ *
+ * The properties of a Xiph comment are its field list map; this copies
+ * only the requested fields out of it.
+ */
+TagLib::PropertyMap
+amded_xiph_properties(const TagLib::Ogg::XiphComment *tag,
+                      const TagLib::StringList &keys)
+{
+    TagLib::PropertyMap rv;
+    const TagLib::SimplePropertyMap &fields = tag->fieldListMap();
+    for (auto &key : keys) {
+        auto iter = fields.find(key);
+        if (iter != fields.end()) {
+            rv.insert(key, iter->second);
+        }
+    }
+    return rv;
+}
+
+/**
+ * Look up properties in an MP4 tag
+ *
+ * Item names are mapped to property keys first. Only items with one of
+ * ‘keys’ get their values converted.
+ */
+TagLib::PropertyMap
+amded_mp4_properties(const TagLib::MP4::Tag *tag,
+                     const TagLib::StringList &keys)
+{
+    const TagLib::MP4::ItemFactory *factory =
+        TagLib::MP4::ItemFactory::instance();
+    TagLib::PropertyMap rv;
+    for (auto &iter : tag->itemMap()) {
+        const TagLib::ByteVector name =
+            iter.first.data(TagLib::String::Latin1);
+        if (!keys.contains(factory->propertyKeyForName(name))) {
+            continue;
+        }
+        auto prop = factory->itemToProperty(name, iter.second);
+        rv.replace(prop.first, prop.second);
+    }
+    return rv;
+}
+
+/**
+ * Get the complete property map of a file's selected tag
+ *
+ * Unlike ‘get_tags_for_file()’, this converts everything, including the
+ * keys of data, that has no property representation (see
+ * ‘TagLib::PropertyMap::unsupportedData()’).
+ *
+ * @param  file   amded file handle of a file opened with TagLib
+ *
+ * @return The tag's property map.
+ */
 TagLib::PropertyMap
-get_tags_for_file(const struct amded_file &file)
+get_all_tags_for_file(const struct amded_file &file)
 {
     TagLib::MPEG::File *mp3fh;
+    TagLib::FLAC::File *flacfh;
 
     switch (file.type.get_id()) {
     case FILE_T_MP3:
@@ -260,13 +485,81 @@ get_tags_for_file(const struct amded_file &file)
             return mp3fh->APETag()->properties();
         case TAG_T_ID3V1:
             return mp3fh->ID3v1Tag()->properties();
+        default:
+            return TagLib::PropertyMap();
+        }
+    case FILE_T_FLAC:
+        flacfh = reinterpret_cast<TagLib::FLAC::File *>(file.fh);
+        if (flacfh->hasXiphComment() && !flacfh->xiphComment()->isEmpty()) {
+            return flacfh->xiphComment()->properties();
+        }
+        break;
+    default:
+        break;
+    }
+    return file.fh->properties();
+}
+
+/**
+ * Get the properties of a file's tag, that listings need
+ *
+ * The result holds the same values for ‘keys’, that the file's full
+ * property map would hold, but for ID3v2, Xiph and MP4 tags, nothing else
+ * is looked at. Other tag types are small, and their full map is used.
+ * Files read by a native reader (see native.cpp) carry their map along.
+ *
+ * @param  file   amded file handle of an opened file
+ * @param  keys   TagLib property keys to look up
+ *
+ * @return Property map with (at most) the entries for ‘keys’.
+ */
+TagLib::PropertyMap
+get_tags_for_file(const struct amded_file &file,
+                  const TagLib::StringList &keys)
+{
+    TagLib::MPEG::File *mp3fh;
+    TagLib::FLAC::File *flacfh;
+
+    if (file.native != nullptr) {
+        return file.native->properties;
+    }
+
+    switch (file.type.get_id()) {
+    case FILE_T_MP3:
+        mp3fh = reinterpret_cast<TagLib::MPEG::File *>(file.fh);
+        switch (file.tagimpl.get_id()) {
+        case TAG_T_ID3V2:
+            return amded_id3v2_properties(mp3fh->ID3v2Tag(), keys);
+        case TAG_T_APETAG:
+            return mp3fh->APETag()->properties();
+        case TAG_T_ID3V1:
+            return mp3fh->ID3v1Tag()->properties();
         default:
             break;
         }
-        /* FALL-THROUGH */
+        break;
+    case FILE_T_FLAC:
+        /* FLAC files prefer a non-empty Xiph comment over other tags. */
+        flacfh = reinterpret_cast<TagLib::FLAC::File *>(file.fh);
+        if (flacfh->hasXiphComment() && !flacfh->xiphComment()->isEmpty()) {
+            return amded_xiph_properties(flacfh->xiphComment(), keys);
+        }
+        break;
+    case FILE_T_OGG_VORBIS:
+        return amded_xiph_properties(
+            reinterpret_cast<TagLib::Ogg::Vorbis::File *>(file.fh)->tag(),
+            keys);
+    case FILE_T_OPUS:
+        return amded_xiph_properties(
+            reinterpret_cast<TagLib::Ogg::Opus::File *>(file.fh)->tag(),
+            keys);
+    case FILE_T_M4A:
+        return amded_mp4_properties(
+            reinterpret_cast<TagLib::MP4::File *>(file.fh)->tag(), keys);
     default:
-        return file.fh->properties();
+        break;
     }
+    return file.fh->properties();
 }
 
 static bool
@@ -13,15 +13,36 @@
 
 #include <map>
 #include <string>
+#include <vector>
+
+#include <id3v2frame.h>
+#include <id3v2tag.h>
+#include <mp4tag.h>
+#include <xiphcomment.h>
 
 #include "amded.h"
 
 enum file_type get_ext_type(const std::string&);
 bool is_multitag_type(enum file_type);
-bool amded_open(struct amded_file &);
+bool amded_open(struct amded_file &, bool);
+void amded_select_tag_impl(struct amded_file &);
 
 std::string get_tag_types(const struct amded_file &);
-TagLib::PropertyMap get_tags_for_file(const struct amded_file &);
+std::vector<enum tag_impl> get_present_tag_types(const struct amded_file &);
+TagLib::PropertyMap get_tags_for_file(const struct amded_file &,
+                                      const TagLib::StringList &);
+TagLib::PropertyMap get_all_tags_for_file(const struct amded_file &);
+bool amded_id3v2_frame_wanted(const TagLib::ByteVector &,
+                              const TagLib::StringList &);
+void amded_id3v2_frame_properties(TagLib::PropertyMap &,
+                                  const TagLib::ID3v2::Frame *,
+                                  const TagLib::StringList &);
+TagLib::PropertyMap amded_id3v2_properties(const TagLib::ID3v2::Tag *,
+                                           const TagLib::StringList &);
+TagLib::PropertyMap amded_xiph_properties(const TagLib::Ogg::XiphComment *,
+                                          const TagLib::StringList &);
+TagLib::PropertyMap amded_mp4_properties(const TagLib::MP4::Tag *,
+                                         const TagLib::StringList &);
 bool tag_impl_allowed_for_file_type(enum file_type, enum tag_impl);
 void tag_multitag(const struct amded_file &);
 void strip_multitag(const struct amded_file &);
@@ -55,7 +55,7 @@ namespace Amded {
 
     FileType::FileType(enum file_type t)
     {
-        label = file_type_map[t];
+        label = file_type_map.at(t);
         id = t;
     }
 
@@ -77,7 +77,7 @@ namespace Amded {
     FileType&
     FileType::operator=(enum file_type t)
     {
-        label = file_type_map[t];
+        label = file_type_map.at(t);
         id = t;
         return *this;
     }
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2009-2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file  git-version.h
+ * @brief version information based on git commit information
+ *
+ * Generated from git-version.h.in
+ */
+
+#ifndef INC_GIT_VERSION_H
+#define INC_GIT_VERSION_H
+
+#define GIT_VERSION     "noversion-c8d1a6c"
+#define GIT_DESCRIPTION "c8d1a6c ([user-025] Add accurate-length to measure mp3 files by frame scanning, 2026-10-17)"
+
+#endif /* INC_GIT_VERSION_H */
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file hash.cpp
+ * @brief A fast, non-cryptographic hash function
+ *
+ * This is XXH64, as specified by the xxHash project. Its digests match the
+ * ones of the reference implementation (and of the ‘xxh64sum’ tool), so
+ * files named after them can be checked with standard tools.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "hash.h"
+
+namespace {
+
+    const uint64_t prime1 = 0x9e3779b185ebca87ULL;
+    const uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+    const uint64_t prime3 = 0x165667b19e3779f9ULL;
+    const uint64_t prime4 = 0x85ebca77c2b2ae63ULL;
+    const uint64_t prime5 = 0x27d4eb2f165667c5ULL;
+
+    inline uint64_t
+    rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    /** Load little endian words, regardless of the host's byte order */
+    inline uint64_t
+    read64(const unsigned char *p)
+    {
+        return static_cast<uint64_t>(p[0])
+            | static_cast<uint64_t>(p[1]) << 8
+            | static_cast<uint64_t>(p[2]) << 16
+            | static_cast<uint64_t>(p[3]) << 24
+            | static_cast<uint64_t>(p[4]) << 32
+            | static_cast<uint64_t>(p[5]) << 40
+            | static_cast<uint64_t>(p[6]) << 48
+            | static_cast<uint64_t>(p[7]) << 56;
+    }
+
+    inline uint64_t
+    read32(const unsigned char *p)
+    {
+        return static_cast<uint64_t>(p[0])
+            | static_cast<uint64_t>(p[1]) << 8
+            | static_cast<uint64_t>(p[2]) << 16
+            | static_cast<uint64_t>(p[3]) << 24;
+    }
+
+    inline uint64_t
+    round(uint64_t acc, uint64_t input)
+    {
+        acc += input * prime2;
+        acc = rotl(acc, 31);
+        return acc * prime1;
+    }
+
+    inline uint64_t
+    merge_round(uint64_t acc, uint64_t value)
+    {
+        acc ^= round(0, value);
+        return acc * prime1 + prime4;
+    }
+
+    /** Run a stripe of 32 bytes through the four accumulators */
+    inline void
+    stripe(uint64_t *acc, const unsigned char *p)
+    {
+        acc[0] = round(acc[0], read64(p));
+        acc[1] = round(acc[1], read64(p + 8));
+        acc[2] = round(acc[2], read64(p + 16));
+        acc[3] = round(acc[3], read64(p + 24));
+    }
+
+}
+
+namespace Amded {
+
+    Hash64::Hash64(uint64_t s)
+        : seed(s), total(0), buffered(0)
+    {
+        acc[0] = seed + prime1 + prime2;
+        acc[1] = seed + prime2;
+        acc[2] = seed;
+        acc[3] = seed - prime1;
+    }
+
+    /**
+     * Feed data into the hash
+     *
+     * Whole stripes are hashed straight from the caller's buffer; only
+     * the rest of a stripe, that is cut off at the end, is copied.
+     */
+    void
+    Hash64::update(const void *data, std::size_t size)
+    {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        const unsigned char *end = p + size;
+
+        total += size;
+        if (buffered + size < sizeof(buf)) {
+            memcpy(buf + buffered, p, size);
+            buffered += size;
+            return;
+        }
+        if (buffered > 0) {
+            const std::size_t fill = sizeof(buf) - buffered;
+            memcpy(buf + buffered, p, fill);
+            stripe(acc, buf);
+            p += fill;
+            buffered = 0;
+        }
+        while (end - p >= 32) {
+            stripe(acc, p);
+            p += 32;
+        }
+        buffered = end - p;
+        memcpy(buf, p, buffered);
+    }
+
+    /**
+     * Finish the hash of all data fed so far
+     *
+     * This does not change the state, so more data may be fed afterwards.
+     */
+    uint64_t
+    Hash64::digest(void) const
+    {
+        uint64_t h;
+
+        if (total >= 32) {
+            h = rotl(acc[0], 1) + rotl(acc[1], 7)
+                + rotl(acc[2], 12) + rotl(acc[3], 18);
+            for (std::size_t i = 0; i < 4; ++i) {
+                h = merge_round(h, acc[i]);
+            }
+        } else {
+            h = seed + prime5;
+        }
+        h += total;
+
+        const unsigned char *p = buf;
+        const unsigned char *end = buf + buffered;
+        for (; end - p >= 8; p += 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * prime1 + prime4;
+        }
+        if (end - p >= 4) {
+            h ^= read32(p) * prime1;
+            h = rotl(h, 23) * prime2 + prime3;
+            p += 4;
+        }
+        for (; p < end; ++p) {
+            h ^= *p * prime5;
+            h = rotl(h, 11) * prime1;
+        }
+
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+}
+
+/**
+ * Hash a buffer in one go
+ *
+ * @param   data    the data to hash
+ * @param   size    its size in bytes
+ *
+ * @return The data's XXH64 digest, with a seed of zero.
+ */
+uint64_t
+amded_hash64(const void *data, std::size_t size)
+{
+    Amded::Hash64 h;
+    h.update(data, size);
+    return h.digest();
+}
+
+/**
+ * Format a digest the way ‘xxh64sum’ does
+ *
+ * @param   digest  the digest to format
+ *
+ * @return 16 lower case hex digits.
+ */
+std::string
+amded_hash_hex(uint64_t digest)
+{
+    static const char hex[] = "0123456789abcdef";
+    std::string rv(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        rv[i] = hex[digest & 0xf];
+        digest >>= 4;
+    }
+    return rv;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file hash.h
+ * @brief API of a fast, non-cryptographic hash function
+ */
+
+#ifndef INC_HASH_H
+#define INC_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Amded {
+
+    /**
+     * Incremental XXH64
+     *
+     * Data may be fed in pieces of any size; the digest is the same as for
+     * hashing all of it at once.
+     */
+    class Hash64 {
+    private:
+        uint64_t acc[4];
+        uint64_t seed;
+        uint64_t total;
+        unsigned char buf[32];
+        std::size_t buffered;
+
+    public:
+        Hash64(uint64_t = 0);
+        void update(const void *, std::size_t);
+        uint64_t digest(void) const;
+    };
+
+}
+
+uint64_t amded_hash64(const void *, std::size_t);
+std::string amded_hash_hex(uint64_t);
+
+#endif /* INC_HASH_H */
@@ -0,0 +1,630 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file http-stream.cpp
+ * @brief Reading remote files with HTTP range requests
+ *
+ * In listing modes, files may be given as ‘http://’ URLs. Tags live at the
+ * start and at the end of audio files, so only a few kilobytes of a file
+ * are needed to list it. Instead of downloading the whole file, the stream
+ * asks the server for the parts, that TagLib reads, with HTTP/1.1 range
+ * requests (RFC 9110, section 14).
+ *
+ * Data is fetched in blocks of ‘io-block-size’ bytes, and the last few
+ * blocks are kept, so TagLib's many small reads turn into few requests.
+ * When a read needs several blocks, that are missing, they are fetched with
+ * a single request. One connection is kept open per file.
+ *
+ * The first request, for the first block, also tells the size of the file
+ * (from its ‘Content-Range’ header). Servers, that do not support range
+ * requests, answer it with the whole file, which is kept in memory then.
+ *
+ * Only plain HTTP is spoken; there is no TLS support. With ‘io-stats’, the
+ * number of requests, the number of bytes fetched, and the size of the file
+ * are reported.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <tbytevector.h>
+
+#include "amded.h"
+#include "http-stream.h"
+#include "io-stream.h"
+
+namespace {
+
+    /** How many blocks of a file to keep */
+    const std::size_t http_cache_blocks = 16;
+
+    /** Seconds to wait for a server before giving up */
+    const int http_timeout = 30;
+
+    /** Longest status or header line accepted */
+    const std::size_t http_max_line = 64 * 1024;
+
+    /**
+     * Take a URL apart
+     *
+     * @param   url     the URL, like "http://example.com:8080/a/b.mp3"
+     * @param   host    where to store the host name or address
+     * @param   port    where to store the port; "80" if not given
+     * @param   target  where to store the path and query
+     *
+     * @return true if ‘url’ is a usable http:// URL; false otherwise.
+     */
+    bool
+    split_url(const std::string &url, std::string &host, std::string &port,
+              std::string &target)
+    {
+        const std::string scheme = "http://";
+        if (url.compare(0, scheme.size(), scheme) != 0) {
+            return false;
+        }
+        const std::size_t start = scheme.size();
+        const std::size_t end = url.find_first_of("/?#", start);
+        const std::string authority = url.substr(start, end - start);
+        if (authority.find('@') != std::string::npos) {
+            return false;
+        }
+
+        target = end == std::string::npos ? "" : url.substr(end);
+        target = target.substr(0, target.find('#'));
+        if (target.empty() || target[0] != '/') {
+            target = "/" + target;
+        }
+
+        std::string rest;
+        if (!authority.empty() && authority[0] == '[') {
+            const std::size_t close = authority.find(']');
+            if (close == std::string::npos) {
+                return false;
+            }
+            host = authority.substr(1, close - 1);
+            rest = authority.substr(close + 1);
+        } else {
+            const std::size_t colon = authority.find(':');
+            host = authority.substr(0, colon);
+            if (colon != std::string::npos) {
+                rest = authority.substr(colon);
+            }
+        }
+        if (!rest.empty() && rest[0] != ':') {
+            return false;
+        }
+        port = rest.size() > 1 ? rest.substr(1) : "80";
+        return !host.empty();
+    }
+
+    /**
+     * Parse the value of a ‘Content-Range’ header
+     *
+     * @param   value   the header's value, like "bytes 0-65535/7340032"
+     * @param   first   where to store the offset of the first byte sent
+     * @param   last    where to store the offset of the last byte sent
+     * @param   total   where to store the size of the whole file
+     *
+     * @return true if the value was understood; false otherwise.
+     */
+    bool
+    parse_content_range(const std::string &value, uint64_t &first,
+                        uint64_t &last, uint64_t &total)
+    {
+        const char *p = value.c_str();
+        char *end;
+        if (strncmp(p, "bytes ", 6) != 0) {
+            return false;
+        }
+        p += 6;
+        first = strtoull(p, &end, 10);
+        if (end == p || *end != '-') {
+            return false;
+        }
+        p = end + 1;
+        last = strtoull(p, &end, 10);
+        if (end == p || *end != '/' || last < first) {
+            return false;
+        }
+        p = end + 1;
+        total = strtoull(p, &end, 10);
+        return end != p && *end == '\0' && last < total;
+    }
+
+    std::string
+    lower(std::string s)
+    {
+        std::transform(s.begin(), s.end(), s.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        return s;
+    }
+
+    std::string
+    trim(const std::string &s)
+    {
+        const std::size_t first = s.find_first_not_of(" \t");
+        if (first == std::string::npos) {
+            return "";
+        }
+        return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+    }
+
+}
+
+namespace Amded {
+
+    /**
+     * Set up a stream for a URL, and fetch the file's first block
+     *
+     * @param   url         the file's URL
+     * @param   bsize       size of the blocks to fetch
+     * @param   counters    counters to account requests in
+     */
+    HttpStream::HttpStream(const std::string &url, std::size_t bsize,
+                           IOStats &counters)
+        : ReadStream(url, counters), block_size(bsize), valid(false),
+          whole(false), clock(0)
+    {
+        if (!split_url(url, host, port, target)) {
+            fail("Only plain http:// URLs are supported");
+            return;
+        }
+        TagLib::ByteVector head;
+        if (!fetch(0, 0, true, head)) {
+            return;
+        }
+        valid = true;
+        stats.size = size;
+    }
+
+    bool
+    HttpStream::isOpen() const
+    {
+        return valid;
+    }
+
+    /**
+     * Report a failure, and give up on the file
+     */
+    void
+    HttpStream::fail(const std::string &reason)
+    {
+        std::cerr << PROJECT ": `" << path << "': " << reason << std::endl;
+        valid = false;
+        disconnect();
+    }
+
+    bool
+    HttpStream::connect_server(void)
+    {
+        struct addrinfo hints;
+        struct addrinfo *found;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        const int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &found);
+        if (rc != 0) {
+            fail(gai_strerror(rc));
+            return false;
+        }
+
+        int error = 0;
+        for (struct addrinfo *ai = found; ai != nullptr; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+                        ai->ai_protocol);
+            if (fd < 0) {
+                error = errno;
+                continue;
+            }
+            struct timeval tv = { http_timeout, 0 };
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+            if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+                break;
+            }
+            error = errno;
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(found);
+        input.clear();
+        if (fd < 0) {
+            fail(std::string("Could not connect: ") + strerror(error));
+            return false;
+        }
+        return true;
+    }
+
+    void
+    HttpStream::disconnect(void)
+    {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+        input.clear();
+    }
+
+    /**
+     * Receive more data from the server into ‘input’
+     *
+     * @return true if data was received; false at the end of the
+     *         connection, or on errors.
+     */
+    bool
+    HttpStream::receive(void)
+    {
+        char buf[16 * 1024];
+        for (;;) {
+            ssize_t rc = recv(fd, buf, sizeof(buf), 0);
+            if (rc < 0 && errno == EINTR) {
+                continue;
+            }
+            if (rc <= 0) {
+                return false;
+            }
+            input.append(buf, rc);
+            return true;
+        }
+    }
+
+    bool
+    HttpStream::read_line(std::string &line)
+    {
+        std::size_t eol;
+        while ((eol = input.find("\r\n")) == std::string::npos) {
+            if (input.size() > http_max_line || !receive()) {
+                return false;
+            }
+        }
+        line = input.substr(0, eol);
+        input.erase(0, eol + 2);
+        return true;
+    }
+
+    bool
+    HttpStream::read_bytes(std::size_t count, std::string &out)
+    {
+        while (input.size() < count) {
+            if (!receive()) {
+                return false;
+            }
+        }
+        out.append(input, 0, count);
+        input.erase(0, count);
+        return true;
+    }
+
+    /**
+     * Read the body of a response
+     *
+     * @param   chunked     true if the body uses chunked transfer coding
+     * @param   has_length  true if the response gave a ‘Content-Length’
+     * @param   length      the body's length, if ‘has_length’ is true
+     * @param   body        where to store the body
+     *
+     * @return true if the whole body was read; false otherwise.
+     */
+    bool
+    HttpStream::read_body(bool chunked, bool has_length, uint64_t length,
+                          std::string &body)
+    {
+        if (chunked) {
+            for (;;) {
+                std::string line;
+                if (!read_line(line)) {
+                    return false;
+                }
+                char *end;
+                const uint64_t chunk = strtoull(line.c_str(), &end, 16);
+                if (end == line.c_str()) {
+                    return false;
+                }
+                if (chunk == 0) {
+                    /* Skip the trailer section. */
+                    do {
+                        if (!read_line(line)) {
+                            return false;
+                        }
+                    } while (!line.empty());
+                    return true;
+                }
+                if (!read_bytes(chunk, body) || !read_line(line)
+                    || !line.empty())
+                {
+                    return false;
+                }
+            }
+        }
+        if (has_length) {
+            return read_bytes(length, body);
+        }
+        /* The body ends with the connection. */
+        while (receive()) {
+        }
+        body += input;
+        disconnect();
+        return true;
+    }
+
+    /**
+     * Send a range request, and read the response
+     *
+     * A connection, that was kept open, may have been closed by the server
+     * in the meantime. In that case, the request is retried once on a new
+     * connection.
+     *
+     * @param   first   offset of the first byte to ask for
+     * @param   last    offset of the last byte to ask for
+     * @param   status  where to store the response's status code
+     * @param   range   where to store the response's ‘Content-Range’
+     * @param   body    where to store the response's body
+     *
+     * @return true if a response was read; false otherwise.
+     */
+    bool
+    HttpStream::exchange(uint64_t first, uint64_t last, int &status,
+                         std::string &range, std::string &body)
+    {
+        std::ostringstream request;
+        request << "GET " << target << " HTTP/1.1\r\n"
+                << "Host: "
+                << (host.find(':') == std::string::npos
+                    ? host : "[" + host + "]")
+                << (port == "80" ? "" : ":" + port) << "\r\n"
+                << "Range: bytes=" << first << '-' << last << "\r\n"
+                << "User-Agent: " PROJECT "/" VERSION "\r\n"
+                << "\r\n";
+        const std::string data = request.str();
+
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            const bool reused = fd >= 0;
+            if (!reused && !connect_server()) {
+                return false;
+            }
+            stats.reads++;
+
+            std::size_t sent = 0;
+            while (sent < data.size()) {
+                ssize_t rc = send(fd, data.data() + sent, data.size() - sent,
+                                  MSG_NOSIGNAL);
+                if (rc < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (rc <= 0) {
+                    break;
+                }
+                sent += rc;
+            }
+            std::string line;
+            if (sent < data.size() || !read_line(line)) {
+                disconnect();
+                if (reused) {
+                    continue;
+                }
+                fail("No response from server");
+                return false;
+            }
+
+            if (line.compare(0, 7, "HTTP/1.") != 0 || line.size() < 12) {
+                fail("Broken response from server");
+                return false;
+            }
+            bool keep = line.compare(0, 8, "HTTP/1.1") == 0;
+            status = atoi(line.c_str() + 9);
+
+            bool chunked = false;
+            bool has_length = false;
+            uint64_t length = 0;
+            range.clear();
+            for (;;) {
+                if (!read_line(line)) {
+                    fail("Broken response from server");
+                    return false;
+                }
+                if (line.empty()) {
+                    break;
+                }
+                const std::size_t colon = line.find(':');
+                if (colon == std::string::npos) {
+                    continue;
+                }
+                const std::string name = lower(line.substr(0, colon));
+                const std::string value = trim(line.substr(colon + 1));
+                if (name == "content-length") {
+                    has_length = true;
+                    length = strtoull(value.c_str(), nullptr, 10);
+                } else if (name == "transfer-encoding") {
+                    chunked = lower(value).find("chunked")
+                        != std::string::npos;
+                } else if (name == "content-range") {
+                    range = value;
+                } else if (name == "connection") {
+                    if (lower(value) == "close") {
+                        keep = false;
+                    } else if (lower(value) == "keep-alive") {
+                        keep = true;
+                    }
+                }
+            }
+
+            body.clear();
+            if (!read_body(chunked, has_length, length, body)) {
+                fail("Broken response from server");
+                return false;
+            }
+            stats.bytes += body.size();
+            if (!keep) {
+                disconnect();
+            }
+            return true;
+        }
+        fail("No response from server");
+        return false;
+    }
+
+    /**
+     * Fetch a run of blocks, and keep them
+     *
+     * @param   first_block the first block to fetch
+     * @param   last_block  the last block to fetch
+     * @param   probing     true for the first request, which determines
+     *                      the size of the file
+     * @param   rv          where to store the data fetched
+     *
+     * @return true if the blocks were fetched; false otherwise.
+     */
+    bool
+    HttpStream::fetch(uint64_t first_block, uint64_t last_block,
+                      bool probing, TagLib::ByteVector &rv)
+    {
+        const uint64_t first = first_block * block_size;
+        uint64_t last = (last_block + 1) * block_size - 1;
+        if (!probing) {
+            last = std::min<uint64_t>(last, size - 1);
+        }
+
+        int status;
+        std::string range, body;
+        if (!exchange(first, last, status, range, body)) {
+            return false;
+        }
+
+        if (status == 200) {
+            /* The server ignored the range; it sent the whole file. */
+            whole = true;
+            everything = TagLib::ByteVector(body.data(), body.size());
+            size = everything.size();
+            stats.size = size;
+            return true;
+        }
+        if (status == 416 && probing) {
+            /* There is no first byte in an empty file. */
+            size = 0;
+            return true;
+        }
+        if (status != 206) {
+            fail("HTTP status " + std::to_string(status));
+            return false;
+        }
+
+        uint64_t sent_first, sent_last, total;
+        if (!parse_content_range(range, sent_first, sent_last, total)
+            || sent_first != first
+            || sent_last - sent_first + 1 != body.size())
+        {
+            fail("Unexpected Content-Range: " + range);
+            return false;
+        }
+        if (probing) {
+            size = total;
+        }
+
+        rv = TagLib::ByteVector(body.data(), body.size());
+        for (uint64_t b = first_block; b <= last_block; ++b) {
+            const uint64_t offset = (b - first_block) * block_size;
+            if (offset >= rv.size()) {
+                break;
+            }
+            cache[b] = { rv.mid(offset, block_size), ++clock };
+        }
+        return true;
+    }
+
+    TagLib::ByteVector
+    HttpStream::readBlock(std::size_t count)
+    {
+        if (!valid || position >= size || count == 0) {
+            return TagLib::ByteVector();
+        }
+        count = std::min<TagLib::offset_t>(count, size - position);
+
+        const uint64_t start = position;
+        const uint64_t first = start / block_size;
+        const uint64_t last = (start + count - 1) / block_size;
+        TagLib::ByteVector data;
+        for (uint64_t b = first; !whole && b <= last;) {
+            auto it = cache.find(b);
+            if (it != cache.end()) {
+                it->second.used = ++clock;
+                data.append(it->second.data);
+                ++b;
+                continue;
+            }
+            /* Fetch all missing blocks up to the next one kept. */
+            uint64_t e = b;
+            while (e < last && cache.find(e + 1) == cache.end()) {
+                ++e;
+            }
+            TagLib::ByteVector fetched;
+            if (!fetch(b, e, false, fetched)) {
+                return TagLib::ByteVector();
+            }
+            data.append(fetched);
+            b = e + 1;
+        }
+
+        TagLib::ByteVector rv = whole
+            ? everything.mid(start, count)
+            : data.mid(start - first * block_size, count);
+        position += rv.size();
+
+        while (cache.size() > http_cache_blocks) {
+            auto oldest = cache.begin();
+            for (auto it = cache.begin(); it != cache.end(); ++it) {
+                if (it->second.used < oldest->second.used) {
+                    oldest = it;
+                }
+            }
+            cache.erase(oldest);
+        }
+        return rv;
+    }
+
+}
+
+/**
+ * Tell if a file name is a URL, that is to be read over the network
+ */
+bool
+amded_is_url(const std::string &name)
+{
+    return name.compare(0, 7, "http://") == 0
+        || name.compare(0, 8, "https://") == 0;
+}
+
+/**
+ * Get the path of the file, that a URL refers to
+ *
+ * The path decides about the file's type, like the name of a local file.
+ *
+ * @param   url     the URL
+ *
+ * @return The URL's path, without query; ‘url’ if it cannot be parsed.
+ */
+std::string
+amded_url_path(const std::string &url)
+{
+    std::string host, port, target;
+    if (!split_url(url, host, port, target)) {
+        return url;
+    }
+    return target.substr(0, target.find('?'));
+}
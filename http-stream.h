@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file http-stream.h
+ * @brief API for reading remote files with HTTP range requests
+ */
+
+#ifndef INC_HTTP_STREAM_H
+#define INC_HTTP_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <tbytevector.h>
+
+#include "io-stream.h"
+
+namespace Amded {
+
+    /**
+     * A stream reading a file from an HTTP server
+     *
+     * Data is fetched with range requests, in blocks of a configurable size.
+     * The last blocks fetched are kept; reads of blocks, that are missing,
+     * are combined into one request. Servers, that ignore range requests,
+     * send the whole file, which is then kept in memory.
+     */
+    class HttpStream : public ReadStream {
+    private:
+        struct cached {
+            TagLib::ByteVector data;
+            unsigned long used;
+        };
+
+        std::string host;
+        std::string port;
+        std::string target;
+        std::size_t block_size;
+        bool valid;
+        bool whole;
+        TagLib::ByteVector everything;
+        std::map<uint64_t, cached> cache;
+        unsigned long clock;
+        std::string input;
+
+        bool connect_server(void);
+        void disconnect(void);
+        bool receive(void);
+        bool read_line(std::string&);
+        bool read_bytes(std::size_t, std::string&);
+        bool read_body(bool, bool, uint64_t, std::string&);
+        bool exchange(uint64_t, uint64_t, int&, std::string&,
+                      std::string&);
+        bool fetch(uint64_t, uint64_t, bool, TagLib::ByteVector&);
+        void fail(const std::string&);
+
+    public:
+        HttpStream(const std::string&, std::size_t, IOStats&);
+        bool isOpen() const override;
+        TagLib::ByteVector readBlock(std::size_t) override;
+    };
+
+}
+
+bool amded_is_url(const std::string&);
+std::string amded_url_path(const std::string&);
+
+#endif /* INC_HTTP_STREAM_H */
@@ -24,7 +24,9 @@
 
 /** usage information */
 std::vector<std::string> usage = {
-"usage: amded OPTION(s) FILE(s)",
+"usage: amded OPTION(s) [FILE(s)]",
+"       amded -B",
+"       amded [-P <jobs>] [-R <readmap>] [-o <param-list>] -U <socket>",
 "",
 "  informational options:",
 "    -h,               display this help text",
@@ -35,10 +37,20 @@ std::vector<std::string> usage = {
 "    -R <readmap>      configure tag reading order",
 "    -W <writemap>     configure which tag types should be written",
 "    -o <param-list>   pass in a comma-separated list of parameters",
+"    -P <jobs>         list files using <jobs> worker threads",
+"    -f <list>         read names of files to process from <list> (- = stdin)",
+"    -0                names in <list> are NUL terminated (default: newline)",
+"    -r                search directories for supported files recursively",
+"    -F <field-list>   list only the given comma-separated fields",
+"    -T <type>         type of audio data read from stdin (file name -)",
+"    -a <archive>      list the audio files in a tar archive (- = stdin)",
+"    -B                serve requests from stdin (batch mode)",
+"    -U <socket>       serve listing requests on a unix domain socket",
 "  action options:",
 "    -l                list tags in human readable form",
 "    -m                list tags in machine readable form",
 "    -j                list tags in JSON format",
+"    -J                list tags in JSON Lines format",
 "    -S                strip all tags from the file",
 "    -t <tag>=<value>  set a tag to a value",
 "    -d <tag>          delete a tag from the file",
@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file io-stream.cpp
+ * @brief Read-only I/O backends for listing modes
+ *
+ * Left to itself, TagLib opens files by name with its FileStream: It tries
+ * to open them for writing first, and reads them in small buffered chunks,
+ * seeking back and forth. That is fine for local disks, but on network
+ * backed storage, every one of those reads may be a round trip.
+ *
+ * In listing modes, amded hands TagLib one of its own streams instead (see
+ * the ‘io’ parameter):
+ *
+ *   - ‘taglib’: TagLib's FileStream, but opened read-only.
+ *
+ *   - ‘pread’: Reads go to the file with pread(2), in blocks of a
+ *     configurable size (see ‘io-block-size’). TagLib's small reads are
+ *     served from the last block read.
+ *
+ *   - ‘mmap’: The file is mapped into memory, and reads are copied out of
+ *     the mapping. Apart from mapping the file, which ‘io-stats’ counts as
+ *     one read, there are no system calls; the kernel pages in what is
+ *     touched.
+ *
+ * Files are opened with O_RDONLY, O_NOATIME and O_CLOEXEC by all backends;
+ * TagLib's FileStream is handed the descriptor. O_NOATIME is only allowed
+ * for the owner of a file, so it is dropped if the kernel refuses it. With
+ * ‘io-stats’, the number of read system calls and the number of bytes read
+ * are reported for every file listed. TagLib's FileStream reads on its own
+ * and cannot be looked into: With ‘io=taglib’, nothing read through the
+ * stream is counted, including payload hashes and frame scans. Reads of
+ * native readers (see native.cpp), which do not use a stream, are counted
+ * with every backend.
+ *
+ * Files given as ‘http://’ URLs are read with range requests, no matter
+ * which backend is chosen (see http-stream.cpp).
+ *
+ * Audio data given on stdin (as file name ‘-’) is read into memory as a
+ * whole, and handed to TagLib as a ByteVectorStream. Pipes cannot seek, and
+ * TagLib looks at the end of most files.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <tbytevector.h>
+#include <tbytevectorstream.h>
+#include <tfilestream.h>
+#include <tiostream.h>
+
+#include "amded.h"
+#include "http-stream.h"
+#include "io-stream.h"
+#include "setup.h"
+
+/**
+ * Open a file for reading
+ *
+ * @param   name    the file to open
+ *
+ * @return A read-only descriptor of the file; -1 if it cannot be opened.
+ */
+int
+amded_open_read_only(const std::string &name)
+{
+    int fd = open(name.c_str(), O_RDONLY | O_NOATIME | O_CLOEXEC);
+    if (fd < 0 && errno == EPERM) {
+        fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    return fd;
+}
+
+/**
+ * Read a block from a file at a given offset
+ *
+ * @param   fd      the file to read from
+ * @param   buf     where to put the data
+ * @param   count   how much to read
+ * @param   offset  where to read from
+ * @param   stats   counters to account the read in
+ *
+ * @return The number of bytes read; less than ‘count’ at the end of the
+ *         file, or if the file could not be read.
+ */
+std::size_t
+amded_pread(int fd, char *buf, std::size_t count, uint64_t offset,
+            Amded::IOStats &stats)
+{
+    std::size_t done = 0;
+    while (done < count) {
+        ssize_t rc = pread(fd, buf + done, count - done, offset + done);
+        stats.reads++;
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            break;
+        }
+        done += rc;
+    }
+    stats.bytes += done;
+    return done;
+}
+
+namespace Amded {
+
+    /**
+     * Set up a stream
+     *
+     * @param   name        the file's name
+     * @param   given       the file's descriptor, that is taken over; -1 to
+     *                      open the file by name
+     * @param   counters    counters to account reads in
+     */
+    ReadStream::ReadStream(const std::string &name, int given,
+                           IOStats &counters)
+        : path(name), fd(given), position(0), size(0), stats(counters)
+    {
+        if (fd < 0) {
+            fd = amded_open_read_only(name);
+        }
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0) {
+            size = st.st_size;
+            stats.size = size;
+        }
+    }
+
+    /**
+     * Set up a stream, that does not read from a local file
+     *
+     * @param   name        the file's name
+     * @param   counters    counters to account reads in
+     */
+    ReadStream::ReadStream(const std::string &name, IOStats &counters)
+        : path(name), fd(-1), position(0), size(0), stats(counters)
+    {
+    }
+
+    ReadStream::~ReadStream()
+    {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    TagLib::FileName
+    ReadStream::name() const
+    {
+        return path.c_str();
+    }
+
+    void
+    ReadStream::writeBlock(const TagLib::ByteVector &)
+    {
+    }
+
+    void
+    ReadStream::insert(const TagLib::ByteVector &, TagLib::offset_t,
+                       std::size_t)
+    {
+    }
+
+    void
+    ReadStream::removeBlock(TagLib::offset_t, std::size_t)
+    {
+    }
+
+    bool
+    ReadStream::readOnly() const
+    {
+        return true;
+    }
+
+    bool
+    ReadStream::isOpen() const
+    {
+        return fd >= 0;
+    }
+
+    void
+    ReadStream::seek(TagLib::offset_t offset, Position p)
+    {
+        switch (p) {
+        case Beginning:
+            position = offset;
+            break;
+        case Current:
+            position += offset;
+            break;
+        case End:
+            position = size + offset;
+            break;
+        }
+        if (position < 0) {
+            position = 0;
+        }
+    }
+
+    TagLib::offset_t
+    ReadStream::tell() const
+    {
+        return position;
+    }
+
+    TagLib::offset_t
+    ReadStream::length()
+    {
+        return size;
+    }
+
+    void
+    ReadStream::truncate(TagLib::offset_t)
+    {
+    }
+
+    PreadStream::PreadStream(const std::string &name, int given,
+                             std::size_t bsize, IOStats &counters)
+        : ReadStream(name, given, counters), block_size(bsize),
+          block_start(0)
+    {
+    }
+
+    TagLib::ByteVector
+    PreadStream::readBlock(std::size_t count)
+    {
+        if (fd < 0 || position >= size) {
+            return TagLib::ByteVector();
+        }
+        count = std::min<TagLib::offset_t>(count, size - position);
+
+        const TagLib::offset_t end = position + count;
+        if (position < block_start || end > block_start + block.size()) {
+            if (count >= block_size) {
+                TagLib::ByteVector rv(count, 0);
+                rv.resize(amded_pread(fd, rv.data(), count, position, stats));
+                position += rv.size();
+                return rv;
+            }
+            const std::size_t want =
+                std::min<TagLib::offset_t>(block_size, size - position);
+            block.resize(want);
+            block.resize(amded_pread(fd, block.data(), want, position, stats));
+            block_start = position;
+        }
+
+        TagLib::ByteVector rv = block.mid(position - block_start, count);
+        position += rv.size();
+        return rv;
+    }
+
+    MmapStream::MmapStream(const std::string &name, int given,
+                           IOStats &counters)
+        : ReadStream(name, given, counters), map(nullptr)
+    {
+        if (fd < 0 || size == 0) {
+            return;
+        }
+        void *m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        stats.reads++;
+        if (m != MAP_FAILED) {
+            map = static_cast<const char *>(m);
+        }
+        /* The mapping stays valid without the descriptor. */
+        close(fd);
+        fd = -1;
+    }
+
+    MmapStream::~MmapStream()
+    {
+        if (map != nullptr) {
+            munmap(const_cast<char *>(map), size);
+        }
+    }
+
+    bool
+    MmapStream::isOpen() const
+    {
+        return map != nullptr || (fd >= 0 && size == 0);
+    }
+
+    TagLib::ByteVector
+    MmapStream::readBlock(std::size_t count)
+    {
+        if (map == nullptr || position >= size) {
+            return TagLib::ByteVector();
+        }
+        count = std::min<TagLib::offset_t>(count, size - position);
+        TagLib::ByteVector rv(map + position, count);
+        position += count;
+        stats.bytes += count;
+        return rv;
+    }
+
+}
+
+/**
+ * Read all of stdin into a stream
+ *
+ * @param   stats   counters to account reads in
+ *
+ * @return The stream holding the data, that was read. Writing to it
+ *         modifies the data in memory.
+ */
+std::unique_ptr<TagLib::ByteVectorStream>
+amded_stdin_stream(Amded::IOStats &stats)
+{
+    const std::size_t chunk = 64 * 1024;
+    auto rv = std::make_unique<TagLib::ByteVectorStream>(TagLib::ByteVector());
+    TagLib::ByteVector &data = *rv->data();
+    std::size_t done = 0;
+    for (;;) {
+        data.resize(done + chunk);
+        ssize_t rc = read(STDIN_FILENO, data.data() + done, chunk);
+        stats.reads++;
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            break;
+        }
+        done += rc;
+    }
+    data.resize(done);
+    stats.bytes += done;
+    return rv;
+}
+
+/**
+ * Create the stream to read a file with in listing modes
+ *
+ * Which kind of stream is used depends on the ‘io’ parameter.
+ *
+ * @param   name    the file's name; ‘-’ reads stdin, URLs are fetched
+ *                  over HTTP
+ * @param   fd      descriptor to read the file from; -1 to open it by name.
+ *                  The caller keeps ‘fd’; streams use a duplicate.
+ * @param   stats   counters to account reads in
+ *
+ * @return The stream. If the file cannot be opened, the stream reports it
+ *         via ‘isOpen()’, which makes TagLib treat the file as invalid.
+ */
+std::unique_ptr<TagLib::IOStream>
+amded_io_stream(const std::string &name, int fd, Amded::IOStats &stats)
+{
+    if (name == "-" && fd < 0) {
+        return amded_stdin_stream(stats);
+    }
+    if (amded_is_url(name)) {
+        return std::make_unique<Amded::HttpStream>(name, get_io_block_size(),
+                                                   stats);
+    }
+    int own = fd >= 0 ? fcntl(fd, F_DUPFD_CLOEXEC, 0) : -1;
+
+    switch (get_io_backend()) {
+    case IO_BACKEND_PREAD:
+        return std::make_unique<Amded::PreadStream>(
+            name, own, get_io_block_size(), stats);
+    case IO_BACKEND_MMAP:
+        return std::make_unique<Amded::MmapStream>(name, own, stats);
+    default:
+        break;
+    }
+    if (own < 0) {
+        own = amded_open_read_only(name);
+    }
+    /* The stream closes its descriptor. */
+    if (own >= 0) {
+        return std::make_unique<TagLib::FileStream>(own, true);
+    }
+    /* This fails just the same, but reports it the way TagLib expects. */
+    return std::make_unique<TagLib::FileStream>(name.c_str(), true);
+}
+
+/**
+ * Report what reading a file took, if ‘io-stats’ is in effect
+ *
+ * @param   name    the file's name
+ * @param   stats   the file's counters
+ *
+ * @return void
+ */
+void
+amded_io_report(const std::string &name, const Amded::IOStats &stats)
+{
+    if (!get_opt(AMDED_IO_STATS)) {
+        return;
+    }
+    std::cerr << PROJECT ": I/O for `" << name << "': "
+              << stats.reads << " reads, "
+              << stats.bytes << " bytes";
+    if (stats.size > 0) {
+        std::cerr << " of " << stats.size;
+    }
+    std::cerr << std::endl;
+}
+
+/**
+ * Report the peak resident set size of the process, if ‘peak-rss’ is in
+ * effect
+ *
+ * This is the high-water mark of the whole process, including all worker
+ * threads, since it was started.
+ *
+ * @return void
+ */
+void
+amded_rss_report(void)
+{
+    if (!get_opt(AMDED_PEAK_RSS)) {
+        return;
+    }
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0) {
+        return;
+    }
+    /* Linux reports kilobytes. */
+    std::cerr << PROJECT ": Peak RSS: " << usage.ru_maxrss << " KiB"
+              << std::endl;
+}
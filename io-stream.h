@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file io-stream.h
+ * @brief API for amded's read-only I/O backends
+ */
+
+#ifndef INC_IO_STREAM_H
+#define INC_IO_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <tbytevector.h>
+#include <tbytevectorstream.h>
+#include <tiostream.h>
+
+namespace Amded {
+
+    /** What reading a file took (see ‘io-stats’) */
+    struct IOStats {
+        /** Number of system calls (or HTTP requests), that read data */
+        unsigned long reads = 0;
+        /** Number of bytes read */
+        uint64_t bytes = 0;
+        /** Size of the file read; zero if unknown */
+        uint64_t size = 0;
+    };
+
+    /**
+     * Common part of amded's read-only streams
+     *
+     * The stream owns its descriptor. All writing operations are refused,
+     * just like they are by a read-only TagLib::FileStream.
+     */
+    class ReadStream : public TagLib::IOStream {
+    protected:
+        std::string path;
+        int fd;
+        TagLib::offset_t position;
+        TagLib::offset_t size;
+        IOStats &stats;
+
+        ReadStream(const std::string&, IOStats&);
+
+    public:
+        ReadStream(const std::string&, int, IOStats&);
+        ~ReadStream() override;
+
+        TagLib::FileName name() const override;
+        void writeBlock(const TagLib::ByteVector&) override;
+        void insert(const TagLib::ByteVector&, TagLib::offset_t,
+                    std::size_t) override;
+        void removeBlock(TagLib::offset_t, std::size_t) override;
+        bool readOnly() const override;
+        bool isOpen() const override;
+        void seek(TagLib::offset_t, Position) override;
+        TagLib::offset_t tell() const override;
+        TagLib::offset_t length() override;
+        void truncate(TagLib::offset_t) override;
+    };
+
+    /**
+     * A stream reading files with pread(2) in large blocks
+     *
+     * Reads smaller than the block size are served from the last block
+     * read; larger reads go straight to the file.
+     */
+    class PreadStream : public ReadStream {
+    private:
+        std::size_t block_size;
+        TagLib::ByteVector block;
+        TagLib::offset_t block_start;
+
+    public:
+        PreadStream(const std::string&, int, std::size_t, IOStats&);
+        TagLib::ByteVector readBlock(std::size_t) override;
+    };
+
+    /** A stream reading files through a memory mapping */
+    class MmapStream : public ReadStream {
+    private:
+        const char *map;
+
+    public:
+        MmapStream(const std::string&, int, IOStats&);
+        ~MmapStream() override;
+        bool isOpen() const override;
+        TagLib::ByteVector readBlock(std::size_t) override;
+    };
+
+}
+
+int amded_open_read_only(const std::string&);
+std::size_t amded_pread(int, char *, std::size_t, uint64_t, Amded::IOStats&);
+std::unique_ptr<TagLib::ByteVectorStream> amded_stdin_stream(Amded::IOStats&);
+std::unique_ptr<TagLib::IOStream> amded_io_stream(const std::string&, int,
+                                                  Amded::IOStats&);
+void amded_io_report(const std::string&, const Amded::IOStats&);
+void amded_rss_report(void);
+
+#endif /* INC_IO_STREAM_H */
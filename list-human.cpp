@@ -22,47 +22,54 @@
 #include "value.h"
 
 static void
-print_iter(const std::pair< const std::string, Value > &iter, bool symbol=false)
+print_iter(std::ostream &out,
+           const std::pair< const std::string, Value > &iter,
+           bool symbol=false)
 {
-    std::cout << std::setw(AMDED_TAG_MAXLENGTH)
-              << std::left
-              << iter.first
-              << " | ";
+    out << std::setw(AMDED_TAG_MAXLENGTH)
+        << std::left
+        << iter.first
+        << " | ";
     if (iter.second.get_type() == TAG_INTEGER) {
-        std::cout << iter.second.get_int();
+        out << iter.second.get_int();
     } else if (iter.second.get_type() == TAG_BOOLEAN) {
-        std::cout << (iter.second.get_bool() ? "true" : "false");
+        out << (iter.second.get_bool() ? "true" : "false");
     } else if (iter.second.get_type() == TAG_STRING) {
         if (symbol) {
-            std::cout << iter.second.get_str().toCString(true);
+            out << iter.second.get_str().toCString(true);
         } else {
-            std::cout << '"'
-                      << iter.second.get_str().toCString(true)
-                      << '"';
+            out << '"'
+                << iter.second.get_str().toCString(true)
+                << '"';
         }
     } else {
-        std::cout << "<INVALID DATA>";
+        out << "<INVALID DATA>";
     }
-    std::cout << std::endl;
+    out << std::endl;
 }
 
 void
-amded_list_human(const struct amded_file &file)
+amded_list_human(const std::string &name, const struct amded_listing &data,
+                 std::ostream &out)
 {
-    std::cout << '<' << file.name << '>' << std::endl;
+    out << '<' << name << '>' << std::endl;
 
-    std::map< std::string, Value > data = amded_list_amded(file);
-    for (auto &iter : data) {
-        print_iter(iter, true);
+    for (auto &iter : data.amded) {
+        print_iter(out, iter, true);
     }
-
-    data = amded_list_tags(file);
-    for (auto &iter : data) {
-        print_iter(iter);
+    for (auto &iter : data.tags) {
+        print_iter(out, iter);
     }
-
-    data = amded_list_audioprops(file.fh->audioProperties());
-    for (auto &iter : data) {
-        print_iter(iter);
+    for (auto &iter : data.props) {
+        print_iter(out, iter);
+    }
+    for (auto &iter : data.raw) {
+        for (auto &value : iter.second) {
+            print_iter(out, { "raw:" + iter.first, value });
+        }
+    }
+    for (auto &key : data.unsupported) {
+        out << std::setw(AMDED_TAG_MAXLENGTH) << std::left << "unsupported"
+            << " | " << key << std::endl;
     }
 }
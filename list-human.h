@@ -11,8 +11,13 @@
 #ifndef INC_LIST_HUMAN_H
 #define INC_LIST_HUMAN_H
 
+#include <iostream>
+#include <string>
+
 #include "amded.h"
+#include "list.h"
 
-void amded_list_human(const struct amded_file &);
+void amded_list_human(const std::string &, const struct amded_listing &,
+                      std::ostream &);
 
 #endif /* INC_LIST_HUMAN_H */
@@ -6,15 +6,30 @@
 /**
  * @file list-json.cpp
  * @brief Tag reader frontend for machines via JSON.
+ *
+ * The output is one JSON object, that maps file names to objects holding the
+ * listing data of each file. It is written incrementally: The opening brace
+ * goes out before the first file is processed, and each file's member is
+ * written as soon as the file is listed. Memory use therefore does not depend
+ * on the number of files in a run, apart from a hash per name, that is kept
+ * to list each file only once (see ‘FileSource::set_unique()’).
+ *
+ * In JSON Lines mode, there is no enclosing object. Every file is described
+ * by an object of its own, that is terminated by a newline and carries the
+ * file's name in its "file-name" member.
+ *
+ * The encoding mimics jsoncpp's minimal StreamWriter, that amded used to
+ * serialise its output with: Members of a file's object are sorted by key,
+ * non-ASCII characters are written as \\u escapes, no whitespace is emitted.
  */
 
+#include <charconv>
+#include <cstddef>
 #include <cstdlib>
 #include <iostream>
-#include <memory>
+#include <map>
 #include <sstream>
-
-#include <json/json.h>
-#include <json/writer.h>
+#include <string>
 
 #include <b64/encode.h>
 
@@ -22,28 +37,143 @@
 #include "list.h"
 #include "setup.h"
 
-static Json::Value data;
+/** Unicode's replacement character, used for broken UTF-8 input */
+#define UNICODE_REPLACEMENT 0xfffd
+
+/**
+ * Decode one UTF-8 sequence, starting at ‘s’
+ *
+ * ‘s’ is advanced to the last byte of the sequence. Broken or overlong
+ * sequences decode to UNICODE_REPLACEMENT.
+ */
+static unsigned int
+utf8_to_codepoint(const char *&s, const char *end)
+{
+    const unsigned int first = static_cast<unsigned char>(*s);
+    unsigned int cp;
+
+    if (first < 0x80) {
+        return first;
+    }
+    if (first < 0xe0) {
+        if (end - s < 2) {
+            return UNICODE_REPLACEMENT;
+        }
+        cp = ((first & 0x1f) << 6) | (s[1] & 0x3f);
+        s += 1;
+        return cp < 0x80 ? UNICODE_REPLACEMENT : cp;
+    }
+    if (first < 0xf0) {
+        if (end - s < 3) {
+            return UNICODE_REPLACEMENT;
+        }
+        cp = ((first & 0x0f) << 12) | ((s[1] & 0x3f) << 6) | (s[2] & 0x3f);
+        s += 2;
+        if (cp >= 0xd800 && cp <= 0xdfff) {
+            return UNICODE_REPLACEMENT;
+        }
+        return cp < 0x800 ? UNICODE_REPLACEMENT : cp;
+    }
+    if (first < 0xf8) {
+        if (end - s < 4) {
+            return UNICODE_REPLACEMENT;
+        }
+        cp = ((first & 0x07) << 18) | ((s[1] & 0x3f) << 12)
+            | ((s[2] & 0x3f) << 6) | (s[3] & 0x3f);
+        s += 3;
+        return cp < 0x10000 ? UNICODE_REPLACEMENT : cp;
+    }
+    return UNICODE_REPLACEMENT;
+}
+
+static void
+put_u16_escape(std::ostream &out, unsigned int u)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char buf[] = {
+        '\\', 'u',
+        hex[(u >> 12) & 0xf], hex[(u >> 8) & 0xf],
+        hex[(u >> 4) & 0xf], hex[u & 0xf]
+    };
+    out.write(buf, sizeof(buf));
+}
+
+/** Write ‘str’ as a quoted and escaped JSON string. */
+static void
+put_string(std::ostream &out, const std::string &str)
+{
+    const char *end = str.data() + str.size();
+
+    out << '"';
+    for (const char *s = str.data(); s < end; ++s) {
+        switch (*s) {
+        case '"':
+            out << "\\\"";
+            continue;
+        case '\\':
+            out << "\\\\";
+            continue;
+        case '\b':
+            out << "\\b";
+            continue;
+        case '\f':
+            out << "\\f";
+            continue;
+        case '\n':
+            out << "\\n";
+            continue;
+        case '\r':
+            out << "\\r";
+            continue;
+        case '\t':
+            out << "\\t";
+            continue;
+        default:
+            break;
+        }
+
+        const unsigned int cp = utf8_to_codepoint(s, end);
+        if (cp < 0x20) {
+            put_u16_escape(out, cp);
+        } else if (cp < 0x80) {
+            out << static_cast<char>(cp);
+        } else if (cp < 0x10000) {
+            put_u16_escape(out, cp);
+        } else {
+            put_u16_escape(out, 0xd800 + (((cp - 0x10000) >> 10) & 0x3ff));
+            put_u16_escape(out, 0xdc00 + ((cp - 0x10000) & 0x3ff));
+        }
+    }
+    out << '"';
+}
 
 static void
-push_item(const std::string &file, std::pair<const std::string, Value> &value)
+put_int(std::ostream &out, int value)
+{
+    char buf[16];
+    auto rc = std::to_chars(buf, buf + sizeof(buf), value);
+    out.write(buf, rc.ptr - buf);
+}
+
+static void
+put_value(std::ostream &out, const std::pair<const std::string, Value> &value)
 {
     switch (value.second.get_type()) {
     case TAG_INTEGER:
-        data[file][value.first] = value.second.get_int();
+        put_int(out, value.second.get_int());
         break;
     case TAG_BOOLEAN:
-        data[file][value.first] = value.second.get_bool();
+        out << (value.second.get_bool() ? "true" : "false");
         break;
     case TAG_STRING:
         if (get_opt(AMDED_JSON_DONT_USE_BASE64)) {
-            data[file][value.first] =
-                value.second.get_str().toCString(true);
+            put_string(out, value.second.get_str().toCString(true));
         } else {
             base64::encoder enc;
             std::istringstream in {value.second.get_str().to8Bit(true)};
-            std::ostringstream out;
-            enc.encode(in, out);
-            data[file][value.first] = out.str();
+            std::ostringstream encoded;
+            enc.encode(in, encoded);
+            put_string(out, encoded.str());
         }
         break;
     default:
@@ -53,34 +183,115 @@ push_item(const std::string &file, std::pair<const std::string, Value> &value)
     }
 }
 
-void
-amded_push_json(const struct amded_file &file)
+/**
+ * Write the "raw-properties" and "unsupported-properties" members
+ *
+ * The former maps each property to an array of all its values, the latter
+ * is an array of keys, that have no property representation. Keys are
+ * written as they are, values are encoded like any other string.
+ */
+static void
+put_raw(std::ostream &out, const struct amded_listing &listing)
 {
-    std::map<std::string, Value> basics;
-    std::map<std::string, Value> tags;
-    std::map<std::string, Value> props;
+    put_string(out, "raw-properties");
+    out << ":{";
+    bool first = true;
+    for (auto &iter : listing.raw) {
+        if (!first) {
+            out << ',';
+        } else {
+            first = false;
+        }
+        put_string(out, iter.first);
+        out << ":[";
+        for (std::size_t i = 0; i < iter.second.size(); ++i) {
+            if (i > 0) {
+                out << ',';
+            }
+            put_value(out, { iter.first, iter.second[i] });
+        }
+        out << ']';
+    }
+    out << "},";
+    put_string(out, "unsupported-properties");
+    out << ":[";
+    for (std::size_t i = 0; i < listing.unsupported.size(); ++i) {
+        if (i > 0) {
+            out << ',';
+        }
+        put_string(out, listing.unsupported[i]);
+    }
+    out << ']';
+}
 
-    basics = amded_list_amded(file);
-    tags = amded_list_tags(file);
-    props = amded_list_audioprops(file.fh->audioProperties());
+/**
+ * Write the JSON object holding a file's listing data
+ *
+ * The three kinds of listing data are merged into one map first, so that the
+ * members of the object come out sorted by key. If ‘with_name’ is set, the
+ * file's name is put in front of those, unencoded. With ‘raw-properties’,
+ * the complete property map and the unsupported keys follow them.
+ */
+static void
+put_record(std::ostream &out, const std::string &name,
+           const struct amded_listing &listing, bool with_name)
+{
+    std::map<std::string, Value> data = listing.amded;
+    data.insert(listing.tags.begin(), listing.tags.end());
+    data.insert(listing.props.begin(), listing.props.end());
 
-    for (auto &iter : basics) {
-        push_item(file.name, iter);
+    bool first = true;
+    out << '{';
+    if (with_name) {
+        put_string(out, "file-name");
+        out << ':';
+        put_string(out, name);
+        first = false;
     }
-    for (auto &iter : tags) {
-        push_item(file.name, iter);
+    for (auto &iter : data) {
+        if (!first) {
+            out << ',';
+        } else {
+            first = false;
+        }
+        put_string(out, iter.first);
+        out << ':';
+        put_value(out, iter);
     }
-    for (auto &iter : props) {
-        push_item(file.name, iter);
+    if (get_opt(AMDED_RAW_PROPERTIES)) {
+        if (!first) {
+            out << ',';
+        }
+        put_raw(out, listing);
     }
+    out << '}';
+}
+
+void
+amded_json_begin(std::ostream &out)
+{
+    out << '{';
+}
+
+void
+amded_list_json(const std::string &name, const struct amded_listing &data,
+                std::ostream &out)
+{
+    put_string(out, name);
+    out << ':';
+    put_record(out, name, data, false);
+}
+
+void
+amded_list_json_lines(const std::string &name,
+                      const struct amded_listing &data, std::ostream &out)
+{
+    put_record(out, name, data, true);
+    out << '\n';
 }
 
 void
-amded_list_json(void)
+amded_json_end(std::ostream &out)
 {
-    Json::StreamWriterBuilder builder;
-    /* This makes the JSON output minimally packed. */
-    builder.settings_["indentation"] = "";
-    std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
-    writer->write(data, &std::cout);
+    out << '}';
 }
@@ -4,16 +4,24 @@
  */
 
 /**
- * @file list-json.cpp
- * @brief Tag reader frontend for machines via JSON.
+ * @file list-json.h
+ * @brief API for tag reader frontend for machines via JSON.
  */
 
 #ifndef INC_LIST_JSON_H
 #define INC_LIST_JSON_H
 
+#include <iostream>
+#include <string>
+
 #include "amded.h"
+#include "list.h"
 
-void amded_push_json(const struct amded_file &);
-void amded_list_json(void);
+void amded_json_begin(std::ostream &);
+void amded_list_json(const std::string &, const struct amded_listing &,
+                     std::ostream &);
+void amded_json_end(std::ostream &);
+void amded_list_json_lines(const std::string &, const struct amded_listing &,
+                           std::ostream &);
 
 #endif /* INC_LIST_JSON_H */
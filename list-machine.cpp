@@ -30,41 +30,49 @@
 #define ASCII_ETX ((char)0x03)
 
 static void
-print_iter(std::pair< const std::string, Value > &iter)
+print_iter(std::ostream &out,
+           const std::pair< const std::string, Value > &iter)
 {
-    std::cout << ASCII_ETX << iter.first << ASCII_STX;
+    out << ASCII_ETX << iter.first << ASCII_STX;
     if (iter.second.get_type() == TAG_INTEGER) {
-        std::cout << iter.second.get_int();
+        out << iter.second.get_int();
     } else if (iter.second.get_type() == TAG_BOOLEAN) {
-        std::cout << (iter.second.get_bool() ? "true" : "false");
+        out << (iter.second.get_bool() ? "true" : "false");
     } else if (iter.second.get_type() == TAG_STRING) {
         if (get_opt(AMDED_MACHINE_DONT_USE_BASE64)) {
-            std::cout << iter.second.get_str().toCString(true);
+            out << iter.second.get_str().toCString(true);
         } else {
             base64::encoder enc;
             std::istringstream in {iter.second.get_str().to8Bit(true)};
-            std::ostringstream out;
-            enc.encode(in, out);
-            std::cout << out.str();
+            std::ostringstream encoded;
+            enc.encode(in, encoded);
+            out << encoded.str();
         }
     }
 }
 
 void
-amded_list_machine(const struct amded_file &file)
+amded_list_machine(const std::string &name, const struct amded_listing &data,
+                   std::ostream &out)
 {
-    std::cout << "file-name" << ASCII_STX << file.name;
+    out << "file-name" << ASCII_STX << name;
 
-    std::map< std::string, Value > data = amded_list_amded(file);
-    for (auto &iter : data) {
-        print_iter(iter);
+    for (auto &iter : data.amded) {
+        print_iter(out, iter);
     }
-    data = amded_list_tags(file);
-    for (auto &iter : data) {
-        print_iter(iter);
+    for (auto &iter : data.tags) {
+        print_iter(out, iter);
     }
-    data = amded_list_audioprops(file.fh->audioProperties());
-    for (auto &iter : data) {
-        print_iter(iter);
+    for (auto &iter : data.props) {
+        print_iter(out, iter);
+    }
+    /* Multi-value properties repeat their key, once for every value. */
+    for (auto &iter : data.raw) {
+        for (auto &value : iter.second) {
+            print_iter(out, { "raw:" + iter.first, value });
+        }
+    }
+    for (auto &key : data.unsupported) {
+        out << ASCII_ETX << "unsupported" << ASCII_STX << key;
     }
 }
@@ -21,29 +21,121 @@
  *
  * All three sources need to check whether or not the user wants to see
  * non-existent and empty tags listed.
+ *
+ * They also get handed the set of fields the user asked for (see ‘-F’).
+ * Fields outside of that set are never computed: That skips lookups of
+ * unwanted tags, probing for tag types and, if none of the audio properties
+ * are asked for, reading those (see ‘amded_list_wants_properties()’). An
+ * empty set means all fields.
+ *
+ * Tags are not converted to a full property map either: Only the keys of
+ * the fields in question are looked up (see ‘get_tags_for_file()’).
+ *
+ * The frontends do not call the backend themselves. They get handed a
+ * ‘struct amded_listing’ instead, that holds all three kinds of data. That
+ * way, listings may also be served from elsewhere, like the cache (see
+ * cache.cpp).
  */
 
+#include <cstdint>
 #include <map>
 #include <string>
 
 #include <fileref.h>
+#include <flacproperties.h>
 #include <tpropertymap.h>
 
 #include "amded.h"
 #include "file-spec.h"
 #include "list.h"
+#include "mp3-scan.h"
+#include "native.h"
+#include "payload.h"
+#include "pictures.h"
 #include "setup.h"
 #include "tag.h"
 #include "value.h"
 
+/** Fields, that ‘amded_list_amded()’ produces */
+static const char *amded_field_names[] = {
+    "file-type", "payload-hash", "tag-type", "tag-types"
+};
+
+/** Fields, that ‘amded_list_audioprops()’ produces */
+static const char *props_field_names[] = {
+    "bit-rate", "channels", "length", "sample-rate", "stream-md5"
+};
+
+static bool
+wanted(const amded_fields &fields, const char *name)
+{
+    return fields.empty() || fields.count(name) > 0;
+}
+
+/** The tags listings contain, with the keys TagLib uses for them */
+static const struct {
+    const char *tagname;
+    const char *propname;
+    bool isint;
+} tag_fields[] = {
+    { "album",          "ALBUM",                false },
+    { "artist",         "ARTIST",               false },
+    { "catalog-number", "CATALOGNUMBER",        false },
+    { "comment",        "COMMENT",              false },
+    { "compilation",    "ALBUMARTIST",          false },
+    { "composer",       "COMPOSER",             false },
+    { "conductor",      "CONDUCTOR",            false },
+    { "description",    "DESCRIPTION",          false },
+    { "genre",          "GENRE",                false },
+    { "label",          "LABEL",                false },
+    { "performer",      "PERFORMER",            false },
+    { "publisher",      "PUBLISHER",            false },
+    { "track-number",   "TRACKNUMBER",          true  },
+    { "track-title",    "TITLE",                false },
+    { "url",            "URL",                  false },
+    { "year",           "DATE",                 true  },
+    { "mb-album-id",    "MUSICBRAINZ_ALBUMID",  false },
+    { "mb-artist-id",   "MUSICBRAINZ_ARTISTID", false },
+    { "mb-track-id",    "MUSICBRAINZ_TRACKID",  false }
+};
+
+/**
+ * Determine the TagLib property keys a projection needs
+ *
+ * @param   fields  the set of fields to list
+ *
+ * @return The keys to look up in a file's tags; empty if no tag fields
+ *         are part of the projection.
+ */
+TagLib::StringList
+amded_list_keys(const amded_fields &fields)
+{
+    TagLib::StringList rv;
+    for (auto &iter : tag_fields) {
+        if (wanted(fields, iter.tagname)) {
+            rv.append(iter.propname);
+        }
+    }
+    /* "is-va" is derived from the album artist, too. */
+    if (wanted(fields, "is-va") && !rv.contains("ALBUMARTIST")) {
+        rv.append("ALBUMARTIST");
+    }
+    return rv;
+}
+
 static void
 tagtomap(std::map< std::string, Value > &m,
          const TagLib::PropertyMap &tags,
          const char *tagname,
          const char *propname,
          const bool wantempty,
-         const bool isint)
+         const bool isint,
+         const amded_fields &fields)
 {
+    if (!wanted(fields, tagname)) {
+        return;
+    }
+
     bool didnothing = false;
     if (tags.contains(propname)) {
         const TagLib::StringList values = tags.find(propname)->second;
@@ -72,79 +164,367 @@ tagtomap(std::map< std::string, Value > &m,
     }
 }
 
+/**
+ * Convert a tag's property map into listing fields
+ */
+static void
+tags_to_fields(std::map< std::string, Value > &m,
+               const TagLib::PropertyMap &tags, bool wantempty,
+               const amded_fields &fields)
+{
+    for (auto &iter : tag_fields) {
+        tagtomap(m, tags, iter.tagname, iter.propname,
+                 wantempty, iter.isint, fields);
+    }
+    if (wanted(fields, "is-va")) {
+        m["is-va"] = tags.contains("ALBUMARTIST");
+    }
+}
+
+/**
+ * Add the fields of every tag of a multi-tag file (see ‘all-tag-blocks’)
+ *
+ * The fields of each tag present in the file are added with the tag's type
+ * as prefix, like "apetag:artist". All tags come from the one file handle,
+ * that was opened already.
+ *
+ * @param   m           the map to add the fields to
+ * @param   file        the file to list
+ * @param   keys        TagLib property keys to look up
+ * @param   wantempty   list empty fields, too
+ * @param   fields      the set of fields to list
+ *
+ * @return void
+ */
+static void
+tag_blocks_to_fields(std::map< std::string, Value > &m,
+                     const struct amded_file &file,
+                     const TagLib::StringList &keys, bool wantempty,
+                     const amded_fields &fields)
+{
+    for (auto type : get_present_tag_types(file)) {
+        struct amded_file block = file;
+        block.tagimpl = type;
+        std::map< std::string, Value > values;
+        tags_to_fields(values, get_tags_for_file(block, keys), wantempty,
+                       fields);
+        const std::string prefix = block.tagimpl.get_label() + ":";
+        for (auto &iter : values) {
+            m[prefix + iter.first] = iter.second;
+        }
+    }
+}
+
 std::map< std::string, Value >
-amded_list_tags(const struct amded_file &file)
+amded_list_tags(const struct amded_file &file, const amded_fields &fields)
 {
-    const TagLib::PropertyMap &tags = get_tags_for_file(file);
     std::map< std::string, Value > retval;
     bool wantempty = get_opt(AMDED_LIST_ALLOW_EMPTY_TAGS);
 
-    if (file.tagimpl.get_id() == TAG_T_NONE) {
-        if (wantempty) {
-            for (auto &iter : tag_map) {
-                if (iter.second.second == TAG_STRING) {
-                    retval[iter.first] = std::string("");
-                } else {
-                    retval[iter.first] = 0;
-                }
+    const TagLib::StringList keys = amded_list_keys(fields);
+    if (keys.isEmpty()) {
+        return retval;
+    }
+
+    if (file.tagimpl.get_id() != TAG_T_NONE) {
+        tags_to_fields(retval, get_tags_for_file(file, keys), wantempty,
+                       fields);
+    } else if (wantempty) {
+        for (auto &iter : tag_map) {
+            if (!wanted(fields, iter.first.c_str())) {
+                continue;
+            }
+            if (iter.second.second == TAG_STRING) {
+                retval[iter.first] = std::string("");
+            } else {
+                retval[iter.first] = 0;
             }
+        }
+        if (wanted(fields, "is-va")) {
             retval["is-va"] = false;
-            return retval;
         }
-        return { };
     }
 
-    tagtomap(retval, tags, "album", "ALBUM", wantempty, false);
-    tagtomap(retval, tags, "artist", "ARTIST", wantempty, false);
-    tagtomap(retval, tags, "catalog-number", "CATALOGNUMBER", wantempty, false);
-    tagtomap(retval, tags, "comment", "COMMENT", wantempty, false);
-    tagtomap(retval, tags, "compilation", "ALBUMARTIST", wantempty, false);
-    if (tags.contains("ALBUMARTIST")) {
-        retval["is-va"] = true;
-    } else {
-        retval["is-va"] = false;
-    }
-    tagtomap(retval, tags, "composer", "COMPOSER", wantempty, false);
-    tagtomap(retval, tags, "conductor", "CONDUCTOR", wantempty, false);
-    tagtomap(retval, tags, "description", "DESCRIPTION", wantempty, false);
-    tagtomap(retval, tags, "genre", "GENRE", wantempty, false);
-    tagtomap(retval, tags, "label", "LABEL", wantempty, false);
-    tagtomap(retval, tags, "performer", "PERFORMER", wantempty, false);
-    tagtomap(retval, tags, "publisher", "PUBLISHER", wantempty, false);
-    tagtomap(retval, tags, "track-number", "TRACKNUMBER", wantempty, true);
-    tagtomap(retval, tags, "track-title", "TITLE", wantempty, false);
-    tagtomap(retval, tags, "url", "URL", wantempty, false);
-    tagtomap(retval, tags, "year", "DATE", wantempty, true);
-    tagtomap(retval, tags, "mb-album-id", "MUSICBRAINZ_ALBUMID", wantempty, false);
-    tagtomap(retval, tags, "mb-artist-id", "MUSICBRAINZ_ARTISTID", wantempty, false);
-    tagtomap(retval, tags, "mb-track-id", "MUSICBRAINZ_TRACKID", wantempty, false);
+    /* Tags, that the read-map did not pick, are listed all the same. */
+    if (get_opt(AMDED_ALL_TAG_BLOCKS) && file.multi_tag) {
+        tag_blocks_to_fields(retval, file, keys, wantempty, fields);
+    }
     return retval;
 }
 
-std::map< std::string, Value >
-amded_list_audioprops(TagLib::AudioProperties *p)
+/**
+ * Turn audio properties into listing fields
+ *
+ * @param   bitrate     the bit-rate in kbit/s
+ * @param   channels    the number of channels
+ * @param   length      the length in seconds
+ * @param   rate        the sample-rate in Hz
+ * @param   md5         the stream's MD5 signature; nullptr if it has none
+ * @param   fields      the set of fields to list
+ *
+ * @return the fields, that ‘fields’ selects.
+ */
+static std::map< std::string, Value >
+props_to_fields(int bitrate, int channels, int length, int rate,
+                const TagLib::ByteVector *md5, const amded_fields &fields)
 {
     std::map< std::string, Value > retval;
-    /* bitrate() actually returns kilo-bitrate */
-    retval["bit-rate"] = p->bitrate() * 1000;
-    retval["channels"] = p->channels();
-    retval["length"] = p->lengthInSeconds();
-    retval["sample-rate"] = p->sampleRate();
+    /* TagLib's bitrate() actually returns kilo-bitrate */
+    if (wanted(fields, "bit-rate")) {
+        retval["bit-rate"] = bitrate * 1000;
+    }
+    if (wanted(fields, "channels")) {
+        retval["channels"] = channels;
+    }
+    if (wanted(fields, "length")) {
+        retval["length"] = length;
+    }
+    if (wanted(fields, "sample-rate")) {
+        retval["sample-rate"] = rate;
+    }
+    /* Flac's STREAMINFO block carries this; all zeroes mean it is unset. */
+    if (get_opt(AMDED_STREAM_MD5) && wanted(fields, "stream-md5")
+        && md5 != nullptr)
+    {
+        if (md5->size() == 16 && *md5 != TagLib::ByteVector(16, '\0')) {
+            retval["stream-md5"] = TagLib::String(md5->toHex());
+        }
+    }
     return retval;
 }
 
 std::map< std::string, Value >
-amded_list_amded(const struct amded_file &file)
+amded_list_audioprops(TagLib::AudioProperties *p, const amded_fields &fields)
+{
+    /* Files opened without reading audio properties do not have any. */
+    if (p == nullptr) {
+        return { };
+    }
+    auto flac = dynamic_cast<TagLib::FLAC::Properties *>(p);
+    const TagLib::ByteVector md5 =
+        flac != nullptr ? flac->signature() : TagLib::ByteVector();
+    return props_to_fields(p->bitrate(), p->channels(), p->lengthInSeconds(),
+                           p->sampleRate(), flac != nullptr ? &md5 : nullptr,
+                           fields);
+}
+
+/**
+ * Turn the audio properties of a native reader into listing fields
+ *
+ * @param   native  the data of a native reader (see native.cpp)
+ * @param   fields  the set of fields to list
+ *
+ * @return the fields, that ‘fields’ selects; empty if the reader did not
+ *         produce audio properties.
+ */
+static std::map< std::string, Value >
+native_audioprops(const Amded::NativeTags &native, const amded_fields &fields)
+{
+    if (!native.has_audio) {
+        return { };
+    }
+    return props_to_fields(native.bitrate, native.channels, native.length,
+                           native.sample_rate, &native.md5, fields);
+}
+
+/**
+ * Replace TagLib's length and bit-rate of an mp3 file by measured ones
+ *
+ * TagLib estimates those for variable bit-rate files without a Xing or VBRI
+ * header. This walks all of the file's frames instead (see mp3-scan.cpp).
+ *
+ * @param   file    the file to measure; it needs to be opened with TagLib
+ * @param   fields  the set of fields to list
+ * @param   props   the file's audio properties, as listed
+ *
+ * @return void
+ */
+static void
+amded_list_mp3_length(const struct amded_file &file,
+                      const amded_fields &fields,
+                      std::map< std::string, Value > &props)
+{
+    struct amded_mp3_scan scan;
+    if ((!wanted(fields, "length") && !wanted(fields, "bit-rate"))
+        || !amded_mp3_scan_file(file, scan))
+    {
+        return;
+    }
+    const uint64_t ms = scan.samples * 1000 / scan.sample_rate;
+    if (wanted(fields, "length")) {
+        props["length"] = static_cast<int>(ms / 1000);
+    }
+    /* Bits per millisecond are kbit/s, like TagLib's bitrate() returns. */
+    if (wanted(fields, "bit-rate") && ms > 0) {
+        props["bit-rate"] =
+            static_cast<int>((scan.bytes * 8 + ms / 2) / ms) * 1000;
+    }
+}
+
+std::map< std::string, Value >
+amded_list_amded(const struct amded_file &file, const amded_fields &fields)
 {
     bool wantempty = get_opt(AMDED_LIST_ALLOW_EMPTY_TAGS);
     std::map< std::string, Value > retval;
-    retval["file-type"] = file.type.get_label();
+    if (wanted(fields, "file-type")) {
+        retval["file-type"] = file.type.get_label();
+    }
+    /* This reads all of the file's audio data. */
+    std::string hash;
+    if (get_opt(AMDED_PAYLOAD_HASH) && wanted(fields, "payload-hash")
+        && amded_payload_hash(file, hash))
+    {
+        retval["payload-hash"] = hash;
+    }
     if (file.multi_tag) {
-        retval["tag-type"] = file.tagimpl.get_label();
-        retval["tag-types"] = get_tag_types(file);
+        if (wanted(fields, "tag-type")) {
+            retval["tag-type"] = file.tagimpl.get_label();
+        }
+        /* This probes the file for each tag type it supports. */
+        if (wanted(fields, "tag-types")) {
+            retval["tag-types"] = get_tag_types(file);
+        }
     } else if (wantempty) {
-        retval["tag-type"] = TagLib::String("");
-        retval["tag-types"] = TagLib::String("");
+        if (wanted(fields, "tag-type")) {
+            retval["tag-type"] = TagLib::String("");
+        }
+        if (wanted(fields, "tag-types")) {
+            retval["tag-types"] = TagLib::String("");
+        }
     }
     return retval;
 }
+
+/**
+ * Add the complete property map of a file's tag to a listing
+ *
+ * Every key of the map is listed with all of its values; keys of data
+ * without a property representation (like pictures in ID3v2 tags) are
+ * listed as they are. This is independent of the fields selected by ‘-F’.
+ *
+ * @param   file    the file to list; it needs to be opened with TagLib
+ * @param   data    the listing to add the data to
+ *
+ * @return void
+ */
+void
+amded_list_raw(const struct amded_file &file, struct amded_listing &data)
+{
+    if (file.fh == nullptr
+        || (file.multi_tag && file.tagimpl.get_id() == TAG_T_NONE))
+    {
+        return;
+    }
+    const TagLib::PropertyMap tags = get_all_tags_for_file(file);
+    for (auto &iter : tags) {
+        std::vector< Value > &values = data.raw[iter.first.to8Bit(true)];
+        for (auto &value : iter.second) {
+            values.push_back(value);
+        }
+    }
+    for (auto &key : tags.unsupportedData()) {
+        data.unsupported.push_back(key.to8Bit(true));
+    }
+}
+
+struct amded_listing
+amded_list_file(const struct amded_file &file, const amded_fields &fields)
+{
+    struct amded_listing rv;
+    rv.amded = amded_list_amded(file, fields);
+    rv.tags = amded_list_tags(file, fields);
+    /* Native readers (see native.cpp) produce properties of their own. */
+    if (file.native != nullptr) {
+        rv.props = native_audioprops(*file.native, fields);
+    } else {
+        rv.props = amded_list_audioprops(
+            file.fh != nullptr ? file.fh->audioProperties() : nullptr, fields);
+    }
+    if (get_opt(AMDED_ACCURATE_LENGTH) && !rv.props.empty()
+        && file.type.get_id() == FILE_T_MP3)
+    {
+        amded_list_mp3_length(file, fields, rv.props);
+    }
+    if (get_opt(AMDED_RAW_PROPERTIES)) {
+        amded_list_raw(file, rv);
+    }
+    if (file.fh != nullptr && !get_picture_store().empty()) {
+        amded_list_pictures(file, rv.amded);
+    }
+    return rv;
+}
+
+/**
+ * Check if a name refers to a field of amded's listings
+ *
+ * @param   name    the name to check
+ *
+ * @return true if ‘name’ is a field, that listings may contain.
+ */
+bool
+amded_list_known_field(const std::string &name)
+{
+    if (name == "is-va" || tag_map.find(name) != tag_map.end()) {
+        return true;
+    }
+    for (auto field : amded_field_names) {
+        if (name == field) {
+            return true;
+        }
+    }
+    for (auto field : props_field_names) {
+        if (name == field) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Check if a projection needs a file's audio properties
+ *
+ * Files may be opened without reading their audio properties, which saves
+ * a lot of work for some file types, when those are not listed anyway.
+ *
+ * @param   fields  the set of fields to list
+ *
+ * @return true if audio properties are part of the projection.
+ */
+bool
+amded_list_wants_properties(const amded_fields &fields)
+{
+    for (auto field : props_field_names) {
+        if (wanted(fields, field)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Drop all fields from a listing, that are not part of a projection
+ *
+ * This is for listings, that were not produced with the projection in
+ * place, like the ones served from the cache.
+ *
+ * @param   data    the listing to modify
+ * @param   fields  the set of fields to keep
+ *
+ * @return void
+ */
+void
+amded_list_project(struct amded_listing &data, const amded_fields &fields)
+{
+    if (fields.empty()) {
+        return;
+    }
+    for (auto *m : { &data.amded, &data.tags, &data.props }) {
+        for (auto iter = m->begin(); iter != m->end();) {
+            if (fields.count(iter->first) > 0) {
+                ++iter;
+            } else {
+                iter = m->erase(iter);
+            }
+        }
+    }
+}
@@ -15,14 +15,44 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <fileref.h>
+#include <tstringlist.h>
 
 #include "amded.h"
+#include "setup.h"
 #include "value.h"
 
-std::map< std::string, Value > amded_list_tags(const struct amded_file &);
-std::map< std::string, Value > amded_list_audioprops(TagLib::AudioProperties*);
-std::map< std::string, Value > amded_list_amded(const struct amded_file &);
+/**
+ * Everything the listing frontends print about a file
+ *
+ * The first three members hold amded-specific information, the file's tags
+ * and the properties of its audio data; see list.cpp for details. The last
+ * two are only filled in with ‘raw-properties’.
+ */
+struct amded_listing {
+    std::map< std::string, Value > amded;
+    std::map< std::string, Value > tags;
+    std::map< std::string, Value > props;
+    /** The tag's complete property map, with all values of each key */
+    std::map< std::string, std::vector< Value > > raw;
+    /** Keys of tag data, that has no property representation */
+    std::vector< std::string > unsupported;
+};
+
+std::map< std::string, Value > amded_list_tags(const struct amded_file &,
+                                               const amded_fields &);
+std::map< std::string, Value > amded_list_audioprops(TagLib::AudioProperties*,
+                                                     const amded_fields &);
+std::map< std::string, Value > amded_list_amded(const struct amded_file &,
+                                                const amded_fields &);
+void amded_list_raw(const struct amded_file &, struct amded_listing &);
+struct amded_listing amded_list_file(const struct amded_file &,
+                                     const amded_fields &);
+bool amded_list_known_field(const std::string &);
+TagLib::StringList amded_list_keys(const amded_fields &);
+bool amded_list_wants_properties(const amded_fields &);
+void amded_list_project(struct amded_listing &, const amded_fields &);
 
 #endif /* INC_LIST_H */
@@ -24,6 +24,8 @@ enum class OperationMode {
     LIST_MACHINE,
     /** list file's tags in machine readable form - JSON flavour */
     LIST_JSON,
+    /** list file's tags in machine readable form - one JSON object per line */
+    LIST_JSON_LINES,
     /** modify meta information in file(s) */
     TAG,
     /** Remove all tags from a file */
@@ -39,7 +41,8 @@ public:
     bool is_list_mode(void) const {
         return (mode == OperationMode::LIST_MACHINE ||
                 mode == OperationMode::LIST_HUMAN ||
-                mode == OperationMode::LIST_JSON);
+                mode == OperationMode::LIST_JSON ||
+                mode == OperationMode::LIST_JSON_LINES);
     };
     bool is_write_mode(void) const {
         return (mode == OperationMode::TAG ||
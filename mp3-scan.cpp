@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file mp3-scan.cpp
+ * @brief Measuring mp3 files by scanning all of their frames
+ *
+ * TagLib derives the length of mp3 files from a Xing or VBRI header, if
+ * there is one, and from the first frame's bit-rate otherwise. For variable
+ * bit-rate files without such a header, that is a guess. With
+ * ‘accurate-length’, all frames are walked instead: Every frame header tells
+ * the frame's size and the number of samples it holds.
+ *
+ * Frames are followed by their sizes. Where that loses track (like with
+ * junk between frames), the data is searched for the next sync word; a
+ * candidate is only accepted, if the header after it is valid and
+ * describes a frame of the same stream. Searching uses SSE2, where the
+ * target supports it, to look at 16 bytes at a time.
+ *
+ * A Xing, Info or VBRI header lives in a frame, that holds no audio; that
+ * frame is not counted.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <tfile.h>
+
+#include "amded.h"
+#include "block-reader.h"
+#include "mp3-scan.h"
+#include "payload.h"
+
+namespace {
+
+    /** Largest frame: MPEG-2.5 layer II, 160 kbit/s, 8 kHz, padded */
+    const std::size_t max_frame = 2881;
+
+    /** Bit-rates in kbit/s, by version (1, 2 and 2.5), layer and index */
+    const int bitrates[2][3][15] = {
+        {
+            { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384,
+              416, 448 },
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320,
+              384 },
+            { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256,
+              320 }
+        },
+        {
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224,
+              256 },
+            { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144,
+              160 },
+            { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144,
+              160 }
+        }
+    };
+
+    const int sample_rates[3] = { 44100, 48000, 32000 };
+
+    struct frame {
+        /** 0: MPEG-1, 1: MPEG-2, 2: MPEG-2.5 */
+        int version;
+        /** 0: layer I, 1: layer II, 2: layer III */
+        int layer;
+        int sample_rate;
+        bool mono;
+        std::size_t size;
+        unsigned int samples;
+    };
+
+    /**
+     * Decode a frame header
+     *
+     * Free format frames (bit-rate index zero) are not supported: Their
+     * size can only be found by searching for the next frame.
+     */
+    bool
+    parse_header(const char *data, frame &f)
+    {
+        const unsigned char *h = reinterpret_cast<const unsigned char *>(data);
+
+        if (h[0] != 0xff || (h[1] & 0xe0) != 0xe0) {
+            return false;
+        }
+        const int version_bits = (h[1] >> 3) & 3;
+        const int layer_bits = (h[1] >> 1) & 3;
+        const int bitrate_index = h[2] >> 4;
+        const int rate_index = (h[2] >> 2) & 3;
+        if (version_bits == 1 || layer_bits == 0 || bitrate_index == 0
+            || bitrate_index == 15 || rate_index == 3)
+        {
+            return false;
+        }
+
+        f.version = version_bits == 3 ? 0 : version_bits == 2 ? 1 : 2;
+        f.layer = 3 - layer_bits;
+        f.sample_rate = sample_rates[rate_index] >> f.version;
+        f.mono = (h[3] >> 6) == 3;
+        const bool padding = (h[2] >> 1) & 1;
+        const long bitrate =
+            bitrates[f.version == 0 ? 0 : 1][f.layer][bitrate_index] * 1000L;
+
+        if (f.layer == 0) {
+            f.samples = 384;
+            f.size = (12 * bitrate / f.sample_rate + padding) * 4;
+        } else if (f.layer == 2 && f.version != 0) {
+            f.samples = 576;
+            f.size = 72 * bitrate / f.sample_rate + padding;
+        } else {
+            f.samples = 1152;
+            f.size = 144 * bitrate / f.sample_rate + padding;
+        }
+        return true;
+    }
+
+    bool
+    same_stream(const frame &a, const frame &b)
+    {
+        return a.version == b.version && a.layer == b.layer
+            && a.sample_rate == b.sample_rate;
+    }
+
+    /** Tell if a frame carries a Xing, Info or VBRI header */
+    bool
+    is_info_frame(const char *data, const frame &f)
+    {
+        if (f.layer != 2) {
+            return false;
+        }
+        /* The Xing header follows the side information. */
+        std::size_t side;
+        if (f.version == 0) {
+            side = f.mono ? 17 : 32;
+        } else {
+            side = f.mono ? 9 : 17;
+        }
+        if (4 + side + 4 <= f.size) {
+            const char *tag = data + 4 + side;
+            if (memcmp(tag, "Xing", 4) == 0 || memcmp(tag, "Info", 4) == 0) {
+                return true;
+            }
+        }
+        return 4 + 32 + 4 <= f.size && memcmp(data + 36, "VBRI", 4) == 0;
+    }
+
+    /**
+     * Find the next possible sync word
+     *
+     * @return The offset of the first 0xff byte in ‘data’, that is followed
+     *         by a byte with its top three bits set; ‘size’ if there is none
+     *         (the last byte is not looked at).
+     */
+    std::size_t
+    find_sync(const unsigned char *data, std::size_t size)
+    {
+        std::size_t i = 0;
+#ifdef __SSE2__
+        const __m128i ff = _mm_set1_epi8(static_cast<char>(0xff));
+        const __m128i e0 = _mm_set1_epi8(static_cast<char>(0xe0));
+        for (; i + 17 <= size; i += 16) {
+            const __m128i a = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(data + i));
+            const __m128i b = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(data + i + 1));
+            const __m128i hit = _mm_and_si128(
+                _mm_cmpeq_epi8(a, ff),
+                _mm_cmpeq_epi8(_mm_and_si128(b, e0), e0));
+            const int mask = _mm_movemask_epi8(hit);
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+#endif
+        for (; i + 1 < size; ++i) {
+            if (data[i] == 0xff && (data[i + 1] & 0xe0) == 0xe0) {
+                return i;
+            }
+        }
+        return size;
+    }
+
+}
+
+/**
+ * Walk all frames of an mp3 file
+ *
+ * @param   file    the file; it needs to be opened with TagLib
+ * @param   rv      where to store the results
+ *
+ * @return true if audio frames were found; false otherwise.
+ */
+bool
+amded_mp3_scan_file(const struct amded_file &file, struct amded_mp3_scan &rv)
+{
+    uint64_t start, end;
+    if (file.fh == nullptr || !amded_mp3_audio_range(file.fh, start, end)) {
+        return false;
+    }
+
+    Amded::BlockReader r(file.fh, start, end);
+    frame first;
+    bool locked = false;
+    bool seen_first = false;
+
+    while (r.need(4)) {
+        frame f;
+        bool ok = parse_header(r.data(), f)
+            && (!seen_first || same_stream(first, f));
+        if (ok && !locked) {
+            /* A candidate needs another header of the same stream behind
+             * it, unless it is the last frame of the file. */
+            frame next;
+            if (r.need(f.size + 4)) {
+                ok = parse_header(r.data() + f.size, next)
+                    && same_stream(f, next);
+            } else {
+                ok = r.need(f.size);
+            }
+        }
+        if (ok && r.need(f.size)) {
+            if (!seen_first) {
+                first = f;
+                seen_first = true;
+                rv.sample_rate = f.sample_rate;
+                if (is_info_frame(r.data(), f)) {
+                    r.skip(f.size);
+                    locked = true;
+                    continue;
+                }
+            }
+            ++rv.frames;
+            rv.samples += f.samples;
+            rv.bytes += f.size;
+            r.skip(f.size);
+            locked = true;
+            continue;
+        }
+
+        /* Lost track: look for the next sync word, from the next byte on. */
+        locked = false;
+        r.need(max_frame);
+        const std::size_t avail = r.available();
+        const std::size_t found = find_sync(
+            reinterpret_cast<const unsigned char *>(r.data()) + 1,
+            avail - 1);
+        r.skip(found + 1 < avail ? found + 1 : avail - 1);
+    }
+    return rv.frames > 0;
+}
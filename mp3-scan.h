@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file mp3-scan.h
+ * @brief API for measuring mp3 files by scanning all of their frames
+ */
+
+#ifndef INC_MP3_SCAN_H
+#define INC_MP3_SCAN_H
+
+#include <cstdint>
+
+#include "amded.h"
+
+/** What a scan of an mp3 file's frames found */
+struct amded_mp3_scan {
+    /** Number of audio frames */
+    uint64_t frames = 0;
+    /** Number of samples per channel, in all of those */
+    uint64_t samples = 0;
+    /** Number of bytes, that those take */
+    uint64_t bytes = 0;
+    int sample_rate = 0;
+};
+
+bool amded_mp3_scan_file(const struct amded_file&, struct amded_mp3_scan&);
+
+#endif /* INC_MP3_SCAN_H */
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file native-mp3.cpp
+ * @brief Native tag reader for MP3 files
+ *
+ * MP3 files may carry up to three tags: An ID3v2 tag at the start of the
+ * file, and an APE tag followed by an ID3v1 tag at its end. This reader
+ * looks for them exactly where TagLib's MPEG::File does:
+ *
+ *   - The ID3v2 tag has to start at offset zero. TagLib also searches for
+ *     tags behind leading garbage, up to the first MPEG frame; files that do
+ *     not start with a tag are left to TagLib.
+ *
+ *   - The ID3v1 tag is the last 128 bytes of the file, if those start with
+ *     "TAG" and are not part of an APE footer.
+ *
+ *   - The APE footer is the 32 bytes in front of the ID3v1 tag, or at the
+ *     end of the file, if there is no ID3v1 tag.
+ *
+ * That takes two reads: The ID3v2 header, and the end of the file. The tag
+ * selected by the read-map costs one more read.
+ *
+ * Of an ID3v2 tag, only frames that may carry one of the requested
+ * properties are parsed (by TagLib's frame factory), while the others are
+ * merely skipped. Tags using unsynchronisation or an extended header, and
+ * ID3v2.2 tags, are handed to TagLib's ID3v2::Tag as a whole. APE and ID3v1
+ * tags are small, and always parsed by TagLib's classes. In all cases,
+ * TagLib only gets to see a block, that holds the tag (see BlockFile).
+ *
+ * With ‘max-frame-bytes’, frames larger than the limit are skipped by their
+ * size, so large embedded pictures or objects are never read.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <apetag.h>
+#include <id3v1tag.h>
+#include <id3v2framefactory.h>
+#include <id3v2header.h>
+#include <id3v2tag.h>
+#include <tbytevector.h>
+#include <tpropertymap.h>
+#include <tstringlist.h>
+
+#include "amded.h"
+#include "file-spec.h"
+#include "native.h"
+#include "setup.h"
+
+namespace {
+
+    /** Size of the ID3v2 tag header; also the size of its footer */
+    const std::size_t id3v2_header_size = 10;
+
+    /** Size of an ID3v2.3 or ID3v2.4 frame header */
+    const std::size_t id3v2_frame_header_size = 10;
+
+    const std::size_t id3v1_size = 128;
+
+    const std::size_t ape_footer_size = 32;
+
+    /**
+     * How much of the end of a file to read to find ID3v1 and APE tags
+     *
+     * TagLib checks the eight bytes in front of "TAG" to tell ID3v1 tags
+     * from the "APETAGEX" magic; the APE footer may precede the ID3v1 tag.
+     */
+    const std::size_t tail_size = id3v1_size + ape_footer_size + 3;
+
+    bool
+    valid_frame_id(const TagLib::ByteVector &id)
+    {
+        if (id.size() != 4) {
+            return false;
+        }
+        for (auto c : id) {
+            if ((c < 'A' || c > 'Z') && (c < '0' || c > '9')) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+}
+
+/**
+ * Read the requested properties from an ID3v2 tag
+ *
+ * The frame loop mirrors TagLib's ID3v2::Tag::parse(), as long as frames
+ * are well-formed: It stops at padding and at the end of the tag. Anything
+ * else ends the loop early, and the file is left to TagLib then. That
+ * includes IDs, that TagLib's frame factory may still accept, like
+ * ID3v2.3 IDs ending in a NUL byte (iTunes writes ID3v2.2 frames that way),
+ * and frames it would stop at: Only TagLib can tell which is which.
+ *
+ * With ‘max-frame-bytes’, tags larger than the limit are not read as a
+ * whole. Frame headers are read one by one instead, and frames larger than
+ * the limit (like embedded pictures) are skipped without being read.
+ *
+ * @param   input   the file to read from
+ * @param   head    the tag's header
+ * @param   keys    TagLib property keys to look up
+ * @param   rv      property map to fill
+ *
+ * @return true if the tag was read; false if TagLib needs to handle it.
+ */
+static bool
+read_id3v2(Amded::NativeFile &input, const TagLib::ByteVector &head,
+           const TagLib::StringList &keys, TagLib::PropertyMap &rv)
+{
+    const TagLib::ID3v2::Header header(head);
+    if (header.tagSize() == 0) {
+        return true;
+    }
+
+    const uint64_t limit = get_max_frame_bytes();
+    const bool whole = limit == 0 || header.tagSize() <= limit;
+    const TagLib::ByteVector data = whole
+        ? input.read(id3v2_header_size, header.tagSize())
+        : TagLib::ByteVector();
+    const unsigned int version = header.majorVersion();
+
+    if ((version != 3 && version != 4)
+        || header.unsynchronisation() || header.extendedHeader())
+    {
+        if (!whole) {
+            return false;
+        }
+        Amded::BlockFile block(TagLib::ByteVector(head).append(data));
+        const TagLib::ID3v2::Tag tag(&block, 0);
+        rv = amded_id3v2_properties(&tag, keys);
+        return true;
+    }
+
+    const unsigned int available = whole ? data.size()
+        : std::min<uint64_t>(header.tagSize(),
+                             input.size() - id3v2_header_size);
+    auto read = [&](unsigned int pos, unsigned int count) {
+        return whole ? data.mid(pos, count)
+                     : input.read(id3v2_header_size + pos, count);
+    };
+
+    unsigned int length = available;
+    if (header.footerPresent() && length >= id3v2_header_size) {
+        length -= id3v2_header_size;
+    }
+
+    const TagLib::ID3v2::FrameFactory *factory =
+        TagLib::ID3v2::FrameFactory::instance();
+    unsigned int pos = 0;
+    while (length > id3v2_frame_header_size
+           && pos < length - id3v2_frame_header_size)
+    {
+        const TagLib::ByteVector fhead = read(pos, id3v2_frame_header_size);
+        if (fhead.size() != id3v2_frame_header_size) {
+            return false;
+        }
+        if (fhead[0] == 0) {
+            /* Padding */
+            break;
+        }
+
+        const TagLib::ID3v2::Frame::Header fh(fhead, version);
+        const TagLib::ByteVector id = fh.frameID();
+        const unsigned int size = fh.frameSize();
+        if (!valid_frame_id(id)
+            || size <= (fh.dataLengthIndicator() ? 4U : 0U)
+            || size > available - pos)
+        {
+            return false;
+        }
+
+        if (amded_id3v2_frame_wanted(id, keys)
+            && (limit == 0 || size <= limit))
+        {
+            std::unique_ptr<TagLib::ID3v2::Frame> frame(factory->createFrame(
+                read(pos, size + id3v2_frame_header_size), &header));
+            if (!frame) {
+                return false;
+            }
+            amded_id3v2_frame_properties(rv, frame.get(), keys);
+        }
+        pos += size + id3v2_frame_header_size;
+    }
+    return true;
+}
+
+/**
+ * Read the properties of an APE tag
+ *
+ * @param   input   the file to read from
+ * @param   footer  where the tag's footer starts
+ * @param   rv      property map to fill
+ *
+ * @return true if the tag was read; false if TagLib needs to handle it.
+ */
+static bool
+read_ape(Amded::NativeFile &input, uint64_t footer,
+         TagLib::PropertyMap &rv)
+{
+    const TagLib::APE::Footer f(input.read(footer, ape_footer_size));
+    const uint64_t size = f.tagSize();
+
+    /* TagLib ignores the items of tags with broken sizes. */
+    if (size <= ape_footer_size || size > input.size()) {
+        return true;
+    }
+    if (size > footer + ape_footer_size) {
+        return false;
+    }
+
+    const TagLib::ByteVector data =
+        input.read(footer + ape_footer_size - size, size);
+    if (data.size() != size) {
+        return false;
+    }
+    Amded::BlockFile block(data);
+    const TagLib::APE::Tag tag(&block, size - ape_footer_size);
+    rv = tag.properties();
+    return true;
+}
+
+/**
+ * Read the properties of an ID3v1 tag
+ *
+ * @param   tail    the end of the file, holding the tag
+ * @param   rv      property map to fill
+ *
+ * @return void
+ */
+static void
+read_id3v1(const TagLib::ByteVector &tail, TagLib::PropertyMap &rv)
+{
+    Amded::BlockFile block(tail.mid(tail.size() - id3v1_size));
+    const TagLib::ID3v1::Tag tag(&block, 0);
+    rv = tag.properties();
+}
+
+/**
+ * Read the tags of an MP3 file
+ *
+ * @param   input   the file to read from
+ * @param   file    amded file handle; ‘file.native’ is filled in
+ * @param   keys    TagLib property keys to look up
+ *
+ * @return true if the file's tags were read; false if TagLib needs to
+ *         handle the file.
+ */
+bool
+amded_native_mp3(Amded::NativeFile &input, struct amded_file &file,
+                 const TagLib::StringList &keys)
+{
+    const uint64_t length = input.size();
+    if (length < id3v2_header_size + tail_size) {
+        return false;
+    }
+
+    const TagLib::ByteVector head = input.read(0, id3v2_header_size);
+    if (head.size() != id3v2_header_size || !head.startsWith("ID3")) {
+        return false;
+    }
+
+    const TagLib::ByteVector tail = input.read(length - tail_size, tail_size);
+    if (tail.size() != tail_size) {
+        return false;
+    }
+    const bool id3v1 = tail.containsAt("TAG", 3 + ape_footer_size)
+        && tail.mid(ape_footer_size, 8) != "APETAGEX";
+    const unsigned int ape_offset = id3v1 ? 3 : 3 + id3v1_size;
+    const bool ape = tail.containsAt("APETAGEX", ape_offset);
+
+    Amded::NativeTags &tags = *file.native;
+    tags.types.insert(TAG_T_ID3V2);
+    if (ape) {
+        tags.types.insert(TAG_T_APETAG);
+    }
+    if (id3v1) {
+        tags.types.insert(TAG_T_ID3V1);
+    }
+    amded_select_tag_impl(file);
+
+    switch (file.tagimpl.get_id()) {
+    case TAG_T_ID3V2:
+        return read_id3v2(input, head, keys, tags.properties);
+    case TAG_T_APETAG:
+        return read_ape(input, length - tail_size + ape_offset,
+                        tags.properties);
+    case TAG_T_ID3V1:
+        read_id3v1(tail, tags.properties);
+        return true;
+    default:
+        return true;
+    }
+}
@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file native-mp4.cpp
+ * @brief Native tag reader for MP4 files
+ *
+ * MP4 files are a tree of atoms. Each atom starts with its size and a four
+ * character name; the size may also be a 64-bit value following the name,
+ * or zero for an atom, that extends to the end of the file. The tags are
+ * the items of the ‘moov/udta/meta/ilst’ atom.
+ *
+ * TagLib's MP4::File parses the entire tree before looking for them. This
+ * reader only visits the atom headers on the way to the ‘ilst’ atom:
+ * Top-level atoms, like the ‘mdat’ atom holding the audio data, are skipped
+ * by their size, and so are all children of ‘moov’ except ‘udta’. Only the
+ * ‘ilst’ atom is read as a whole; with ‘max-frame-bytes’, items larger than
+ * the limit are skipped if the atom exceeds it.
+ *
+ * To decode the items, the ‘ilst’ atom is wrapped into a minimal atom tree
+ * (‘moov/udta/meta/ilst’), that is parsed by TagLib's MP4::File in memory.
+ * That way, all item types, including freeform ‘----’ items, are mapped to
+ * property keys by TagLib, just like for files opened through TagLib.
+ *
+ * Atom sizes and names are checked like TagLib checks them on the way down.
+ * Files with broken atoms in front of ‘moov’, or with top-level containers
+ * other than ‘moov’ (like fragmented files), are left to TagLib. Broken
+ * atoms inside of the skipped subtrees of ‘moov’ are not noticed, though.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include <mp4file.h>
+#include <tbytevector.h>
+#include <tpropertymap.h>
+#include <tstringlist.h>
+
+#include "amded.h"
+#include "file-spec.h"
+#include "native.h"
+#include "setup.h"
+
+namespace {
+
+    /** Size of an atom header with a 32-bit size */
+    const std::size_t atom_header_size = 8;
+
+    /** Size of an atom header with a 64-bit size */
+    const std::size_t atom_header_size64 = 16;
+
+    /** Largest ‘ilst’ payload, that fits into the wrapping atoms' sizes */
+    const uint64_t ilst_max =
+        std::numeric_limits<uint32_t>::max() - 4 * atom_header_size;
+
+    /** Atoms, that TagLib descends into */
+    const char *containers[] = {
+        "moov", "udta", "mdia", "meta", "ilst",
+        "stbl", "minf", "moof", "traf", "trak",
+        "stsd"
+    };
+
+    /** The children, that tell a ‘meta’ atom without version and flags */
+    const char *meta_children[] = {
+        "hdlr", "ilst", "mhdr", "ctry", "lang"
+    };
+
+    struct atom {
+        /** Where the atom starts */
+        uint64_t offset;
+        /** Where the atom's payload starts */
+        uint64_t data;
+        /** Where the atom ends */
+        uint64_t end;
+        TagLib::ByteVector name;
+    };
+
+    /** Outcome of looking for an atom */
+    enum atom_search {
+        ATOM_FOUND,
+        ATOM_MISSING,
+        ATOM_BROKEN
+    };
+
+    bool
+    is_container(const TagLib::ByteVector &name)
+    {
+        for (auto container : containers) {
+            if (name == container) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+}
+
+/**
+ * Read an atom's header
+ *
+ * @param   input   the file to read from
+ * @param   offset  where the atom starts
+ * @param   rv      the atom's position and name
+ *
+ * @return true if TagLib would accept the header; false otherwise.
+ */
+static bool
+read_atom(Amded::NativeFile &input, uint64_t offset, struct atom &rv)
+{
+    const TagLib::ByteVector header = input.read(offset, atom_header_size64);
+    if (header.size() < atom_header_size) {
+        return false;
+    }
+
+    const uint64_t available = input.size() - offset;
+    uint64_t length = header.toUInt(0U);
+    rv.data = offset + atom_header_size;
+    if (length == 0) {
+        length = available;
+    } else if (length == 1) {
+        if (header.size() != atom_header_size64) {
+            return false;
+        }
+        const long long wide = header.toLongLong(atom_header_size);
+        if (wide < 0) {
+            return false;
+        }
+        length = wide;
+        rv.data = offset + atom_header_size64;
+    }
+    if (length < atom_header_size || length > available
+        || rv.data > offset + length)
+    {
+        return false;
+    }
+
+    rv.name = header.mid(4, 4);
+    for (auto ch : rv.name) {
+        if ((ch < ' ' || ch > '~') && ch != '\251') {
+            return false;
+        }
+    }
+    rv.offset = offset;
+    rv.end = offset + length;
+    return true;
+}
+
+/**
+ * Look for the first atom of a given name in a range of a file
+ *
+ * All atoms in the range are visited, so broken ones are noticed even
+ * behind the one, that is looked for.
+ *
+ * @param   input   the file to read from
+ * @param   begin   where the first atom starts
+ * @param   end     where the range ends
+ * @param   name    the name to look for
+ * @param   rv      the atom, that was found
+ *
+ * @return Whether the atom was found, or a broken atom was run into.
+ */
+static enum atom_search
+find_atom(Amded::NativeFile &input, uint64_t begin, uint64_t end,
+          const char *name, struct atom &rv)
+{
+    enum atom_search result = ATOM_MISSING;
+    struct atom current;
+    for (uint64_t offset = begin; offset < end; offset = current.end) {
+        if (!read_atom(input, offset, current)) {
+            return ATOM_BROKEN;
+        }
+        if (result == ATOM_MISSING && current.name == name) {
+            rv = current;
+            result = ATOM_FOUND;
+        }
+    }
+    return result;
+}
+
+/**
+ * Find where the children of a ‘meta’ atom start
+ *
+ * Depending on where the file comes from, ‘meta’ atoms may or may not carry
+ * version and flags in front of their children. Like TagLib, this looks at
+ * what follows to tell the two apart.
+ */
+static uint64_t
+meta_children_offset(Amded::NativeFile &input, const struct atom &meta)
+{
+    const TagLib::ByteVector next = input.read(meta.data, 8).mid(4, 4);
+    for (auto child : meta_children) {
+        if (next == child) {
+            return meta.data;
+        }
+    }
+    return meta.data + 4;
+}
+
+/**
+ * Wrap a payload into an atom with a 32-bit size
+ */
+static TagLib::ByteVector
+make_atom(const char *name, const TagLib::ByteVector &payload)
+{
+    return TagLib::ByteVector::fromUInt(atom_header_size + payload.size())
+        .append(name).append(payload);
+}
+
+/**
+ * Read the items of an ‘ilst’ atom, leaving out items larger than a limit
+ *
+ * Each item is an atom of its own. Their headers are read one by one, and
+ * items larger than ‘limit’ (like cover art) are skipped by their size.
+ *
+ * @param   input   the file to read from
+ * @param   ilst    the ‘ilst’ atom
+ * @param   limit   the largest item to read
+ * @param   rv      the items, that were read
+ *
+ * @return true if the items were read; false otherwise.
+ */
+static bool
+read_items_bounded(Amded::NativeFile &input, const struct atom &ilst,
+                   uint64_t limit, TagLib::ByteVector &rv)
+{
+    struct atom item;
+    for (uint64_t offset = ilst.data; offset < ilst.end; offset = item.end) {
+        if (!read_atom(input, offset, item) || item.end > ilst.end) {
+            return false;
+        }
+        if (item.end - item.offset > limit) {
+            continue;
+        }
+        const TagLib::ByteVector data =
+            input.read(item.offset, item.end - item.offset);
+        if (data.size() != item.end - item.offset) {
+            return false;
+        }
+        rv.append(data);
+    }
+    return true;
+}
+
+/**
+ * Read the requested properties of an MP4 file
+ *
+ * @param   input   the file to read from
+ * @param   file    amded file handle; ‘file.native’ is filled in
+ * @param   keys    TagLib property keys to look up
+ *
+ * @return true if the file's tags were read; false if TagLib needs to
+ *         handle the file.
+ */
+bool
+amded_native_mp4(Amded::NativeFile &input, struct amded_file &file,
+                 const TagLib::StringList &keys)
+{
+    /* Top-level atoms are only checked up to ‘moov’, like TagLib does. */
+    struct atom moov;
+    for (uint64_t offset = 0;; offset = moov.end) {
+        if (offset + atom_header_size > input.size()
+            || !read_atom(input, offset, moov))
+        {
+            return false;
+        }
+        if (moov.name == "moov") {
+            break;
+        }
+        if (is_container(moov.name)) {
+            return false;
+        }
+    }
+
+    amded_select_tag_impl(file);
+
+    struct atom udta, meta, ilst;
+    enum atom_search rc = find_atom(input, moov.data, moov.end, "udta", udta);
+    if (rc == ATOM_FOUND) {
+        rc = find_atom(input, udta.data, udta.end, "meta", meta);
+    }
+    if (rc == ATOM_FOUND) {
+        rc = find_atom(input, meta_children_offset(input, meta), meta.end,
+                       "ilst", ilst);
+    }
+    if (rc == ATOM_BROKEN) {
+        return false;
+    }
+    if (rc == ATOM_MISSING) {
+        return true;
+    }
+
+    const uint64_t limit = get_max_frame_bytes();
+    TagLib::ByteVector items;
+    if (limit > 0 && ilst.end - ilst.data > limit) {
+        if (!read_items_bounded(input, ilst, limit, items)
+            || items.size() > ilst_max)
+        {
+            return false;
+        }
+    } else {
+        if (ilst.end - ilst.data > ilst_max) {
+            return false;
+        }
+        items = input.read(ilst.data, ilst.end - ilst.data);
+        if (items.size() != ilst.end - ilst.data) {
+            return false;
+        }
+    }
+
+    Amded::BlockStream block(
+        make_atom("moov", make_atom("udta", make_atom("meta",
+                  make_atom("ilst", items)))));
+    const TagLib::MP4::File mp4(&block.stream, false);
+    if (!mp4.isValid() || mp4.tag() == nullptr) {
+        return false;
+    }
+    file.native->properties = amded_mp4_properties(mp4.tag(), keys);
+    return true;
+}
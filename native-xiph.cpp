@@ -0,0 +1,396 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file native-xiph.cpp
+ * @brief Native tag readers for FLAC, Ogg Vorbis and Opus files
+ *
+ * All three file types carry their tags in a Xiph comment near the start of
+ * the file:
+ *
+ *   - In FLAC files, it is the first VORBIS_COMMENT metadata block. The
+ *     metadata blocks follow the "fLaC" marker, each with a four byte header
+ *     holding its type, its size and whether it is the last one.
+ *
+ *   - In Ogg Vorbis and Opus files, it is the stream's second packet. Ogg
+ *     files are a sequence of pages; packets are split into segments, the
+ *     sizes of which are listed in the header of the page holding them. A
+ *     packet ends with the first segment shorter than 255 bytes, and may
+ *     continue on the next page.
+ *
+ * These readers walk the metadata blocks or pages with positional reads,
+ * and only read the comment itself. The checks, that make TagLib consider
+ * a file invalid, are mirrored; FLAC files starting with an ID3v2 tag and
+ * Ogg files not starting with a page are left to TagLib, as are FLAC files
+ * with an empty comment and an ID3v1 tag (TagLib falls back to the latter).
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#include <tbytevector.h>
+#include <tpropertymap.h>
+#include <tstringlist.h>
+#include <xiphcomment.h>
+
+#include "amded.h"
+#include "file-spec.h"
+#include "native.h"
+#include "setup.h"
+
+namespace {
+
+    /** Size of a FLAC metadata block header */
+    const std::size_t flac_block_header_size = 4;
+
+    /** FLAC metadata block types, that are special to TagLib */
+    enum flac_block_type {
+        FLAC_STREAMINFO = 0,
+        FLAC_PADDING = 1,
+        FLAC_SEEKTABLE = 3,
+        FLAC_VORBIS_COMMENT = 4
+    };
+
+    /** Flag in a block header's first byte, that marks the last block */
+    const unsigned char flac_last_block = 0x80;
+
+    /** Size of the fixed part of an Ogg page header */
+    const std::size_t ogg_header_size = 27;
+
+    /** Largest possible Ogg page header, including its segment table */
+    const std::size_t ogg_header_max = ogg_header_size + 255;
+
+    /** Flag in an Ogg page header, that marks the last page of a stream */
+    const unsigned char ogg_last_page = 0x04;
+
+    const std::size_t id3v1_size = 128;
+
+}
+
+/**
+ * Check if a file ends in an ID3v1 tag, the way TagLib does
+ *
+ * @param   input   the file to look at
+ *
+ * @return true if the file has an ID3v1 tag.
+ */
+static bool
+has_id3v1(Amded::NativeFile &input)
+{
+    if (input.size() < id3v1_size + 3) {
+        return false;
+    }
+    const TagLib::ByteVector tail =
+        input.read(input.size() - id3v1_size - 3, 11);
+    return tail.size() == 11 && tail.containsAt("TAG", 3)
+        && tail.mid(0, 8) != "APETAGEX";
+}
+
+/**
+ * Decode a STREAMINFO block into audio properties
+ *
+ * The arithmetic is TagLib's (see FLAC::Properties), so that values come
+ * out exactly like they do the usual way. Blocks too short to hold the
+ * needed fields make for all zeroes, just like in TagLib.
+ *
+ * @param   data    the block's data
+ * @param   stream  the size of the audio data in bytes
+ * @param   rv      where to store the properties
+ *
+ * @return void
+ */
+static void
+flac_properties(const TagLib::ByteVector &data, uint64_t stream,
+                Amded::NativeTags &rv)
+{
+    rv.has_audio = true;
+    if (data.size() < 18) {
+        return;
+    }
+    const unsigned int flags = data.toUInt(10U, true);
+    rv.sample_rate = flags >> 12;
+    rv.channels = ((flags >> 9) & 7) + 1;
+    const unsigned long long frames =
+        (static_cast<unsigned long long>(flags & 0xf) << 32)
+        | data.toUInt(14U, true);
+    if (frames > 0 && rv.sample_rate > 0) {
+        const double ms = static_cast<double>(frames) * 1000.0
+            / rv.sample_rate;
+        rv.length = static_cast<int>(ms + 0.5) / 1000;
+        rv.bitrate = static_cast<int>(static_cast<double>(stream) * 8.0
+                                      / ms + 0.5);
+    }
+    if (data.size() >= 34) {
+        rv.md5 = data.mid(18, 16);
+    }
+}
+
+/**
+ * Read a Vorbis comment block, leaving out fields larger than a limit
+ *
+ * The vendor string and the fields are read one by one; those larger than
+ * ‘limit’ (like base64 encoded pictures) are skipped by their length. The
+ * block is rebuilt from the rest, with the field count adjusted.
+ *
+ * @param   input   the file to read from
+ * @param   offset  where the block's data starts
+ * @param   length  the length of the block's data
+ * @param   limit   the largest field to read
+ * @param   rv      the rebuilt block
+ *
+ * @return true if the block was read; false otherwise.
+ */
+static bool
+read_comment_bounded(Amded::NativeFile &input, uint64_t offset,
+                     uint64_t length, uint64_t limit, TagLib::ByteVector &rv)
+{
+    const uint64_t end = offset + length;
+    if (length < 8) {
+        return false;
+    }
+    TagLib::ByteVector size = input.read(offset, 4);
+    if (size.size() != 4) {
+        return false;
+    }
+    uint64_t vendor = size.toUInt(false);
+    if (vendor > end - offset - 4) {
+        return false;
+    }
+    rv = vendor > limit
+        ? TagLib::ByteVector::fromUInt(0, false)
+        : input.read(offset, 4 + vendor);
+    offset += 4 + vendor;
+
+    const TagLib::ByteVector count = input.read(offset, 4);
+    if (end - offset < 4 || count.size() != 4) {
+        return false;
+    }
+    offset += 4;
+
+    TagLib::ByteVector fields;
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < count.toUInt(false); ++i) {
+        size = end - offset < 4 ? TagLib::ByteVector() : input.read(offset, 4);
+        if (size.size() != 4 || size.toUInt(false) > end - offset - 4) {
+            /* TagLib stops at broken fields, too. */
+            break;
+        }
+        const uint64_t field = size.toUInt(false);
+        if (field <= limit) {
+            fields.append(input.read(offset, 4 + field));
+            ++kept;
+        }
+        offset += 4 + field;
+    }
+    rv.append(TagLib::ByteVector::fromUInt(kept, false)).append(fields);
+    return true;
+}
+
+/**
+ * Read the requested properties of a FLAC file
+ *
+ * The block loop mirrors TagLib's FLAC::File::scan(). It visits the
+ * headers of all metadata blocks, so broken files are rejected just like
+ * TagLib rejects them, but only reads the first Vorbis comment block. With
+ * ‘max-frame-bytes’, that block's fields are read one by one, if it is
+ * larger than the limit (see read_comment_bounded()).
+ *
+ * With ‘properties’, the STREAMINFO block is read, too (see
+ * flac_properties()).
+ *
+ * @param   input       the file to read from
+ * @param   file        amded file handle; ‘file.native’ is filled in
+ * @param   keys        TagLib property keys to look up
+ * @param   properties  produce the file's audio properties, too
+ *
+ * @return true if the file's tags were read; false if TagLib needs to
+ *         handle the file.
+ */
+bool
+amded_native_flac(Amded::NativeFile &input, struct amded_file &file,
+                  const TagLib::StringList &keys, bool properties)
+{
+    if (input.read(0, 4) != "fLaC") {
+        return false;
+    }
+
+    TagLib::ByteVector comment;
+    TagLib::ByteVector streaminfo;
+    bool found = false;
+    bool first = true;
+    uint64_t offset = 4;
+    for (;;) {
+        const TagLib::ByteVector header =
+            input.read(offset, flac_block_header_size);
+        if (header.size() != flac_block_header_size) {
+            return false;
+        }
+        const unsigned char type = header[0] & ~flac_last_block;
+        const uint64_t length = header.toUInt(1U, 3U);
+
+        if (first && type != FLAC_STREAMINFO) {
+            return false;
+        }
+        if (length == 0 && type != FLAC_PADDING && type != FLAC_SEEKTABLE) {
+            return false;
+        }
+        offset += flac_block_header_size;
+        if (length > input.size() - offset) {
+            return false;
+        }
+
+        if (first && properties) {
+            streaminfo = input.read(offset, length);
+            if (streaminfo.size() != length) {
+                return false;
+            }
+        }
+        if (type == FLAC_VORBIS_COMMENT && !found) {
+            const uint64_t limit = get_max_frame_bytes();
+            if (limit > 0 && length > limit) {
+                if (!read_comment_bounded(input, offset, length, limit,
+                                          comment))
+                {
+                    return false;
+                }
+            } else {
+                comment = input.read(offset, length);
+                if (comment.size() != length) {
+                    return false;
+                }
+            }
+            found = true;
+        }
+
+        offset += length;
+        first = false;
+        if (header[0] & flac_last_block) {
+            break;
+        }
+    }
+
+    /* With an empty comment, TagLib lists the ID3v1 tag, if there is one. */
+    const bool id3v1 = has_id3v1(input);
+    amded_select_tag_impl(file);
+    if (found) {
+        const TagLib::Ogg::XiphComment tag(comment);
+        if (!tag.isEmpty()) {
+            file.native->properties = amded_xiph_properties(&tag, keys);
+        } else if (id3v1) {
+            return false;
+        }
+    } else if (id3v1) {
+        return false;
+    }
+    if (properties) {
+        /* The audio data runs from the last block to an ID3v1 tag. */
+        const uint64_t end = id3v1 ? input.size() - id3v1_size : input.size();
+        flac_properties(streaminfo, end > offset ? end - offset : 0,
+                        *file.native);
+    }
+    return true;
+}
+
+/**
+ * Reassemble a packet from the start of an Ogg stream
+ *
+ * This mirrors TagLib's Ogg::File::readPages() and Ogg::File::packet().
+ * Like those, it does not tell logical streams apart.
+ *
+ * @param   input   the file to read from
+ * @param   index   the index of the packet to read
+ * @param   packet  the packet's data
+ *
+ * @return true if the packet was read; false otherwise.
+ */
+static bool
+ogg_packet(Amded::NativeFile &input, unsigned int index,
+           TagLib::ByteVector &packet)
+{
+    unsigned int current = 0;
+    uint64_t offset = 0;
+    for (;;) {
+        const TagLib::ByteVector header = input.read(offset, ogg_header_max);
+        if (header.size() < ogg_header_size || !header.startsWith("OggS")) {
+            return false;
+        }
+        const std::size_t segments =
+            static_cast<unsigned char>(header[ogg_header_size - 1]);
+        if (segments < 1 || header.size() < ogg_header_size + segments) {
+            return false;
+        }
+        /* TagLib gives up on the last page, even if it completes a packet. */
+        if (header[5] & ogg_last_page) {
+            return false;
+        }
+
+        std::size_t datasize = 0;
+        for (std::size_t i = 0; i < segments; ++i) {
+            datasize +=
+                static_cast<unsigned char>(header[ogg_header_size + i]);
+        }
+        offset += ogg_header_size + segments;
+        const TagLib::ByteVector data = input.read(offset, datasize);
+        if (data.size() != datasize) {
+            return false;
+        }
+
+        std::size_t pos = 0;
+        for (std::size_t i = 0; i < segments; ++i) {
+            const unsigned char lacing =
+                static_cast<unsigned char>(header[ogg_header_size + i]);
+            if (current == index) {
+                packet.append(data.mid(pos, lacing));
+            }
+            pos += lacing;
+            if (lacing < 255) {
+                if (current == index) {
+                    return true;
+                }
+                ++current;
+            }
+        }
+        offset += datasize;
+    }
+}
+
+/**
+ * Read the requested properties of an Ogg Vorbis or Opus file
+ *
+ * @param   input   the file to read from
+ * @param   file    amded file handle; ‘file.native’ is filled in
+ * @param   keys    TagLib property keys to look up
+ *
+ * @return true if the file's tags were read; false if TagLib needs to
+ *         handle the file.
+ */
+bool
+amded_native_ogg(Amded::NativeFile &input, struct amded_file &file,
+                 const TagLib::StringList &keys)
+{
+    const bool opus = file.type.get_id() == FILE_T_OPUS;
+    TagLib::ByteVector packet;
+
+    if (opus) {
+        if (!ogg_packet(input, 0, packet) || !packet.startsWith("OpusHead")) {
+            return false;
+        }
+        packet.clear();
+    }
+    if (!ogg_packet(input, 1, packet)) {
+        return false;
+    }
+
+    const TagLib::ByteVector magic = opus
+        ? TagLib::ByteVector("OpusTags") : TagLib::ByteVector("\x03vorbis");
+    if (!packet.startsWith(magic)) {
+        return false;
+    }
+
+    const TagLib::Ogg::XiphComment tag(packet.mid(magic.size()));
+    file.native->properties = amded_xiph_properties(&tag, keys);
+    amded_select_tag_impl(file);
+    return true;
+}
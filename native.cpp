@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file native.cpp
+ * @brief Native tag readers for listing modes
+ *
+ * To list a file, amded usually opens it with one of TagLib's file classes.
+ * Those do more than listing needs: An MPEG file, for example, is scanned
+ * for its first audio frame, even if its audio properties are not wanted.
+ *
+ * The native readers (enabled by the ‘native-readers’ parameter) go
+ * straight for the tags instead: They read the few blocks of a file, that
+ * hold them, with positional reads and only look at the properties, that
+ * the listing asks for. The actual decoding is still left to TagLib's tag
+ * classes, so values come out exactly like they do the usual way.
+ *
+ * The readers produce the tag types present in a file and the property map
+ * of the tag, that the read-map selects (see ‘struct Amded::NativeTags’).
+ * The listing backend (see list.cpp) takes it from there.
+ *
+ * Only the FLAC reader produces audio properties, from the STREAMINFO block
+ * and the size of the file (see ‘amded_native_has_properties()’). Whenever
+ * other files' properties are needed, or whenever a reader runs into
+ * something it does not handle, the file is opened with TagLib as usual.
+ * With ‘native-verify’, files are read both ways, and differences are
+ * reported.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <tbytevector.h>
+#include <tstringlist.h>
+
+#include "amded.h"
+#include "io-stream.h"
+#include "list.h"
+#include "native.h"
+#include "value.h"
+
+namespace Amded {
+
+    NativeFile::NativeFile(IOStats &counters)
+        : fd(-1), owned(false), length(0), stats(counters)
+    {
+    }
+
+    NativeFile::~NativeFile()
+    {
+        if (owned && fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    /**
+     * Get ready to read from a file
+     *
+     * @param   name    name of the file to open, unless ‘given’ is set
+     * @param   given   descriptor to read the file from; -1 to open it by
+     *                  name. It is not closed by the NativeFile.
+     *
+     * @return true if the file can be read; false otherwise.
+     */
+    bool
+    NativeFile::open(const std::string &name, int given)
+    {
+        if (given >= 0) {
+            fd = given;
+        } else {
+            fd = amded_open_read_only(name);
+            if (fd < 0) {
+                return false;
+            }
+            owned = true;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+        length = st.st_size;
+        return true;
+    }
+
+    uint64_t
+    NativeFile::size(void) const
+    {
+        return length;
+    }
+
+    /**
+     * Read a block from a file
+     *
+     * @param   offset  where the block starts
+     * @param   count   the block's size
+     *
+     * @return The data read; shorter than ‘count’ at the end of the file,
+     *         or if the file could not be read.
+     */
+    TagLib::ByteVector
+    NativeFile::read(uint64_t offset, std::size_t count)
+    {
+        if (offset >= length) {
+            return TagLib::ByteVector();
+        }
+        if (count > length - offset) {
+            count = length - offset;
+        }
+
+        TagLib::ByteVector rv(count, 0);
+        std::size_t done = amded_pread(fd, rv.data(), count, offset, stats);
+        if (done < count) {
+            rv.resize(done);
+        }
+        return rv;
+    }
+
+}
+
+static bool
+flac_with_properties(Amded::NativeFile &input, struct amded_file &file,
+                     const TagLib::StringList &keys)
+{
+    return amded_native_flac(input, file, keys, true);
+}
+
+static bool
+flac_tags_only(Amded::NativeFile &input, struct amded_file &file,
+               const TagLib::StringList &keys)
+{
+    return amded_native_flac(input, file, keys, false);
+}
+
+/**
+ * Read a file's tags with a native reader
+ *
+ * On success, ‘file.native’ holds the result, ‘file.tagimpl’ and
+ * ‘file.multi_tag’ are set up, and ‘file.fh’ stays unset. The caller owns
+ * ‘file.native’ then.
+ *
+ * @param   file        amded file handle; ‘name’ and ‘type’ need to be set
+ * @param   fd          descriptor to read the file from; -1 to open it by
+ *                      name
+ * @param   keys        TagLib property keys, that the listing needs
+ * @param   properties  read the file's audio properties, too; only for
+ *                      types ‘amded_native_has_properties()’ accepts
+ * @param   stats       counters to account reads in
+ *
+ * @return true if the file's tags were read; false if the file needs to be
+ *         opened with TagLib instead.
+ */
+bool
+amded_native_open(struct amded_file &file, int fd,
+                  const TagLib::StringList &keys, bool properties,
+                  Amded::IOStats &stats)
+{
+    bool (*reader)(Amded::NativeFile &, struct amded_file &,
+                   const TagLib::StringList &);
+
+    if (properties && !amded_native_has_properties(file)) {
+        return false;
+    }
+    switch (file.type.get_id()) {
+    case FILE_T_MP3:
+        reader = amded_native_mp3;
+        break;
+    case FILE_T_FLAC:
+        reader = properties ? flac_with_properties : flac_tags_only;
+        break;
+    case FILE_T_OGG_VORBIS:
+    case FILE_T_OPUS:
+        reader = amded_native_ogg;
+        break;
+    case FILE_T_M4A:
+        reader = amded_native_mp4;
+        break;
+    default:
+        return false;
+    }
+
+    Amded::NativeFile input(stats);
+    if (!input.open(file.name, fd)) {
+        return false;
+    }
+
+    file.native = new Amded::NativeTags;
+    bool rc = reader(input, file, keys);
+    if (!rc) {
+        delete file.native;
+        file.native = nullptr;
+    }
+    return rc;
+}
+
+/**
+ * Tell if a native reader produces a file's audio properties
+ *
+ * @param   file    amded file handle; ‘type’ needs to be set
+ *
+ * @return true if the file's type is read with audio properties.
+ */
+bool
+amded_native_has_properties(const struct amded_file &file)
+{
+    return file.type.get_id() == FILE_T_FLAC;
+}
+
+static bool
+verify_map(const std::string &name,
+           const std::map< std::string, Value > &native,
+           const std::map< std::string, Value > &taglib)
+{
+    bool rv = true;
+    for (auto &iter : taglib) {
+        auto found = native.find(iter.first);
+        if (found == native.end() || found->second != iter.second) {
+            std::cerr << PROJECT ": Native reader mismatch in `" << name
+                      << "': " << iter.first << std::endl;
+            rv = false;
+        }
+    }
+    for (auto &iter : native) {
+        if (taglib.find(iter.first) == taglib.end()) {
+            std::cerr << PROJECT ": Native reader mismatch in `" << name
+                      << "': " << iter.first << " (extra)" << std::endl;
+            rv = false;
+        }
+    }
+    return rv;
+}
+
+/**
+ * Compare a native reader's listing of a file to TagLib's
+ *
+ * This is what the ‘native-verify’ parameter does for every file, that a
+ * native reader handled. Each differing field is reported on stderr.
+ *
+ * @param   name    the file's name
+ * @param   native  listing data produced via the native reader
+ * @param   taglib  listing data produced via TagLib
+ *
+ * @return true if both listings are identical; false otherwise.
+ */
+bool
+amded_native_verify(const std::string &name,
+                    const struct amded_listing &native,
+                    const struct amded_listing &taglib)
+{
+    bool rv = verify_map(name, native.amded, taglib.amded);
+    rv = verify_map(name, native.tags, taglib.tags) && rv;
+    rv = verify_map(name, native.props, taglib.props) && rv;
+    return rv;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file native.h
+ * @brief API for amded's native tag readers
+ */
+
+#ifndef INC_NATIVE_H
+#define INC_NATIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+
+#include <tbytevector.h>
+#include <tbytevectorstream.h>
+#include <tfile.h>
+#include <tpropertymap.h>
+#include <tstringlist.h>
+
+#include "amded.h"
+#include "io-stream.h"
+#include "list.h"
+
+namespace Amded {
+
+    /** What a native reader found out about a file's tags */
+    struct NativeTags {
+        /** The tag types present in the file */
+        std::set<enum tag_impl> types;
+        /** The requested properties of the tag, that is to be read */
+        TagLib::PropertyMap properties;
+        /** Audio properties; only set by readers, that produce them */
+        bool has_audio = false;
+        int bitrate = 0;
+        int channels = 0;
+        int length = 0;
+        int sample_rate = 0;
+        TagLib::ByteVector md5;
+    };
+
+    /** Positional reads from a file */
+    class NativeFile {
+    private:
+        int fd;
+        bool owned;
+        uint64_t length;
+        IOStats &stats;
+
+    public:
+        explicit NativeFile(IOStats&);
+        ~NativeFile();
+
+        bool open(const std::string&, int);
+        uint64_t size(void) const;
+        TagLib::ByteVector read(uint64_t, std::size_t);
+    };
+
+    /** Holds the stream of a BlockFile; needs to be constructed first */
+    struct BlockStream {
+        TagLib::ByteVectorStream stream;
+        explicit BlockStream(const TagLib::ByteVector &data) : stream(data) {}
+    };
+
+    /**
+     * A TagLib file, that holds nothing but a block of data
+     *
+     * TagLib's tag classes read themselves from a file. Handing them a
+     * block, that was read from the actual file, lets them parse a tag
+     * without anything else of the file being touched.
+     */
+    class BlockFile : private BlockStream, public TagLib::File {
+    public:
+        explicit BlockFile(const TagLib::ByteVector &data)
+            : BlockStream(data), TagLib::File(&stream) {}
+
+        TagLib::Tag *tag() const override { return nullptr; }
+        TagLib::AudioProperties *audioProperties() const override {
+            return nullptr;
+        }
+        bool save() override { return false; }
+    };
+
+}
+
+bool amded_native_open(struct amded_file &, int, const TagLib::StringList &,
+                       bool, Amded::IOStats &);
+bool amded_native_has_properties(const struct amded_file &);
+bool amded_native_verify(const std::string &, const struct amded_listing &,
+                         const struct amded_listing &);
+
+bool amded_native_mp3(Amded::NativeFile &, struct amded_file &,
+                      const TagLib::StringList &);
+bool amded_native_flac(Amded::NativeFile &, struct amded_file &,
+                       const TagLib::StringList &, bool);
+bool amded_native_ogg(Amded::NativeFile &, struct amded_file &,
+                      const TagLib::StringList &);
+bool amded_native_mp4(Amded::NativeFile &, struct amded_file &,
+                      const TagLib::StringList &);
+
+#endif /* INC_NATIVE_H */
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file parallel.cpp
+ * @brief Listing files with a pool of worker threads
+ *
+ * Most of the time spent in listing modes goes into TagLib parsing files.
+ * Files are independent of one another, so that work can be spread across a
+ * number of threads (see the ‘-P’ option).
+ *
+ * Workers do not get a fixed share of the file list up front. Instead, every
+ * worker grabs the next unprocessed file whenever it is done with its last
+ * one. Slow files (huge ID3v2 tags, m4a files with the moov atom at the end)
+ * therefore only ever hold up the worker that is processing them.
+ *
+ * File names are pulled from the file source by the workers themselves, one
+ * at a time, so long file lists are never held in memory as a whole.
+ *
+ * Each worker renders a file's record into a string. The main thread puts
+ * those strings onto the output. By default, it does that in command line
+ * order, so the output is exactly the same as with a serial run: Records that
+ * are finished early wait in a reorder buffer until all their predecessors
+ * are printed. That buffer is bounded: Workers do not start on a new file if
+ * that would put it too far ahead of the oldest record still missing. With
+ * the ‘completion-order’ parameter, records are printed as soon as they are
+ * finished instead.
+ */
+
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "parallel.h"
+
+/**
+ * Number of records, per worker, that may be in flight or waiting in the
+ * reorder buffer at any time.
+ */
+#define REORDER_WINDOW_PER_JOB 4
+
+namespace {
+
+/** A finished record, waiting to be emitted */
+struct list_result {
+    bool ok;
+    std::string output;
+};
+
+class ListQueue {
+public:
+    ListQueue(Amded::FileSource &source, std::size_t window, bool ordered)
+        : source(source), window(window), ordered(ordered) {};
+
+    bool
+    take(std::size_t &seq, std::string &name)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        may_take.wait(guard, [this] {
+            return exhausted || issued < emitted + window;
+        });
+        if (exhausted || !source.next(name)) {
+            exhausted = true;
+            may_emit.notify_one();
+            return false;
+        }
+        seq = issued++;
+        return true;
+    }
+
+    void
+    finish(std::size_t seq, bool ok, std::string &&output)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        done.emplace(seq, list_result{ ok, std::move(output) });
+        may_emit.notify_one();
+    }
+
+    bool
+    next(list_result &result)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        may_emit.wait(guard, [this] {
+            if (exhausted && emitted == issued) {
+                return true;
+            }
+            return !done.empty()
+                && (!ordered || done.begin()->first == emitted);
+        });
+        if (done.empty()) {
+            return false;
+        }
+        auto iter = done.begin();
+        result = std::move(iter->second);
+        done.erase(iter);
+        ++emitted;
+        may_take.notify_all();
+        return true;
+    }
+
+private:
+    Amded::FileSource &source;
+    const std::size_t window;
+    const bool ordered;
+    bool exhausted = false;
+    std::size_t issued = 0;
+    std::size_t emitted = 0;
+    std::map<std::size_t, list_result> done;
+    std::mutex lock;
+    std::condition_variable may_take;
+    std::condition_variable may_emit;
+};
+
+} /* anonymous namespace */
+
+/**
+ * List files using a pool of worker threads
+ *
+ * @param  source   supply of file names to process
+ * @param  jobs     number of worker threads to use
+ * @param  ordered  emit records in the order of ‘source’ if true; in the
+ *                  order they are finished otherwise
+ * @param  work     callback that renders one file's record
+ * @param  emit     callback that puts a record onto the output; called from
+ *                  the calling thread only
+ *
+ * @return void
+ */
+void
+amded_list_parallel(Amded::FileSource &source, unsigned int jobs,
+                    bool ordered,
+                    const Amded::ListWorker &work,
+                    const Amded::ListEmitter &emit)
+{
+    ListQueue queue(source, jobs * REORDER_WINDOW_PER_JOB, ordered);
+    std::vector<std::thread> workers;
+
+    for (unsigned int i = 0; i < jobs; ++i) {
+        workers.emplace_back([&queue, &work] {
+            std::size_t seq;
+            std::string name;
+            while (queue.take(seq, name)) {
+                std::string output;
+                bool ok = work(name, output);
+                queue.finish(seq, ok, std::move(output));
+            }
+        });
+    }
+
+    list_result result;
+    while (queue.next(result)) {
+        if (result.ok) {
+            emit(result.output);
+        }
+    }
+
+    for (auto &iter : workers) {
+        iter.join();
+    }
+}
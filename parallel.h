@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file parallel.h
+ * @brief API for listing files with a pool of worker threads
+ */
+
+#ifndef INC_PARALLEL_H
+#define INC_PARALLEL_H
+
+#include <functional>
+#include <string>
+
+#include "file-source.h"
+
+namespace Amded {
+
+/**
+ * Turn one file name into its listing record. Returns false if the file
+ * could not be listed, in which case nothing is emitted for it.
+ */
+using ListWorker = std::function<bool(const std::string &, std::string &)>;
+
+/** Put one finished listing record onto the output. */
+using ListEmitter = std::function<void(const std::string &)>;
+
+}; /* namespace Amded */
+
+void amded_list_parallel(Amded::FileSource &, unsigned int, bool,
+                         const Amded::ListWorker &,
+                         const Amded::ListEmitter &);
+
+#endif /* INC_PARALLEL_H */
@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file payload.cpp
+ * @brief Hashing the audio payload of files
+ *
+ * Two files with the same audio data, but different tags, should get the
+ * same payload hash (see ‘payload-hash’). So only the parts of a file, that
+ * carry audio data, are hashed:
+ *
+ *  - mp3: Everything between leading ID3v2 tags and trailing APE and ID3v1
+ *    tags.
+ *  - flac: Everything after the metadata blocks (and leading ID3v2 tags), up
+ *    to a trailing ID3v1 tag.
+ *  - ogg-vorbis, opus: The data of all packets, but the comment packet
+ *    (the second one of each logical stream). Page headers are left out,
+ *    because their sequence numbers and checksums change, when the comment
+ *    packet changes size.
+ *  - m4a: The contents of all top-level ‘mdat’ atoms.
+ *
+ * The hash is XXH64 (see hash.cpp) of these bytes, in file order. Data is
+ * read through the TagLib file, that the tags were read from, in large
+ * sequential blocks (see block-reader.cpp).
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <tbytevector.h>
+#include <tfile.h>
+
+#include "amded.h"
+#include "block-reader.h"
+#include "hash.h"
+#include "payload.h"
+
+namespace {
+
+    uint64_t
+    be32(const char *p)
+    {
+        const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+        return static_cast<uint64_t>(u[0]) << 24 | u[1] << 16
+            | u[2] << 8 | u[3];
+    }
+
+    uint64_t
+    le32(const char *p)
+    {
+        const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+        return static_cast<uint64_t>(u[3]) << 24 | u[2] << 16
+            | u[1] << 8 | u[0];
+    }
+
+    TagLib::ByteVector
+    read_at(TagLib::File *fh, uint64_t offset, std::size_t size)
+    {
+        fh->seek(offset);
+        return fh->readBlock(size);
+    }
+
+    /** Skip ID3v2 tags at the start of a file; return the offset after */
+    uint64_t
+    skip_id3v2(TagLib::File *fh, uint64_t length)
+    {
+        uint64_t pos = 0;
+        while (pos + 10 <= length) {
+            const TagLib::ByteVector h = read_at(fh, pos, 10);
+            if (h.size() < 10 || !h.startsWith("ID3")) {
+                break;
+            }
+            const unsigned char *u =
+                reinterpret_cast<const unsigned char *>(h.data());
+            if ((u[6] | u[7] | u[8] | u[9]) & 0x80) {
+                break;
+            }
+            const uint64_t size = (u[6] << 21) | (u[7] << 14)
+                | (u[8] << 7) | u[9];
+            /* Flag 0x10 marks a footer, that follows the tag. */
+            pos += 10 + size + ((u[5] & 0x10) ? 10 : 0);
+        }
+        return std::min(pos, length);
+    }
+
+    /** Drop an ID3v1 tag from the end of a range */
+    uint64_t
+    strip_id3v1(TagLib::File *fh, uint64_t start, uint64_t end)
+    {
+        if (end - start >= 128 && read_at(fh, end - 128, 3) == "TAG") {
+            return end - 128;
+        }
+        return end;
+    }
+
+    /** Drop an APE tag from the end of a range */
+    uint64_t
+    strip_ape(TagLib::File *fh, uint64_t start, uint64_t end)
+    {
+        if (end - start < 32) {
+            return end;
+        }
+        const TagLib::ByteVector f = read_at(fh, end - 32, 32);
+        if (f.size() < 32 || !f.startsWith("APETAGEX")) {
+            return end;
+        }
+        /* The size covers items and footer; bit 31 flags a header, too. */
+        uint64_t size = le32(f.data() + 12);
+        if (le32(f.data() + 20) & 0x80000000UL) {
+            size += 32;
+        }
+        return size <= end - start ? end - size : end;
+    }
+
+    bool
+    hash_range(TagLib::File *fh, uint64_t start, uint64_t end,
+               Amded::Hash64 &h)
+    {
+        Amded::BlockReader r(fh, start, end);
+        return r.hash(h, end - start);
+    }
+
+    bool
+    hash_mp3(TagLib::File *fh, Amded::Hash64 &h)
+    {
+        uint64_t start, end;
+        return amded_mp3_audio_range(fh, start, end)
+            && hash_range(fh, start, end, h);
+    }
+
+    bool
+    hash_flac(TagLib::File *fh, uint64_t length, Amded::Hash64 &h)
+    {
+        uint64_t pos = skip_id3v2(fh, length);
+        if (read_at(fh, pos, 4) != "fLaC") {
+            return false;
+        }
+        pos += 4;
+        for (;;) {
+            const TagLib::ByteVector b = read_at(fh, pos, 4);
+            if (b.size() < 4) {
+                return false;
+            }
+            /* Bit 7 marks the last block, the low 24 bits are its size. */
+            pos += 4 + (be32(b.data()) & 0xffffff);
+            if (static_cast<unsigned char>(b[0]) & 0x80) {
+                break;
+            }
+        }
+        if (pos > length) {
+            return false;
+        }
+        return hash_range(fh, pos, strip_id3v1(fh, pos, length), h);
+    }
+
+    bool
+    hash_ogg(TagLib::File *fh, uint64_t length, Amded::Hash64 &h)
+    {
+        /* Number of complete packets seen, per logical stream */
+        std::map<uint64_t, unsigned long> packets;
+        Amded::BlockReader r(fh, 0, length);
+
+        while (r.need(27)) {
+            const char *p = r.data();
+            if (p[0] != 'O' || p[1] != 'g' || p[2] != 'g' || p[3] != 'S') {
+                return false;
+            }
+            const uint64_t serial = le32(p + 14);
+            const std::size_t segments = static_cast<unsigned char>(p[26]);
+            if (!r.need(27 + segments)) {
+                return false;
+            }
+            const std::string lacing(r.data() + 27, segments);
+            r.skip(27 + segments);
+
+            unsigned long &packet = packets[serial];
+            for (auto c : lacing) {
+                const std::size_t len = static_cast<unsigned char>(c);
+                if (packet == 1) {
+                    r.skip(len);
+                } else if (!r.hash(h, len)) {
+                    return false;
+                }
+                /* Segments shorter than 255 bytes end a packet. */
+                if (len < 255) {
+                    ++packet;
+                }
+            }
+        }
+        return !packets.empty();
+    }
+
+    bool
+    hash_mp4(TagLib::File *fh, uint64_t length, Amded::Hash64 &h)
+    {
+        uint64_t pos = 0;
+        bool found = false;
+
+        while (pos + 8 <= length) {
+            const TagLib::ByteVector a = read_at(fh, pos, 16);
+            if (a.size() < 8) {
+                return false;
+            }
+            uint64_t size = be32(a.data());
+            uint64_t header = 8;
+            if (size == 1) {
+                if (a.size() < 16) {
+                    return false;
+                }
+                size = be32(a.data() + 8) << 32 | be32(a.data() + 12);
+                header = 16;
+            } else if (size == 0) {
+                /* The last atom may extend to the end of the file. */
+                size = length - pos;
+            }
+            if (size < header || size > length - pos) {
+                return false;
+            }
+            if (a.mid(4, 4) == "mdat") {
+                if (!hash_range(fh, pos + header, pos + size, h)) {
+                    return false;
+                }
+                found = true;
+            }
+            pos += size;
+        }
+        return found;
+    }
+
+}
+
+/**
+ * Find the part of an mp3 file, that is not taken by tags
+ *
+ * @param   fh      the file
+ * @param   start   where to store the offset of the first byte of audio
+ * @param   end     where to store the offset after the last one
+ *
+ * @return true if the range was found; false if the file's length is
+ *         unknown.
+ */
+bool
+amded_mp3_audio_range(TagLib::File *fh, uint64_t &start, uint64_t &end)
+{
+    const TagLib::offset_t length = fh->length();
+    if (length < 0) {
+        return false;
+    }
+    start = skip_id3v2(fh, length);
+    end = strip_id3v1(fh, start, length);
+    end = strip_ape(fh, start, end);
+    return true;
+}
+
+/**
+ * Compute the hash of a file's audio payload
+ *
+ * @param   file    the file; it needs to be opened with TagLib
+ * @param   rv      where to store the hash, as 16 hex digits
+ *
+ * @return true if the hash was computed; false if the file's structure
+ *         could not be made sense of, or it could not be read.
+ */
+bool
+amded_payload_hash(const struct amded_file &file, std::string &rv)
+{
+    TagLib::File *fh = file.fh;
+    if (fh == nullptr) {
+        return false;
+    }
+    const TagLib::offset_t length = fh->length();
+    if (length < 0) {
+        return false;
+    }
+
+    Amded::Hash64 h;
+    bool ok;
+    switch (file.type.get_id()) {
+    case FILE_T_MP3:
+        ok = hash_mp3(fh, h);
+        break;
+    case FILE_T_FLAC:
+        ok = hash_flac(fh, length, h);
+        break;
+    case FILE_T_OGG_VORBIS:
+    case FILE_T_OPUS:
+        ok = hash_ogg(fh, length, h);
+        break;
+    case FILE_T_M4A:
+        ok = hash_mp4(fh, length, h);
+        break;
+    default:
+        ok = false;
+        break;
+    }
+    if (ok) {
+        rv = amded_hash_hex(h.digest());
+    }
+    return ok;
+}
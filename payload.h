@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file payload.h
+ * @brief API for hashing the audio payload of files
+ */
+
+#ifndef INC_PAYLOAD_H
+#define INC_PAYLOAD_H
+
+#include <cstdint>
+#include <string>
+
+#include <tfile.h>
+
+#include "amded.h"
+
+bool amded_mp3_audio_range(TagLib::File *, uint64_t&, uint64_t&);
+bool amded_payload_hash(const struct amded_file&, std::string&);
+
+#endif /* INC_PAYLOAD_H */
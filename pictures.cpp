@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file pictures.cpp
+ * @brief Extracting embedded pictures to a picture store
+ *
+ * With ‘picture-store=<dir>’, listings write every picture embedded in a
+ * file to ‘<dir>/<hash>.<ext>’, where ‘<hash>’ is the XXH64 digest of the
+ * picture's data (see hash.cpp) and ‘<ext>’ is derived from its MIME type.
+ * Album art, that is shared by all tracks of an album, is therefore stored
+ * once. Pictures are taken from the tags TagLib read anyway, so this does
+ * not take another pass over the file.
+ *
+ * Blobs are written to a temporary file in the store, that is renamed to
+ * its final name when complete. Concurrent runs (or threads, see ‘-P’)
+ * storing the same picture therefore never leave a partial file behind.
+ */
+
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <attachedpictureframe.h>
+#include <flacfile.h>
+#include <flacpicture.h>
+#include <id3v2tag.h>
+#include <mp4coverart.h>
+#include <mp4file.h>
+#include <mpegfile.h>
+#include <opusfile.h>
+#include <vorbisfile.h>
+#include <xiphcomment.h>
+
+#include "amded.h"
+#include "hash.h"
+#include "pictures.h"
+#include "setup.h"
+#include "value.h"
+
+namespace {
+
+    struct picture {
+        /** TagLib shares the data of copied vectors, so this is no copy */
+        TagLib::ByteVector data;
+        std::string mime;
+    };
+
+    /** Names of blobs known to be in the store already */
+    std::mutex known_mutex;
+    std::unordered_set<std::string> known;
+
+    /** Tells apart temporary files of the threads of a process */
+    std::atomic<unsigned long> tmp_counter { 0 };
+
+    void
+    add_xiph_pictures(TagLib::Ogg::XiphComment *comment,
+                      std::vector<picture> &rv)
+    {
+        if (comment == nullptr) {
+            return;
+        }
+        for (auto *p : comment->pictureList()) {
+            rv.push_back({ p->data(), p->mimeType().to8Bit(true) });
+        }
+    }
+
+    std::string
+    cover_art_mime(TagLib::MP4::CoverArt::Format format)
+    {
+        switch (format) {
+        case TagLib::MP4::CoverArt::JPEG:
+            return "image/jpeg";
+        case TagLib::MP4::CoverArt::PNG:
+            return "image/png";
+        case TagLib::MP4::CoverArt::BMP:
+            return "image/bmp";
+        case TagLib::MP4::CoverArt::GIF:
+            return "image/gif";
+        default:
+            return "";
+        }
+    }
+
+    /**
+     * Collect the pictures embedded in a file
+     *
+     * These are ID3v2 APIC frames, FLAC PICTURE blocks, Xiph comment
+     * METADATA_BLOCK_PICTURE fields and MP4 covr items.
+     */
+    std::vector<picture>
+    collect_pictures(const struct amded_file &file)
+    {
+        std::vector<picture> rv;
+        TagLib::MPEG::File *mp3fh;
+        TagLib::FLAC::File *flacfh;
+        TagLib::MP4::Tag *mp4tag;
+
+        switch (file.type.get_id()) {
+        case FILE_T_MP3:
+            mp3fh = reinterpret_cast<TagLib::MPEG::File *>(file.fh);
+            if (!mp3fh->hasID3v2Tag()) {
+                break;
+            }
+            for (auto *frame : mp3fh->ID3v2Tag()->frameList("APIC")) {
+                auto *apic =
+                    dynamic_cast<TagLib::ID3v2::AttachedPictureFrame *>(frame);
+                if (apic != nullptr) {
+                    rv.push_back({ apic->picture(),
+                                   apic->mimeType().to8Bit(true) });
+                }
+            }
+            break;
+        case FILE_T_FLAC:
+            flacfh = reinterpret_cast<TagLib::FLAC::File *>(file.fh);
+            for (auto *p : flacfh->pictureList()) {
+                rv.push_back({ p->data(), p->mimeType().to8Bit(true) });
+            }
+            if (flacfh->hasXiphComment()) {
+                add_xiph_pictures(flacfh->xiphComment(), rv);
+            }
+            break;
+        case FILE_T_OGG_VORBIS:
+            add_xiph_pictures(
+                reinterpret_cast<TagLib::Ogg::Vorbis::File *>(file.fh)->tag(),
+                rv);
+            break;
+        case FILE_T_OPUS:
+            add_xiph_pictures(
+                reinterpret_cast<TagLib::Ogg::Opus::File *>(file.fh)->tag(),
+                rv);
+            break;
+        case FILE_T_M4A:
+            mp4tag = reinterpret_cast<TagLib::MP4::File *>(file.fh)->tag();
+            if (mp4tag == nullptr || !mp4tag->contains("covr")) {
+                break;
+            }
+            for (auto &art : mp4tag->item("covr").toCoverArtList()) {
+                rv.push_back({ art.data(), cover_art_mime(art.format()) });
+            }
+            break;
+        default:
+            break;
+        }
+        return rv;
+    }
+
+    /** Map a picture's MIME type to the extension of its blob */
+    std::string
+    extension(const std::string &mime)
+    {
+        std::string m;
+        for (auto c : mime) {
+            m += std::tolower(static_cast<unsigned char>(c));
+        }
+        /* "image/jpg" and a bare "jpeg" are common in ID3v2 tags. */
+        if (m.find("jpeg") != std::string::npos
+            || m.find("jpg") != std::string::npos)
+        {
+            return "jpg";
+        }
+        for (auto ext : { "png", "gif", "bmp", "webp", "tiff" }) {
+            if (m.find(ext) != std::string::npos) {
+                return ext;
+            }
+        }
+        return "bin";
+    }
+
+    bool
+    write_full(int fd, const char *data, std::size_t size)
+    {
+        while (size > 0) {
+            ssize_t rc = write(fd, data, size);
+            if (rc < 0 && errno == EINTR) {
+                continue;
+            }
+            if (rc < 0) {
+                return false;
+            }
+            data += rc;
+            size -= rc;
+        }
+        return true;
+    }
+
+    /**
+     * Put a blob into the store, unless it is there already
+     *
+     * @sideeffects Prints a diagnostic to stderr on failure.
+     */
+    void
+    store_blob(const std::string &dir, const std::string &name,
+               const TagLib::ByteVector &data)
+    {
+        {
+            std::lock_guard<std::mutex> lock(known_mutex);
+            if (known.count(name) > 0) {
+                return;
+            }
+        }
+
+        const std::string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0) {
+            std::lock_guard<std::mutex> lock(known_mutex);
+            known.insert(name);
+            return;
+        }
+
+        const std::string tmp = dir + "/." + name + "."
+            + std::to_string(getpid()) + "."
+            + std::to_string(tmp_counter++) + ".tmp";
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                      0644);
+        if (fd < 0) {
+            std::cerr << PROJECT ": `" << tmp << "': "
+                      << strerror(errno) << std::endl;
+            return;
+        }
+        bool ok = write_full(fd, data.data(), data.size());
+        int err = errno;
+        if (close(fd) != 0 && ok) {
+            ok = false;
+            err = errno;
+        }
+        if (ok && rename(tmp.c_str(), path.c_str()) != 0) {
+            ok = false;
+            err = errno;
+        }
+        if (!ok) {
+            std::cerr << PROJECT ": `" << path << "': "
+                      << strerror(err) << std::endl;
+            unlink(tmp.c_str());
+            return;
+        }
+        std::lock_guard<std::mutex> lock(known_mutex);
+        known.insert(name);
+    }
+
+}
+
+/**
+ * Check, that a picture store can be used
+ *
+ * @param   dir     the store's directory
+ *
+ * @return true if ‘dir’ is a writable directory; false otherwise.
+ */
+bool
+amded_picture_store_ok(const std::string &dir)
+{
+    struct stat st;
+    return stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode)
+        && access(dir.c_str(), W_OK | X_OK) == 0;
+}
+
+/**
+ * Store a file's pictures and list them
+ *
+ * This adds "picture-count" and, for the n-th picture (counting from one),
+ * "picture-<n>-hash", "picture-<n>-mime" and "picture-<n>-size" fields.
+ *
+ * @param   file    the file to list; it needs to be opened with TagLib
+ * @param   data    the amded-specific part of the file's listing
+ *
+ * @return void
+ */
+void
+amded_list_pictures(const struct amded_file &file,
+                    std::map< std::string, Value > &data)
+{
+    const std::string dir = get_picture_store();
+    const std::vector<picture> pictures = collect_pictures(file);
+
+    data["picture-count"] = static_cast<int>(pictures.size());
+    for (std::size_t i = 0; i < pictures.size(); ++i) {
+        const picture &p = pictures[i];
+        const std::string hash =
+            amded_hash_hex(amded_hash64(p.data.data(), p.data.size()));
+        store_blob(dir, hash + "." + extension(p.mime), p.data);
+
+        const std::string prefix = "picture-" + std::to_string(i + 1);
+        data[prefix + "-hash"] = hash;
+        data[prefix + "-mime"] = p.mime;
+        data[prefix + "-size"] = static_cast<int>(p.data.size());
+    }
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file pictures.h
+ * @brief API for extracting embedded pictures to a picture store
+ */
+
+#ifndef INC_PICTURES_H
+#define INC_PICTURES_H
+
+#include <map>
+#include <string>
+
+#include "amded.h"
+#include "value.h"
+
+bool amded_picture_store_ok(const std::string&);
+void amded_list_pictures(const struct amded_file&,
+                         std::map< std::string, Value >&);
+
+#endif /* INC_PICTURES_H */
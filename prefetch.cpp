@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file prefetch.cpp
+ * @brief Prefetching the files, that are processed next
+ *
+ * Processing files one after another leaves a single read outstanding at
+ * any time. With cold caches on spinning disks or network storage, most of
+ * the time is spent waiting for it. The prefetcher (enabled by the
+ * ‘prefetch=N’ parameter) keeps the device busy instead: While one file is
+ * processed, reading the next N files' heads and tails, where their tags
+ * live, is already under way. When amded gets to those files, their data
+ * is in the page cache.
+ *
+ * With io_uring (build with ‘WITH_LIBURING=1’), opening, sizing and reading
+ * the files is all asynchronous: For each file, an ‘openat’ and a ‘statx’
+ * request are queued. Once both are done, the reads of the head and the
+ * tail follow. Their data goes into a scratch buffer, that is never looked
+ * at; only the page cache matters. Nothing in here ever waits for a
+ * request, except when the prefetcher is torn down.
+ *
+ * Without io_uring, or if the kernel refuses to set up a ring, files are
+ * opened synchronously, and posix_fadvise(2) asks the kernel to read their
+ * heads and tails in the background.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file-source.h"
+#include "http-stream.h"
+#include "io-stream.h"
+#include "prefetch.h"
+
+namespace {
+
+    /** How much of the start of a file to prefetch */
+    const std::size_t prefetch_head = 128 * 1024;
+
+    /** How much of the end of a file to prefetch */
+    const std::size_t prefetch_tail = 8 * 1024;
+
+#ifdef AMDED_WITH_LIBURING
+    enum prefetch_op {
+        PREFETCH_OPEN,
+        PREFETCH_STAT,
+        PREFETCH_HEAD,
+        PREFETCH_TAIL
+    };
+#endif /* AMDED_WITH_LIBURING */
+
+}
+
+namespace Amded {
+
+    /**
+     * Set up a prefetcher
+     *
+     * @param   source  where to take file names from
+     * @param   n       how many files to prefetch ahead of the current one
+     */
+    Prefetcher::Prefetcher(FileSource &source, std::size_t n)
+        : files(source), depth(n), exhausted(false)
+    {
+#ifdef AMDED_WITH_LIBURING
+        /* Each file has at most two requests in flight. */
+        ring_ok = depth > 0
+            && io_uring_queue_init(2 * depth + 2, &ring, 0) == 0;
+        if (ring_ok) {
+            scratch.resize(prefetch_head);
+        }
+#endif /* AMDED_WITH_LIBURING */
+    }
+
+    Prefetcher::~Prefetcher()
+    {
+#ifdef AMDED_WITH_LIBURING
+        if (ring_ok) {
+            for (auto &s : slots) {
+                s->retired = true;
+            }
+            reap(true);
+            io_uring_queue_exit(&ring);
+        }
+#endif /* AMDED_WITH_LIBURING */
+    }
+
+#ifdef AMDED_WITH_LIBURING
+    struct io_uring_sqe *
+    Prefetcher::get_sqe(void)
+    {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+        if (sqe == nullptr) {
+            /* The submission queue is full; hand it to the kernel. */
+            io_uring_submit(&ring);
+            sqe = io_uring_get_sqe(&ring);
+        }
+        return sqe;
+    }
+
+    /**
+     * Queue one request for a file
+     *
+     * @param   s       the file's state
+     * @param   op      the request to queue (see ‘enum prefetch_op’)
+     *
+     * @return void
+     */
+    void
+    Prefetcher::submit(slot &s, int op)
+    {
+        struct io_uring_sqe *sqe = get_sqe();
+        if (sqe == nullptr) {
+            return;
+        }
+        switch (op) {
+        case PREFETCH_OPEN:
+            /* Like amded_open_read_only(), see complete(). */
+            io_uring_prep_openat(sqe, AT_FDCWD, s.name.c_str(),
+                                 O_RDONLY | O_CLOEXEC
+                                 | (s.noatime ? O_NOATIME : 0), 0);
+            break;
+        case PREFETCH_STAT:
+            io_uring_prep_statx(sqe, AT_FDCWD, s.name.c_str(), 0,
+                                STATX_SIZE, &s.stx);
+            break;
+        case PREFETCH_HEAD:
+            io_uring_prep_read(sqe, s.fd, scratch.data(),
+                               std::min<uint64_t>(s.size, prefetch_head), 0);
+            break;
+        case PREFETCH_TAIL:
+            io_uring_prep_read(sqe, s.fd, scratch.data(), prefetch_tail,
+                               s.size - prefetch_tail);
+            break;
+        }
+        s.requests[op] = { &s, op };
+        io_uring_sqe_set_data(sqe, &s.requests[op]);
+        s.pending++;
+    }
+
+    /**
+     * Take note of a finished request, and queue what comes next
+     *
+     * @param   req     the request, that finished
+     * @param   res     its result
+     *
+     * @return void
+     */
+    void
+    Prefetcher::complete(request &req, int res)
+    {
+        slot &s = *req.owner;
+        s.pending--;
+        switch (req.op) {
+        case PREFETCH_OPEN:
+            /* O_NOATIME needs to own the file; retry without it. */
+            if (res == -EPERM && s.noatime) {
+                s.noatime = false;
+                submit(s, PREFETCH_OPEN);
+                return;
+            }
+            s.opened = true;
+            s.fd = res;
+            break;
+        case PREFETCH_STAT:
+            s.sized = res == 0;
+            s.size = s.stx.stx_size;
+            break;
+        default:
+            break;
+        }
+
+        if (s.pending > 0 || !s.opened) {
+            return;
+        }
+        if (req.op == PREFETCH_OPEN || req.op == PREFETCH_STAT) {
+            if (s.fd >= 0 && s.sized && s.size > 0) {
+                submit(s, PREFETCH_HEAD);
+                if (s.size > prefetch_head + prefetch_tail) {
+                    submit(s, PREFETCH_TAIL);
+                }
+                return;
+            }
+        }
+        if (s.fd >= 0) {
+            close(s.fd);
+            s.fd = -1;
+        }
+    }
+
+    /**
+     * Process finished requests
+     *
+     * @param   wait    if true, wait until all requests of retired files
+     *                  are done
+     *
+     * @return void
+     */
+    void
+    Prefetcher::reap(bool wait)
+    {
+        for (;;) {
+            io_uring_submit(&ring);
+
+            bool busy = false;
+            for (auto &s : slots) {
+                busy = busy || (s->retired && s->pending > 0);
+            }
+            struct io_uring_cqe *cqe;
+            int rc = wait && busy
+                ? io_uring_wait_cqe(&ring, &cqe)
+                : io_uring_peek_cqe(&ring, &cqe);
+            if (rc < 0) {
+                break;
+            }
+            auto *req = static_cast<request *>(io_uring_cqe_get_data(cqe));
+            int res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            complete(*req, res);
+        }
+
+        slots.remove_if([](const std::unique_ptr<slot> &s) {
+            return s->retired && s->pending == 0;
+        });
+    }
+#endif /* AMDED_WITH_LIBURING */
+
+    /**
+     * Initiate prefetching a file
+     *
+     * @param   name    the file to prefetch
+     *
+     * @return void
+     */
+    void
+    Prefetcher::start(const std::string &name)
+    {
+        const bool local = name != "-" && !amded_is_url(name);
+#ifdef AMDED_WITH_LIBURING
+        if (ring_ok) {
+            /* Every queued name gets a slot, so next() can retire it. */
+            slots.push_back(std::make_unique<slot>());
+            slot &s = *slots.back();
+            s.name = name;
+            s.fd = -1;
+            s.opened = s.sized = s.retired = false;
+            s.noatime = true;
+            s.size = 0;
+            s.pending = 0;
+            if (local) {
+                submit(s, PREFETCH_OPEN);
+                submit(s, PREFETCH_STAT);
+            }
+            return;
+        }
+#endif /* AMDED_WITH_LIBURING */
+        if (!local) {
+            return;
+        }
+        const int fd = amded_open_read_only(name);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            posix_fadvise(fd, 0, prefetch_head, POSIX_FADV_WILLNEED);
+            if (static_cast<uint64_t>(st.st_size) > prefetch_head) {
+                posix_fadvise(fd, st.st_size - prefetch_tail, prefetch_tail,
+                              POSIX_FADV_WILLNEED);
+            }
+        }
+        /* The kernel keeps reading after the file is closed. */
+        close(fd);
+    }
+
+    /**
+     * Take names from the source, until ‘depth’ files are ahead
+     *
+     * @return void
+     */
+    void
+    Prefetcher::fill(void)
+    {
+        std::string name;
+        while (!exhausted && queue.size() <= depth) {
+            if (!files.next(name)) {
+                exhausted = true;
+                break;
+            }
+            if (depth > 0) {
+                start(name);
+            }
+            queue.push_back(name);
+        }
+#ifdef AMDED_WITH_LIBURING
+        if (ring_ok) {
+            reap(false);
+        }
+#endif /* AMDED_WITH_LIBURING */
+    }
+
+    /**
+     * Get the next file to process
+     *
+     * @param   name    where to store the file's name
+     *
+     * @return true if there was another file; false otherwise.
+     */
+    bool
+    Prefetcher::next(std::string &name)
+    {
+        fill();
+        if (queue.empty()) {
+            return false;
+        }
+        name = queue.front();
+        queue.pop_front();
+#ifdef AMDED_WITH_LIBURING
+        /*
+         * Slots are in queue order, one per name, including names that are
+         * not prefetched; the first active one is this file's.
+         */
+        for (auto &s : slots) {
+            if (!s->retired) {
+                s->retired = true;
+                break;
+            }
+        }
+#endif /* AMDED_WITH_LIBURING */
+        return true;
+    }
+
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file prefetch.h
+ * @brief API for prefetching the files, that are processed next
+ */
+
+#ifndef INC_PREFETCH_H
+#define INC_PREFETCH_H
+
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef AMDED_WITH_LIBURING
+#include <liburing.h>
+#endif /* AMDED_WITH_LIBURING */
+
+#include "file-source.h"
+
+namespace Amded {
+
+    /**
+     * A file source, that gets the files ahead of the current one read
+     *
+     * Names are taken from a FileSource up to ‘depth’ files ahead. For each
+     * of them, reading the start and the end of the file is initiated right
+     * away, without waiting for it to finish. With a depth of zero, names
+     * are passed on as they are.
+     */
+    class Prefetcher {
+    private:
+#ifdef AMDED_WITH_LIBURING
+        struct slot;
+
+        /** An operation in flight; its address is the submission's data */
+        struct request {
+            slot *owner;
+            int op;
+        };
+
+        /** The state of prefetching one file */
+        struct slot {
+            std::string name;
+            int fd;
+            bool opened;
+            /** Open with O_NOATIME; cleared if that is not permitted */
+            bool noatime;
+            bool sized;
+            uint64_t size;
+            struct statx stx;
+            unsigned int pending;
+            bool retired;
+            request requests[4];
+        };
+
+        struct io_uring ring;
+        bool ring_ok;
+        std::list<std::unique_ptr<slot>> slots;
+        std::vector<char> scratch;
+
+        struct io_uring_sqe *get_sqe(void);
+        void submit(slot&, int);
+        void complete(request&, int);
+        void reap(bool);
+#endif /* AMDED_WITH_LIBURING */
+
+        FileSource &files;
+        std::size_t depth;
+        std::deque<std::string> queue;
+        bool exhausted;
+
+        void fill(void);
+        void start(const std::string&);
+
+    public:
+        Prefetcher(FileSource&, std::size_t);
+        ~Prefetcher();
+
+        bool next(std::string&);
+    };
+
+}
+
+#endif /* INC_PREFETCH_H */
@@ -0,0 +1,702 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file server.cpp
+ * @brief Serving listing requests on a Unix domain socket
+ *
+ * With ‘-U <socket>’, amded listens on a Unix domain socket and serves any
+ * number of clients at the same time. The main thread handles all sockets,
+ * driven by epoll(7): It accepts connections, reads requests and writes
+ * responses, without ever blocking on a single client. Requests are handed
+ * to a pool of worker threads (sized via ‘-P’), which do the actual work of
+ * listing files.
+ *
+ * Requests are framed just like in batch mode (see batch.cpp): A list of
+ * NUL terminated arguments, ended by an empty argument. Responses use the
+ * same format as in batch mode, too. A client may send more than one request
+ * without waiting for responses in between; its requests are processed one
+ * after another, and responses are sent in the order of the requests.
+ * Diagnostics, that amded prints while processing a request (like about
+ * unsupported file types or failed HTTP requests), go into the response's
+ * error block instead of the server's stderr (see ‘ErrorRouter’).
+ *
+ * Clients may pass open file descriptors along with a request (as SCM_RIGHTS
+ * ancillary data), to have files listed without the server resolving their
+ * names again. All descriptors, that were received since the previous
+ * request of a client was complete, belong to the next request that is
+ * completed. The server closes them when the request is finished.
+ *
+ * SIGINT and SIGTERM make the server finish the requests it already handed
+ * to its workers, send their responses, remove its socket and return.
+ * Further requests, that clients sent without waiting, are not started.
+ */
+
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "amded.h"
+#include "server.h"
+
+/** Maximum number of file descriptors accepted with one message */
+#define SERVER_MAX_FDS 64
+
+/** Amount of data read from a client at once */
+#define SERVER_READ_SIZE (64 * 1024)
+
+/** Clients sending larger requests than this are disconnected */
+#define SERVER_MAX_REQUEST (16 * 1024 * 1024)
+
+/** Number of events handled per epoll_wait(2) call */
+#define SERVER_MAX_EVENTS 64
+
+/** Milliseconds to wait for a client to take its responses at shutdown */
+#define SERVER_FLUSH_TIMEOUT 5000
+
+namespace {
+
+struct Client {
+    int fd;
+    /** Data received, that is not part of a dispatched request, yet */
+    std::string in;
+    /** Descriptors received for the next request */
+    std::vector<int> fds;
+    /** Responses, that still need to be sent */
+    std::string out;
+    std::size_t sent = 0;
+    /** A request of this client is being processed by a worker */
+    bool busy = false;
+    /** The client will not send any more requests */
+    bool eof = false;
+    /** Waiting for the socket to become writable */
+    bool want_out = false;
+    /** The connection was dropped */
+    bool closed = false;
+};
+
+using ClientPtr = std::shared_ptr<Client>;
+
+struct Job {
+    ClientPtr client;
+    Amded::ServerRequest request;
+};
+
+struct Done {
+    ClientPtr client;
+    std::string response;
+};
+
+/**
+ * Stream buffer for std::cerr, that routes diagnostics to the request of
+ * the current thread
+ *
+ * Workers point ‘sink’ at their request's diagnostics while processing it.
+ * Output of other threads, like the main thread's, goes to the original
+ * buffer. There is no put area, so every write ends up in here.
+ */
+class ErrorRouter : public std::streambuf {
+public:
+    explicit ErrorRouter(std::streambuf *fallback) : fallback(fallback) {};
+
+    std::streambuf *
+    original(void)
+    {
+        return fallback;
+    };
+
+    /** Where the current thread's diagnostics go; nullptr for stderr */
+    static thread_local std::string *sink;
+
+protected:
+    int_type
+    overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof())) {
+            return traits_type::not_eof(c);
+        }
+        if (sink != nullptr) {
+            *sink += traits_type::to_char_type(c);
+            return c;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        return fallback->sputc(traits_type::to_char_type(c));
+    };
+
+    std::streamsize
+    xsputn(const char *s, std::streamsize n) override
+    {
+        if (sink != nullptr) {
+            sink->append(s, n);
+            return n;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        return fallback->sputn(s, n);
+    };
+
+    int
+    sync(void) override
+    {
+        if (sink != nullptr) {
+            return 0;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        return fallback->pubsync();
+    };
+
+private:
+    std::streambuf *fallback;
+    std::mutex lock;
+};
+
+thread_local std::string *ErrorRouter::sink = nullptr;
+
+static void
+close_fds(std::vector<int> &fds)
+{
+    for (auto fd : fds) {
+        close(fd);
+    }
+    fds.clear();
+}
+
+/**
+ * Split the first complete request off the front of ‘in’
+ *
+ * @return true if a request was stored in ‘args’; false if ‘in’ does not
+ *         hold a complete request, yet.
+ */
+static bool
+take_request(std::string &in, std::vector<std::string> &args)
+{
+    std::size_t pos = 0;
+
+    args.clear();
+    for (;;) {
+        std::size_t end = in.find('\0', pos);
+        if (end == std::string::npos) {
+            return false;
+        }
+        if (end == pos) {
+            in.erase(0, end + 1);
+            return true;
+        }
+        args.emplace_back(in, pos, end - pos);
+        pos = end + 1;
+    }
+}
+
+class Server {
+public:
+    Server(const Amded::ServerHandler &handler) : handler(handler) {};
+    ~Server();
+    int run(const std::string &, unsigned int);
+
+private:
+    const Amded::ServerHandler &handler;
+    int epfd = -1;
+    int lfd = -1;
+    int efd = -1;
+    int sfd = -1;
+    std::map<int, ClientPtr> clients;
+
+    std::mutex lock;
+    std::condition_variable have_jobs;
+    std::deque<Job> jobs;
+    std::deque<Done> done;
+    bool stop = false;
+    /** Shutting down: No more requests are handed to the workers */
+    bool draining = false;
+
+    void work(void);
+    void watch(const ClientPtr &);
+    void accept_clients(void);
+    void read_client(const ClientPtr &);
+    void dispatch(const ClientPtr &);
+    void write_client(const ClientPtr &);
+    void finish_jobs(void);
+    void flush_client(const ClientPtr &);
+    void drop(const ClientPtr &);
+};
+
+/** Close the descriptors, that ‘run()’ did not get to close */
+Server::~Server()
+{
+    for (int *fd : { &lfd, &sfd, &efd, &epfd }) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void
+Server::work(void)
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    for (;;) {
+        have_jobs.wait(guard, [this] { return stop || !jobs.empty(); });
+        if (jobs.empty()) {
+            return;
+        }
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        guard.unlock();
+
+        std::string out, err;
+        ErrorRouter::sink = &err;
+        int status = handler(job.request, out, err);
+        ErrorRouter::sink = nullptr;
+        close_fds(job.request.fds);
+
+        std::string response = std::to_string(status) + ' '
+            + std::to_string(out.size()) + ' '
+            + std::to_string(err.size()) + '\n';
+        response += out;
+        response += err;
+
+        guard.lock();
+        done.push_back({ std::move(job.client), std::move(response) });
+        uint64_t one = 1;
+        if (write(efd, &one, sizeof(one)) < 0) {
+            /* The counter is non-zero already; that's all we need. */
+        }
+    }
+}
+
+/** Update the events, that are watched on a client's socket */
+void
+Server::watch(const ClientPtr &c)
+{
+    struct epoll_event ev;
+
+    ev.events = 0;
+    if (!c->eof) {
+        ev.events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (c->want_out) {
+        ev.events |= EPOLLOUT;
+    }
+    ev.data.fd = c->fd;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+void
+Server::accept_clients(void)
+{
+    for (;;) {
+        int fd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            continue;
+        }
+        auto c = std::make_shared<Client>();
+        c->fd = fd;
+        clients[fd] = c;
+    }
+}
+
+void
+Server::read_client(const ClientPtr &c)
+{
+    char buf[SERVER_READ_SIZE];
+    union {
+        char buf[CMSG_SPACE(SERVER_MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    for (;;) {
+        struct iovec iov = { buf, sizeof(buf) };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        ssize_t n = recvmsg(c->fd, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            drop(c);
+            return;
+        }
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr;
+             cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            std::size_t count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (std::size_t i = 0; i < count; ++i) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(fd));
+                c->fds.push_back(fd);
+            }
+        }
+        if (msg.msg_flags & MSG_CTRUNC) {
+            std::cerr << PROJECT ": Client passed too many descriptors;"
+                      << " dropping it." << std::endl;
+            drop(c);
+            return;
+        }
+
+        if (n == 0) {
+            c->eof = true;
+            watch(c);
+            break;
+        }
+        c->in.append(buf, n);
+        if (c->in.size() > SERVER_MAX_REQUEST) {
+            std::cerr << PROJECT ": Request too large; dropping client."
+                      << std::endl;
+            drop(c);
+            return;
+        }
+    }
+
+    dispatch(c);
+    if (c->eof && !c->busy && c->out.empty()) {
+        drop(c);
+    }
+}
+
+/** Hand the client's next request to the workers, if it is complete */
+void
+Server::dispatch(const ClientPtr &c)
+{
+    if (c->closed || c->busy || draining) {
+        return;
+    }
+
+    Job job;
+    if (!take_request(c->in, job.request.args)) {
+        return;
+    }
+    job.request.fds = std::move(c->fds);
+    c->fds.clear();
+    job.client = c;
+    c->busy = true;
+
+    std::lock_guard<std::mutex> guard(lock);
+    jobs.push_back(std::move(job));
+    have_jobs.notify_one();
+}
+
+void
+Server::write_client(const ClientPtr &c)
+{
+    while (c->sent < c->out.size()) {
+        ssize_t n = send(c->fd, c->out.data() + c->sent,
+                         c->out.size() - c->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (!c->want_out) {
+                    c->want_out = true;
+                    watch(c);
+                }
+                return;
+            }
+            drop(c);
+            return;
+        }
+        c->sent += n;
+    }
+
+    c->out.clear();
+    c->sent = 0;
+    if (c->want_out) {
+        c->want_out = false;
+        watch(c);
+    }
+    if (c->eof && !c->busy) {
+        drop(c);
+    }
+}
+
+/** Queue up the responses, that workers finished */
+void
+Server::finish_jobs(void)
+{
+    uint64_t count;
+    std::deque<Done> finished;
+
+    if (read(efd, &count, sizeof(count)) < 0) {
+        /* Nothing to do, but checking anyway does not hurt. */
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        finished.swap(done);
+    }
+
+    for (auto &iter : finished) {
+        ClientPtr &c = iter.client;
+        if (c->closed) {
+            continue;
+        }
+        c->out += iter.response;
+        c->busy = false;
+        dispatch(c);
+        write_client(c);
+    }
+}
+
+/** Send a client's pending responses, waiting a bounded time for it */
+void
+Server::flush_client(const ClientPtr &c)
+{
+    write_client(c);
+    while (!c->closed && c->sent < c->out.size()) {
+        struct pollfd pfd;
+        pfd.fd = c->fd;
+        pfd.events = POLLOUT;
+        if (poll(&pfd, 1, SERVER_FLUSH_TIMEOUT) <= 0) {
+            return;
+        }
+        write_client(c);
+    }
+}
+
+void
+Server::drop(const ClientPtr &c)
+{
+    if (c->closed) {
+        return;
+    }
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, nullptr);
+    close(c->fd);
+    close_fds(c->fds);
+    c->closed = true;
+    clients.erase(c->fd);
+}
+
+/**
+ * Create the listening socket at ‘path’
+ *
+ * A socket, that is left over from a server, that is not running anymore,
+ * is replaced. A socket of a running server is not.
+ */
+static int
+open_socket(const std::string &path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << PROJECT ": Socket name too long: `" << path << "'"
+                  << std::endl;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool running = probe >= 0 && connect(probe, (struct sockaddr *)&addr,
+                                             sizeof(addr)) == 0;
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (running) {
+            std::cerr << PROJECT ": Socket `" << path
+                      << "' is in use by another server." << std::endl;
+            close(fd);
+            return -1;
+        }
+        unlink(path.c_str());
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || listen(fd, SOMAXCONN) < 0)
+    {
+        std::cerr << PROJECT ": Could not listen on `" << path << "': "
+                  << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int
+Server::run(const std::string &path, unsigned int nworkers)
+{
+    sigset_t sigs, oldsigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    /* Block these before starting threads, so that all of them inherit it. */
+    pthread_sigmask(SIG_BLOCK, &sigs, &oldsigs);
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    sfd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (epfd < 0 || efd < 0 || sfd < 0) {
+        std::cerr << PROJECT ": Could not set up server: "
+                  << strerror(errno) << std::endl;
+        pthread_sigmask(SIG_SETMASK, &oldsigs, nullptr);
+        return EXIT_FAILURE;
+    }
+    lfd = open_socket(path);
+    if (lfd < 0) {
+        pthread_sigmask(SIG_SETMASK, &oldsigs, nullptr);
+        return EXIT_FAILURE;
+    }
+    for (int fd : { lfd, efd, sfd }) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    ErrorRouter router(std::cerr.rdbuf());
+    std::cerr.rdbuf(&router);
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < nworkers; ++i) {
+        workers.emplace_back([this] { work(); });
+    }
+
+    bool running = true;
+    while (running) {
+        struct epoll_event events[SERVER_MAX_EVENTS];
+        int n = epoll_wait(epfd, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            const int fd = events[i].data.fd;
+            const uint32_t what = events[i].events;
+
+            if (fd == lfd) {
+                accept_clients();
+                continue;
+            }
+            if (fd == efd) {
+                finish_jobs();
+                continue;
+            }
+            if (fd == sfd) {
+                /* Consume the signal, so that it is not delivered when
+                 * the signal mask is restored. */
+                struct signalfd_siginfo info;
+                if (read(sfd, &info, sizeof(info)) < 0) {
+                    /* It was there, or we would not be here. */
+                }
+                running = false;
+                continue;
+            }
+
+            auto iter = clients.find(fd);
+            if (iter == clients.end()) {
+                continue;
+            }
+            ClientPtr c = iter->second;
+            if (what & (EPOLLERR | EPOLLHUP)) {
+                drop(c);
+                continue;
+            }
+            if (what & EPOLLOUT) {
+                write_client(c);
+            }
+            if (!c->closed && (what & (EPOLLIN | EPOLLRDHUP))) {
+                read_client(c);
+            }
+        }
+    }
+
+    close(lfd);
+    lfd = -1;
+    unlink(path.c_str());
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    have_jobs.notify_all();
+    for (auto &iter : workers) {
+        iter.join();
+    }
+    std::cerr.rdbuf(router.original());
+    /* Workers ran all queued jobs before returning; send their responses.
+     * Requests, that were not handed to a worker, are not started now. */
+    draining = true;
+    finish_jobs();
+    std::vector<ClientPtr> pending;
+    for (auto &iter : clients) {
+        pending.push_back(iter.second);
+    }
+    for (auto &c : pending) {
+        flush_client(c);
+    }
+    while (!clients.empty()) {
+        drop(clients.begin()->second);
+    }
+    pthread_sigmask(SIG_SETMASK, &oldsigs, nullptr);
+    return EXIT_SUCCESS;
+}
+
+} /* anonymous namespace */
+
+/**
+ * Serve requests on a Unix domain socket until SIGINT or SIGTERM
+ *
+ * @param  path      name of the socket to create
+ * @param  jobs      number of worker threads to process requests with
+ * @param  handler   callback that processes a request
+ *
+ * @return EXIT_SUCCESS after a regular shutdown; EXIT_FAILURE if the server
+ *         could not be set up.
+ */
+int
+amded_serve(const std::string &path, unsigned int jobs,
+            const Amded::ServerHandler &handler)
+{
+    Server server(handler);
+    return server.run(path, jobs > 0 ? jobs : 1);
+}
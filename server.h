@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file server.h
+ * @brief API for amded's socket server mode
+ */
+
+#ifndef INC_SERVER_H
+#define INC_SERVER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Amded {
+
+    /** A request, as read from a client */
+    struct ServerRequest {
+        /** The request's arguments */
+        std::vector<std::string> args;
+        /** File descriptors, that were passed along with the request */
+        std::vector<int> fds;
+    };
+
+    /**
+     * Process one request. Called from worker threads. Returns the request's
+     * status, and fills in what goes into the response's data blocks.
+     */
+    using ServerHandler = std::function<int(const ServerRequest &,
+                                            std::string &, std::string &)>;
+
+}
+
+int amded_serve(const std::string &, unsigned int,
+                const Amded::ServerHandler &);
+
+#endif /* INC_SERVER_H */
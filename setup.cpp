@@ -82,12 +82,56 @@
  *     Amded's behaviour can also be altered by a set of boolean flags (such
  *     as ‘-E’). The implementation works by setting and reading bits in a
  *     large integer word.
+ *
+ *   Worker threads:
+ *
+ *     The ‘-P’ option sets the number of threads that list files
+ *     concurrently. One (the default) means that files are processed
+ *     strictly one after another in the main thread.
+ *
+ *   File list:
+ *
+ *     The ‘-f’ option names a file (or "-" for stdin), that file names to
+ *     process are read from, in addition to the ones on the command line.
+ *
+ *   Numeric parameters:
+ *
+ *     Some of the parameters passed in via ‘-o’ carry a value, like
+ *     "walk-threads=4". Each of those is stored in a variable of its own.
+ *
+ *   Cache file:
+ *
+ *     The ‘cache=FILE’ parameter names the file, that listing data is cached
+ *     in (see cache.cpp). Without it, no cache is used.
+ *
+ *   Server socket:
+ *
+ *     The ‘-U’ option names a Unix domain socket, that amded serves listing
+ *     requests on (see server.cpp), instead of processing files itself.
+ *
+ *   Audio properties:
+ *
+ *     The ‘properties=STYLE’ parameter selects TagLib's read style for audio
+ *     properties: "fast", "average" (the default) or "accurate". Those
+ *     trade the precision of values like the length of a file against the
+ *     amount of the file that needs to be read. With ‘no-properties’, they
+ *     are not read at all.
+ *
+ *   Field projection:
+ *
+ *     The ‘-F’ option restricts listings to a set of fields. The set is
+ *     stored as is; an empty set means all fields are listed.
  */
 
+#include <cstddef>
 #include <cstdint>
 #include <map>
+#include <set>
+#include <string>
 #include <vector>
 
+#include <audioproperties.h>
+
 #include "amded.h"
 #include "setup.h"
 #include "value.h"
@@ -202,3 +246,283 @@ unset_only_tag_delete(void)
 {
     otd = false;
 }
+
+/*
+ * Number of listing workers (see ‘-P’).
+ */
+
+static unsigned int jobs = 1;
+
+void
+set_jobs(unsigned int n)
+{
+    jobs = n;
+}
+
+unsigned int
+get_jobs(void)
+{
+    return jobs;
+}
+
+/*
+ * File list (see ‘-f’).
+ */
+
+static std::string file_list;
+
+void
+set_file_list(const std::string &name)
+{
+    file_list = name;
+}
+
+std::string
+get_file_list(void)
+{
+    return file_list;
+}
+
+/*
+ * Tar archive to list the members of (see ‘-a’).
+ */
+
+static std::string archive;
+
+void
+set_archive(const std::string &name)
+{
+    archive = name;
+}
+
+std::string
+get_archive(void)
+{
+    return archive;
+}
+
+/*
+ * Number of threads to walk directory trees with (see ‘-r’).
+ */
+
+static unsigned int walk_threads = 0;
+
+void
+set_walk_threads(unsigned int n)
+{
+    walk_threads = n;
+}
+
+unsigned int
+get_walk_threads(void)
+{
+    return walk_threads;
+}
+
+/*
+ * Listing cache (see ‘cache=FILE’).
+ */
+
+static std::string cache_file;
+
+void
+set_cache_file(const std::string &name)
+{
+    cache_file = name;
+}
+
+std::string
+get_cache_file(void)
+{
+    return cache_file;
+}
+
+/*
+ * Directory to store embedded pictures in (see ‘picture-store=<dir>’).
+ */
+
+static std::string picture_store;
+
+void
+set_picture_store(const std::string &dir)
+{
+    picture_store = dir;
+}
+
+std::string
+get_picture_store(void)
+{
+    return picture_store;
+}
+
+/*
+ * Socket to serve requests on (see ‘-U’).
+ */
+
+static std::string server_socket;
+
+void
+set_server_socket(const std::string &name)
+{
+    server_socket = name;
+}
+
+std::string
+get_server_socket(void)
+{
+    return server_socket;
+}
+
+/*
+ * How thoroughly audio properties are read (see ‘properties=STYLE’).
+ */
+
+static TagLib::AudioProperties::ReadStyle properties_style =
+    TagLib::AudioProperties::Average;
+
+void
+set_properties_style(TagLib::AudioProperties::ReadStyle style)
+{
+    properties_style = style;
+}
+
+TagLib::AudioProperties::ReadStyle
+get_properties_style(void)
+{
+    return properties_style;
+}
+
+/*
+ * Type of the audio data read from stdin (see ‘-T’).
+ */
+
+static enum file_type stdin_type = FILE_T_INVALID;
+
+void
+set_stdin_type(enum file_type type)
+{
+    stdin_type = type;
+}
+
+enum file_type
+get_stdin_type(void)
+{
+    return stdin_type;
+}
+
+/*
+ * Number of files to prefetch ahead of the current one (see ‘prefetch=N’).
+ */
+
+static unsigned int prefetch = 0;
+
+void
+set_prefetch(unsigned int n)
+{
+    prefetch = n;
+}
+
+unsigned int
+get_prefetch(void)
+{
+    return prefetch;
+}
+
+/*
+ * How listing modes read files (see ‘io=BACKEND’ and ‘io-block-size=N’).
+ */
+
+static enum io_backend io_backend = IO_BACKEND_TAGLIB;
+static std::size_t io_block_size = 64 * 1024;
+
+void
+set_io_backend(enum io_backend backend)
+{
+    io_backend = backend;
+}
+
+enum io_backend
+get_io_backend(void)
+{
+    return io_backend;
+}
+
+void
+set_io_block_size(std::size_t size)
+{
+    io_block_size = size;
+}
+
+std::size_t
+get_io_block_size(void)
+{
+    return io_block_size;
+}
+
+/*
+ * Largest tag frame or block, that native readers read (see
+ * ‘max-frame-bytes=N’); zero for no limit.
+ */
+
+static uint64_t max_frame_bytes = 0;
+
+void
+set_max_frame_bytes(uint64_t size)
+{
+    max_frame_bytes = size;
+}
+
+uint64_t
+get_max_frame_bytes(void)
+{
+    return max_frame_bytes;
+}
+
+/*
+ * Fields to restrict listings to (see ‘-F’).
+ */
+
+static amded_fields fields;
+
+void
+add_field(const std::string &name)
+{
+    fields.insert(name);
+}
+
+const amded_fields &
+get_fields(void)
+{
+    return fields;
+}
+
+/**
+ * Return all of the setup to its defaults
+ *
+ * In batch mode (see batch.cpp), every request starts out with this.
+ *
+ * @return void
+ */
+void
+reset_setup(void)
+{
+    newtags.clear();
+    read_map.clear();
+    write_map.clear();
+    amded_options = 0;
+    otd = true;
+    jobs = 1;
+    file_list.clear();
+    archive.clear();
+    walk_threads = 0;
+    cache_file.clear();
+    picture_store.clear();
+    server_socket.clear();
+    properties_style = TagLib::AudioProperties::Average;
+    stdin_type = FILE_T_INVALID;
+    prefetch = 0;
+    io_backend = IO_BACKEND_TAGLIB;
+    io_block_size = 64 * 1024;
+    max_frame_bytes = 0;
+    fields.clear();
+}
@@ -11,17 +11,55 @@
 #ifndef INC_SETUP_H
 #define INC_SETUP_H
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <map>
+#include <set>
+#include <string>
 #include <vector>
 
+#include <audioproperties.h>
+
 #include "value.h"
 
+/** A set of listing field names, that can be searched by C strings, too */
+using amded_fields = std::set< std::string, std::less<> >;
+
 void add_tag(enum tag_id, const Value&);
 void set_opt(uint32_t);
 bool get_opt(uint32_t);
 void unset_only_tag_delete(void);
 bool only_tag_delete(void);
+void set_jobs(unsigned int);
+unsigned int get_jobs(void);
+void set_file_list(const std::string&);
+std::string get_file_list(void);
+void set_archive(const std::string&);
+std::string get_archive(void);
+void set_walk_threads(unsigned int);
+unsigned int get_walk_threads(void);
+void set_cache_file(const std::string&);
+std::string get_cache_file(void);
+void set_picture_store(const std::string&);
+std::string get_picture_store(void);
+void set_server_socket(const std::string&);
+std::string get_server_socket(void);
+void set_properties_style(TagLib::AudioProperties::ReadStyle);
+TagLib::AudioProperties::ReadStyle get_properties_style(void);
+void set_stdin_type(enum file_type);
+enum file_type get_stdin_type(void);
+void set_prefetch(unsigned int);
+unsigned int get_prefetch(void);
+void set_io_backend(enum io_backend);
+enum io_backend get_io_backend(void);
+void set_io_block_size(std::size_t);
+std::size_t get_io_block_size(void);
+void set_max_frame_bytes(uint64_t);
+uint64_t get_max_frame_bytes(void);
+void add_field(const std::string&);
+const amded_fields &get_fields(void);
+void reset_setup(void);
 
 extern std::map< enum file_type, std::vector< enum tag_impl > > read_map;
 extern std::map< enum file_type, std::vector< enum tag_impl > > write_map;
@@ -48,7 +48,7 @@ namespace Amded {
 
     TagImplementation::TagImplementation(enum tag_impl t)
     {
-        label = tagimpl_map[t];
+        label = tagimpl_map.at(t);
         id = t;
     }
 
@@ -70,7 +70,7 @@ namespace Amded {
     TagImplementation&
     TagImplementation::operator=(enum tag_impl t)
     {
-        label = tagimpl_map[t];
+        label = tagimpl_map.at(t);
         id = t;
         return *this;
     }
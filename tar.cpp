@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file tar.cpp
+ * @brief Reading tar archives sequentially
+ *
+ * A tar archive is a sequence of 512 byte blocks: Each member starts with a
+ * header block, followed by its data, padded to a multiple of the block
+ * size. Two blocks of zeroes end the archive.
+ *
+ * This understands POSIX ustar headers (including the name prefix field),
+ * GNU long names (‘L’ members) and the ‘path’ and ‘size’ records of pax
+ * extended headers (‘x’ members), which covers archives written by GNU tar,
+ * bsdtar and most libraries. Sizes may be octal or GNU's base-256 encoding.
+ *
+ * Archives are read front to back in a single pass, so they may come from a
+ * pipe. Data of members, that are not of interest, is skipped: By seeking,
+ * if the archive is a file, and by reading it otherwise.
+ *
+ * Sizes in headers are not trusted: Long names and pax headers are limited
+ * to ‘tar_max_header_data’ bytes, and members of archive files may not
+ * extend past the end of the file. Broken sizes and records make the
+ * archive broken (see ‘is_broken()’), instead of ending the run.
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <map>
+#include <new>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <tbytevector.h>
+
+#include "io-stream.h"
+#include "tar.h"
+
+namespace {
+
+    const std::size_t tar_block_size = 512;
+
+    /** Offsets and sizes of the header fields, that are looked at */
+    const std::size_t tar_name = 0;
+    const std::size_t tar_name_size = 100;
+    const std::size_t tar_size = 124;
+    const std::size_t tar_size_size = 12;
+    const std::size_t tar_chksum = 148;
+    const std::size_t tar_chksum_size = 8;
+    const std::size_t tar_typeflag = 156;
+    const std::size_t tar_magic = 257;
+    const std::size_t tar_prefix = 345;
+    const std::size_t tar_prefix_size = 155;
+
+    /** Largest long name or pax header, that is read */
+    const uint64_t tar_max_header_data = 1024 * 1024;
+
+    /** Pad a member's size to whole blocks */
+    uint64_t
+    padded(uint64_t size)
+    {
+        return (size + tar_block_size - 1) / tar_block_size * tar_block_size;
+    }
+
+    /** Read a NUL terminated (or field filling) string from a header */
+    std::string
+    field_string(const char *header, std::size_t offset, std::size_t size)
+    {
+        const char *p = header + offset;
+        return std::string(p, strnlen(p, size));
+    }
+
+    /**
+     * Read a numeric header field
+     *
+     * Fields are octal numbers, terminated by a space or NUL. GNU tar stores
+     * larger numbers in base 256, marked by the first byte's top bit.
+     */
+    bool
+    field_number(const char *header, std::size_t offset, std::size_t size,
+                 uint64_t &rv)
+    {
+        const unsigned char *p =
+            reinterpret_cast<const unsigned char *>(header + offset);
+        rv = 0;
+        if (p[0] & 0x80) {
+            for (std::size_t i = 1; i < size; ++i) {
+                if (rv >> 56) {
+                    return false;
+                }
+                rv = (rv << 8) | p[i];
+            }
+            return true;
+        }
+        std::size_t i = 0;
+        while (i < size && p[i] == ' ') {
+            ++i;
+        }
+        for (; i < size && p[i] >= '0' && p[i] <= '7'; ++i) {
+            rv = (rv << 3) | (p[i] - '0');
+        }
+        return i == size || p[i] == ' ' || p[i] == '\0';
+    }
+
+    /** Check a header block's checksum */
+    bool
+    valid_header(const char *header)
+    {
+        uint64_t expected;
+        if (!field_number(header, tar_chksum, tar_chksum_size, expected)) {
+            return false;
+        }
+        uint64_t sum = 0;
+        for (std::size_t i = 0; i < tar_block_size; ++i) {
+            if (i >= tar_chksum && i < tar_chksum + tar_chksum_size) {
+                sum += ' ';
+            } else {
+                sum += static_cast<unsigned char>(header[i]);
+            }
+        }
+        return sum == expected;
+    }
+
+    bool
+    zero_block(const char *header)
+    {
+        for (std::size_t i = 0; i < tar_block_size; ++i) {
+            if (header[i] != '\0') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Split a pax extended header into its records
+     *
+     * Records look like "<length> <key>=<value>\n", where the length counts
+     * the whole record. Later records override earlier ones.
+     *
+     * @return true if all records are well-formed; false otherwise.
+     */
+    bool
+    pax_records(const TagLib::ByteVector &data,
+                std::map<std::string, std::string> &rv)
+    {
+        std::size_t pos = 0;
+        const std::size_t size = data.size();
+        while (pos < size) {
+            std::size_t length = 0;
+            std::size_t i = pos;
+            for (; i < size && data[i] >= '0' && data[i] <= '9'; ++i) {
+                length = length * 10 + (data[i] - '0');
+                if (length > size) {
+                    return false;
+                }
+            }
+            /* The length has to cover itself, the space and the newline. */
+            if (i >= size || data[i] != ' ' || length > size - pos
+                || length < i - pos + 2 || data[pos + length - 1] != '\n')
+            {
+                return false;
+            }
+            const std::string record(data.data() + i + 1,
+                                     pos + length - i - 2);
+            const std::size_t eq = record.find('=');
+            if (eq != std::string::npos) {
+                rv[record.substr(0, eq)] = record.substr(eq + 1);
+            }
+            pos += length;
+        }
+        return true;
+    }
+
+}
+
+namespace Amded {
+
+    TarReader::TarReader()
+        : fd(-1), owned(false), seekable(false), broken(false), remaining(0)
+    {
+    }
+
+    TarReader::~TarReader()
+    {
+        if (owned && fd >= 0) {
+            close(fd);
+        }
+    }
+
+    /**
+     * Get ready to read an archive
+     *
+     * @param   name    the archive's name; ‘-’ reads stdin
+     *
+     * @return true if the archive could be opened; false otherwise.
+     */
+    bool
+    TarReader::open(const std::string &name)
+    {
+        if (name == "-") {
+            fd = STDIN_FILENO;
+        } else {
+            fd = amded_open_read_only(name);
+            if (fd < 0) {
+                return false;
+            }
+            owned = true;
+        }
+        struct stat st;
+        seekable = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+        return true;
+    }
+
+    bool
+    TarReader::read_full(char *buf, std::size_t count)
+    {
+        std::size_t done = 0;
+        while (done < count) {
+            ssize_t rc = read(fd, buf + done, count - done);
+            if (rc < 0 && errno == EINTR) {
+                continue;
+            }
+            if (rc <= 0) {
+                return false;
+            }
+            done += rc;
+        }
+        return true;
+    }
+
+    bool
+    TarReader::skip(uint64_t count)
+    {
+        if (seekable) {
+            return lseek(fd, count, SEEK_CUR) >= 0;
+        }
+        char buf[64 * 1024];
+        while (count > 0) {
+            const std::size_t n = count < sizeof(buf) ? count : sizeof(buf);
+            if (!read_full(buf, n)) {
+                return false;
+            }
+            count -= n;
+        }
+        return true;
+    }
+
+    /**
+     * Check if an archive file has at least ‘count’ more bytes
+     *
+     * Archives, that are not files, cannot be checked; they run out of data
+     * while reading instead.
+     */
+    bool
+    TarReader::available(uint64_t count)
+    {
+        if (!seekable) {
+            return true;
+        }
+        struct stat st;
+        const off_t pos = lseek(fd, 0, SEEK_CUR);
+        return pos >= 0 && fstat(fd, &st) == 0 && pos <= st.st_size
+            && count <= static_cast<uint64_t>(st.st_size - pos);
+    }
+
+    /**
+     * Read a member's data, and skip its padding
+     *
+     * @param   size    the size of the member's data
+     * @param   rv      where to store the data
+     *
+     * @return true if the data was read; false if it could not be, or if it
+     *         is too large to be held in memory.
+     */
+    bool
+    TarReader::read_data(uint64_t size, TagLib::ByteVector &rv)
+    {
+        if (size > std::numeric_limits<unsigned int>::max()
+            || !available(size))
+        {
+            return false;
+        }
+        try {
+            rv.resize(size);
+        }
+        catch (const std::bad_alloc&) {
+            return false;
+        }
+        if (!read_full(rv.data(), size) || !skip(padded(size) - size)) {
+            return false;
+        }
+        remaining = 0;
+        return true;
+    }
+
+    /**
+     * Move on to the next member of the archive
+     *
+     * Data of the current member, that was not read, is skipped.
+     *
+     * @param   member  where to store the member's description
+     *
+     * @return true if there was another member; false at the end of the
+     *         archive, or if it is broken (see ‘is_broken()’).
+     */
+    bool
+    TarReader::next(TarMember &member)
+    {
+        std::string long_name, pax_name;
+        uint64_t pax_size = 0;
+        bool have_pax_size = false;
+
+        if (broken || fd < 0 || !skip(remaining)) {
+            broken = true;
+            return false;
+        }
+        remaining = 0;
+
+        for (;;) {
+            char header[tar_block_size];
+            if (!read_full(header, sizeof(header))) {
+                /* Archives missing their end blocks are common enough. */
+                return false;
+            }
+            if (zero_block(header)) {
+                return false;
+            }
+            if (!valid_header(header)) {
+                broken = true;
+                return false;
+            }
+
+            uint64_t size;
+            if (!field_number(header, tar_size, tar_size_size, size)) {
+                broken = true;
+                return false;
+            }
+            const char type = header[tar_typeflag];
+
+            if (type == 'g') {
+                /* Global pax headers carry nothing of interest here. */
+                if (!skip(padded(size))) {
+                    broken = true;
+                    return false;
+                }
+                continue;
+            }
+            if (type == 'L' || type == 'x') {
+                TagLib::ByteVector data;
+                if (size > tar_max_header_data || !read_data(size, data)) {
+                    broken = true;
+                    return false;
+                }
+                if (type == 'L') {
+                    long_name = std::string(data.data(),
+                                            strnlen(data.data(), size));
+                    continue;
+                }
+                std::map<std::string, std::string> records;
+                if (!pax_records(data, records)) {
+                    broken = true;
+                    return false;
+                }
+                auto iter = records.find("path");
+                if (iter != records.end()) {
+                    pax_name = iter->second;
+                }
+                iter = records.find("size");
+                if (iter != records.end()) {
+                    /* std::stoull() would wrap negative sizes around. */
+                    const std::string &value = iter->second;
+                    if (value.empty() || value[0] < '0' || value[0] > '9') {
+                        broken = true;
+                        return false;
+                    }
+                    try {
+                        pax_size = std::stoull(value);
+                        have_pax_size = true;
+                    }
+                    catch (const std::exception&) {
+                        broken = true;
+                        return false;
+                    }
+                }
+                continue;
+            }
+
+            if (!pax_name.empty()) {
+                member.name = pax_name;
+            } else if (!long_name.empty()) {
+                member.name = long_name;
+            } else {
+                member.name = field_string(header, tar_name, tar_name_size);
+                const std::string prefix =
+                    field_string(header, tar_prefix, tar_prefix_size);
+                if (memcmp(header + tar_magic, "ustar\0", 6) == 0
+                    && !prefix.empty())
+                {
+                    member.name = prefix + "/" + member.name;
+                }
+            }
+            member.size = have_pax_size ? pax_size : size;
+            member.regular = type == '0' || type == '\0' || type == '7';
+            remaining = padded(member.size);
+            return true;
+        }
+    }
+
+    /**
+     * Read the data of the current member
+     *
+     * @param   member  the member, that ‘next()’ returned last
+     * @param   rv      where to store the data
+     *
+     * @return true if the data was read; false if the archive is broken.
+     */
+    bool
+    TarReader::data(const TarMember &member, TagLib::ByteVector &rv)
+    {
+        if (!read_data(member.size, rv)) {
+            broken = true;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Tell if reading an archive stopped at a broken member
+     */
+    bool
+    TarReader::is_broken(void) const
+    {
+        return broken;
+    }
+
+}
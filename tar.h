@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file tar.h
+ * @brief API for reading tar archives sequentially
+ */
+
+#ifndef INC_TAR_H
+#define INC_TAR_H
+
+#include <cstdint>
+#include <string>
+
+#include <tbytevector.h>
+
+namespace Amded {
+
+    /** A member of a tar archive */
+    struct TarMember {
+        std::string name;
+        uint64_t size;
+        /** True for regular files; other members carry no data to list */
+        bool regular;
+    };
+
+    class TarReader {
+    private:
+        int fd;
+        bool owned;
+        bool seekable;
+        bool broken;
+        /** Bytes of the current member's data (and padding) not read yet */
+        uint64_t remaining;
+
+        bool read_full(char *, std::size_t);
+        bool skip(uint64_t);
+        bool available(uint64_t);
+        bool read_data(uint64_t, TagLib::ByteVector &);
+
+    public:
+        TarReader();
+        ~TarReader();
+
+        bool open(const std::string&);
+        bool next(TarMember&);
+        bool data(const TarMember&, TagLib::ByteVector&);
+        bool is_broken(void) const;
+    };
+
+}
+
+#endif /* INC_TAR_H */
@@ -0,0 +1,517 @@
+#!/usr/bin/env python3
+"""Generate audio files for amded's tests.
+
+The files are built byte by byte, without any audio tools: Their audio data
+is silence or noise in valid frames or packets, which is all TagLib and
+amded's native readers look at. Each file exercises one way of laying out
+tags, that the native readers have to handle exactly like TagLib does, or
+leave to TagLib.
+
+Usage: fixtures.py tags <directory>
+       fixtures.py copies <directory> <count> <name>
+       fixtures.py large-m4a <directory> <count> <mebibytes>
+       fixtures.py frames <directory> <frames> <count>
+       fixtures.py properties <directory> <mebibytes> <count>
+
+The "tags" set exercises the native readers; "copies" makes <count> hard
+links to file <name> of that set, for benchmarks over many files;
+"large-m4a" makes <count> M4A files with <mebibytes> of audio data in
+front of their ‘moov’ atom (as holes, where the file system allows);
+"frames" makes <count> mp3, FLAC, Ogg Vorbis and M4A files each, in
+subdirectories named after their extensions, with <frames> tag fields
+besides the usual ones; "properties" does the same with <mebibytes> of
+audio data per file.
+"""
+
+import os
+import struct
+import sys
+
+
+# ID3v2
+
+def syncsafe(n):
+    return bytes([(n >> 21) & 0x7f, (n >> 14) & 0x7f, (n >> 7) & 0x7f,
+                  n & 0x7f])
+
+
+def id3v2_frame(fid, data, version=4):
+    size = syncsafe(len(data)) if version == 4 else struct.pack('>I', len(data))
+    return fid + size + b'\0\0' + data
+
+
+def text_frame(fid, text, version=4):
+    # UTF-8 only exists in ID3v2.4; v2.3 gets UTF-16 with a BOM.
+    if version == 4:
+        data = b'\x03' + text.encode('utf-8')
+    else:
+        data = b'\x01' + text.encode('utf-16')
+    return id3v2_frame(fid, data, version)
+
+
+def txxx_frame(desc, text, version=4):
+    if version == 4:
+        data = b'\x03' + desc.encode('utf-8') + b'\0' + text.encode('utf-8')
+    else:
+        data = (b'\x01' + desc.encode('utf-16') + b'\0\0'
+                + text.encode('utf-16'))
+    return id3v2_frame(b'TXXX', data, version)
+
+
+def apic_frame(size, version=4):
+    data = b'\0image/jpeg\0\x03\0' + b'\xff\xd8' + b'\x55' * size
+    return id3v2_frame(b'APIC', data, version)
+
+
+def id3v2_tag(frames, version=4, padding=0, flags=0):
+    body = b''.join(frames) + b'\0' * padding
+    return (b'ID3' + bytes([version, 0, flags]) + syncsafe(len(body))
+            + body)
+
+
+def unsynchronise(data):
+    out = bytearray()
+    for i, c in enumerate(data):
+        out.append(c)
+        nxt = data[i + 1] if i + 1 < len(data) else 0
+        if c == 0xff and (nxt == 0 or nxt & 0xe0 == 0xe0):
+            out.append(0)
+    return bytes(out)
+
+
+def standard_frames(version=4, title='Fixture'):
+    return [
+        text_frame(b'TIT2', title, version),
+        text_frame(b'TPE1', 'Test Artist äöü', version),
+        text_frame(b'TALB', 'Test Album', version),
+        text_frame(b'TRCK', '3/12', version),
+        text_frame(b'TCON', 'Electronic', version),
+        text_frame(b'TDRC' if version == 4 else b'TYER', '2024', version),
+        txxx_frame('CATALOGNUMBER', 'CAT-0042', version),
+        txxx_frame('LABEL', 'Fixture Records', version),
+    ]
+
+
+# ID3v1 and APE
+
+def id3v1_tag(title='V1 Title', artist='V1 Artist'):
+    def field(s, n):
+        return s.encode('latin-1')[:n].ljust(n, b'\0')
+    return (b'TAG' + field(title, 30) + field(artist, 30)
+            + field('V1 Album', 30) + b'1999' + field('v1', 28)
+            + b'\0\x07' + b'\x0d')
+
+
+def ape_item(key, value):
+    v = value.encode('utf-8')
+    return struct.pack('<II', len(v), 0) + key.encode('ascii') + b'\0' + v
+
+
+def ape_tag(items):
+    body = b''.join(ape_item(k, v) for k, v in items)
+    size = len(body) + 32
+
+    def block(flags):
+        return (b'APETAGEX' + struct.pack('<IIII', 2000, size, len(items),
+                                          flags) + b'\0' * 8)
+    return block(0xa0000000) + body + block(0x80000000)
+
+
+# MPEG audio
+
+def mpeg_frames(count=40):
+    # MPEG-1 layer III, 128 kbit/s, 44.1 kHz, no padding: 417 bytes each.
+    header = b'\xff\xfb\x90\x64'
+    return (header + b'\0' * 413) * count
+
+
+# Xiph comments, FLAC and Ogg
+
+def xiph_comment(fields, vendor='amded fixtures'):
+    def string(s):
+        b = s.encode('utf-8')
+        return struct.pack('<I', len(b)) + b
+    return (string(vendor) + struct.pack('<I', len(fields))
+            + b''.join(string(k + '=' + v) for k, v in fields))
+
+
+def standard_fields(title='Fixture'):
+    return [('TITLE', title), ('ARTIST', 'Test Artist äöü'),
+            ('ALBUM', 'Test Album'), ('TRACKNUMBER', '3'),
+            ('TRACKTOTAL', '12'), ('GENRE', 'Electronic'), ('DATE', '2024'),
+            ('CATALOGNUMBER', 'CAT-0042'), ('LABEL', 'Fixture Records')]
+
+
+def flac_block(kind, data, last=False):
+    return (bytes([kind | (0x80 if last else 0)])
+            + struct.pack('>I', len(data))[1:] + data)
+
+
+def flac_streaminfo(rate=44100, channels=2, bits=16, samples=441000):
+    packed = ((rate << 44) | ((channels - 1) << 41) | ((bits - 1) << 36)
+              | samples)
+    return (struct.pack('>HH', 4096, 4096) + b'\0\0\x10' + b'\0\x20\0'
+            + struct.pack('>Q', packed) + bytes(range(16)))
+
+
+def flac_picture(size):
+    mime = b'image/jpeg'
+    return (struct.pack('>II', 3, len(mime)) + mime + struct.pack('>I', 0)
+            + struct.pack('>IIIII', 500, 500, 24, 0, size + 2)
+            + b'\xff\xd8' + b'\x55' * size)
+
+
+def flac_file(blocks, audio=8192):
+    # Blocks are (type, data) pairs; the last one gets flagged.
+    body = b''.join(flac_block(kind, data, i == len(blocks) - 1)
+                    for i, (kind, data) in enumerate(blocks))
+    return b'fLaC' + body + (b'\xff\xf8' + b'\x33' * 510) * (audio // 512)
+
+
+def ogg_crc_table():
+    table = []
+    for i in range(256):
+        crc = i << 24
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x04c11db7 if crc & 0x80000000
+                   else crc << 1) & 0xffffffff
+        table.append(crc)
+    return table
+
+
+OGG_CRC_TABLE = ogg_crc_table()
+
+
+def ogg_crc(data):
+    crc = 0
+    for c in data:
+        crc = ((crc << 8) & 0xffffffff) ^ OGG_CRC_TABLE[(crc >> 24) ^ c]
+    return crc
+
+
+def ogg_stream(groups, serial=0x414d4445):
+    """Lay out packets in Ogg pages.
+
+    Each group of packets starts on a new page, with the group's granule
+    position on the page finishing its last packet; packets larger than a
+    page continue on the following pages.
+    """
+    pages = []
+    for packets, granule in groups:
+        lacing = []
+        for p in packets:
+            lacing.append((len(p) // 255) * [255] + [len(p) % 255])
+        data = b''.join(packets)
+        segments = [s for lace in lacing for s in lace]
+        ends = set()
+        n = 0
+        for lace in lacing:
+            n += len(lace)
+            ends.add(n - 1)
+        start = 0
+        pos = 0
+        continued = False
+        while start < len(segments):
+            table = segments[start:start + 255]
+            size = sum(table)
+            done = any(i in ends for i in range(start, start + len(table)))
+            pages.append([continued, granule if done else (1 << 64) - 1,
+                          bytes(table), data[pos:pos + size]])
+            continued = (start + len(table) - 1) not in ends
+            start += len(table)
+            pos += size
+    out = b''
+    for seq, (continued, granule, table, data) in enumerate(pages):
+        flags = ((0x01 if continued else 0) | (0x02 if seq == 0 else 0)
+                 | (0x04 if seq == len(pages) - 1 else 0))
+        header = (b'OggS\0' + bytes([flags]) + struct.pack('<QIII', granule,
+                                                          serial, seq, 0)
+                  + bytes([len(table)]) + table)
+        page = header + data
+        crc = ogg_crc(page)
+        out += page[:22] + struct.pack('<I', crc) + page[26:]
+    return out
+
+
+def vorbis_file(fields, rate=44100, pages=5):
+    ident = (b'\x01vorbis' + struct.pack('<IBIiii', 0, 2, rate, 0, 128000, 0)
+             + b'\xb8\x01')
+    comment = b'\x03vorbis' + xiph_comment(fields) + b'\x01'
+    setup = b'\x05vorbis' + b'\x42' * 300
+    audio = [([b'\x00' + b'\x11' * 400] * 20, rate * (i + 1))
+             for i in range(pages)]
+    return ogg_stream([([ident], 0), ([comment, setup], 0)] + audio)
+
+
+def opus_file(fields):
+    head = b'OpusHead' + struct.pack('<BBHIhB', 1, 2, 312, 48000, 0, 0)
+    tags = b'OpusTags' + xiph_comment(fields)
+    audio = [([b'\xfc' + b'\x22' * 200] * 50, 48000 * (i + 1) + 312)
+             for i in range(5)]
+    return ogg_stream([([head], 0), ([tags], 0)] + audio)
+
+
+# MP4
+
+def atom(name, *payload):
+    data = b''.join(payload)
+    return struct.pack('>I', 8 + len(data)) + name + data
+
+
+def full_atom(name, *payload, version=0, flags=0):
+    return atom(name, struct.pack('>I', (version << 24) | flags), *payload)
+
+
+def mp4_data(kind, value):
+    return atom(b'data', struct.pack('>II', kind, 0), value)
+
+
+def mp4_text(name, text):
+    return atom(name, mp4_data(1, text.encode('utf-8')))
+
+
+def mp4_freeform(name, text):
+    return atom(b'----', full_atom(b'mean', b'com.apple.iTunes'),
+                full_atom(b'name', name.encode('ascii')),
+                mp4_data(1, text.encode('utf-8')))
+
+
+def mp4_items(title='Fixture', cover=0):
+    items = [
+        mp4_text(b'\xa9nam', title),
+        mp4_text(b'\xa9ART', 'Test Artist äöü'),
+        mp4_text(b'\xa9alb', 'Test Album'),
+        mp4_text(b'\xa9day', '2024'),
+        mp4_text(b'\xa9gen', 'Electronic'),
+        atom(b'trkn', mp4_data(0, struct.pack('>HHHH', 0, 3, 12, 0))),
+        mp4_freeform('CATALOGNUMBER', 'CAT-0042'),
+        mp4_freeform('LABEL', 'Fixture Records'),
+        mp4_freeform('MusicBrainz Track Id',
+                     '6f1a4e0b-8d2c-4b1e-9c3a-2f5d7e8a9b10'),
+    ]
+    if cover:
+        items.append(atom(b'covr', mp4_data(13, b'\xff\xd8'
+                                                + b'\x55' * cover)))
+    return items
+
+
+def mp4_moov(items, rate=44100, seconds=10):
+    duration = rate * seconds
+    mvhd = full_atom(b'mvhd', struct.pack('>IIII', 0, 0, rate, duration),
+                     struct.pack('>IH', 0x00010000, 0x0100), b'\0' * 10,
+                     struct.pack('>9I', 0x10000, 0, 0, 0, 0x10000, 0, 0, 0,
+                                 0x40000000),
+                     b'\0' * 24, struct.pack('>I', 2))
+    esds = full_atom(b'esds',
+                     b'\x03\x19\x00\x01\x00',
+                     b'\x04\x11\x40\x15\x00\x06\x00',
+                     struct.pack('>II', 130000, 128000),
+                     b'\x05\x02\x12\x10', b'\x06\x01\x02')
+    mp4a = atom(b'mp4a', b'\0' * 6, struct.pack('>H', 1), b'\0' * 8,
+                struct.pack('>HHHHI', 2, 16, 0, 0, rate << 16), esds)
+    stbl = atom(b'stbl', full_atom(b'stsd', struct.pack('>I', 1), mp4a),
+                full_atom(b'stts', struct.pack('>I', 0)),
+                full_atom(b'stsc', struct.pack('>I', 0)),
+                full_atom(b'stsz', struct.pack('>II', 0, 0)),
+                full_atom(b'stco', struct.pack('>I', 0)))
+    mdia = atom(b'mdia',
+                full_atom(b'mdhd', struct.pack('>IIIIHH', 0, 0, rate,
+                                               duration, 0x55c4, 0)),
+                full_atom(b'hdlr', b'\0' * 4, b'soun', b'\0' * 12, b'\0'),
+                atom(b'minf', full_atom(b'smhd', b'\0' * 4), stbl))
+    tkhd = full_atom(b'tkhd', struct.pack('>IIIII', 0, 0, 1, 0, duration),
+                     b'\0' * 8, struct.pack('>HHHH', 0, 0, 0x0100, 0),
+                     struct.pack('>9I', 0x10000, 0, 0, 0, 0x10000, 0, 0, 0,
+                                 0x40000000),
+                     b'\0' * 8, flags=7)
+    meta = full_atom(b'meta',
+                     full_atom(b'hdlr', b'\0' * 4, b'mdirappl', b'\0' * 9),
+                     atom(b'ilst', *items))
+    return atom(b'moov', mvhd, atom(b'trak', tkhd, mdia),
+                atom(b'udta', meta))
+
+
+def mp4_ftyp():
+    return atom(b'ftyp', b'M4A ', struct.pack('>I', 0), b'M4A mp42isom')
+
+
+def mp4_file(items, audio=16384, moov_first=False):
+    moov = mp4_moov(items)
+    mdat = atom(b'mdat', b'\x21' * audio)
+    if moov_first:
+        return mp4_ftyp() + moov + mdat
+    return mp4_ftyp() + mdat + moov
+
+
+def write_large_mp4(path, mebibytes, title):
+    # The audio data is left as a hole, so large files are cheap to make.
+    size = mebibytes * 1024 * 1024
+    with open(path, 'wb') as f:
+        f.write(mp4_ftyp() + struct.pack('>I', size + 8) + b'mdat')
+        f.seek(size, os.SEEK_CUR)
+        f.write(mp4_moov(mp4_items(title, cover=200000)))
+
+
+# Test sets
+
+def mp3_files():
+    audio = mpeg_frames()
+    yield 'v23-padded.mp3', (
+        id3v2_tag(standard_frames(3), version=3, padding=1024) + audio)
+    yield 'v24-nopad.mp3', (
+        id3v2_tag(standard_frames(4) + [apic_frame(70000)]) + audio)
+    # iTunes writes ID3v2.2 frame IDs into ID3v2.3 tags, padded with a NUL
+    # byte. TagLib converts those; native readers have to leave them to it.
+    yield 'v23-itunes.mp3', (
+        id3v2_tag([text_frame(b'TIT2', 'Before', 3),
+                   id3v2_frame(b'TT2\0', b'\0iTunes title', 3)]
+                  + standard_frames(3)[1:], version=3, padding=256)
+        + audio)
+    yield 'ape-id3v1.mp3', (
+        id3v2_tag(standard_frames(4), padding=100) + audio
+        + ape_tag([('Title', 'APE Title'), ('Artist', 'APE Artist'),
+                   ('Track', '7'), ('CATALOGNUMBER', 'APE-1')])
+        + id3v1_tag())
+    yield 'ape-only.mp3', (
+        id3v2_tag([], padding=64) + audio
+        + ape_tag([('Title', 'Only APE'), ('Year', '2001')]))
+    yield 'id3v1-only.mp3', audio + id3v1_tag()
+    frames = b''.join(standard_frames(3)) + id3v2_frame(
+        b'PRIV', b'owner\0\xff\xe0\xff\x00\xff', 3)
+    yield 'unsync.mp3', (
+        b'ID3\x03\x00\x80' + syncsafe(len(unsynchronise(frames)))
+        + unsynchronise(frames) + audio)
+    # A frame size running past the end of the tag
+    broken = bytearray(id3v2_tag(standard_frames(4), padding=32))
+    broken[10 + 4:10 + 8] = syncsafe(0x7ffff)
+    yield 'bad-size.mp3', bytes(broken) + audio
+
+
+def xiph_files():
+    info = (0, flac_streaminfo())
+    comment = (4, xiph_comment(standard_fields()))
+    yield 'basic.flac', flac_file([info, comment, (1, b'\0' * 4096)])
+    yield 'picture.flac', flac_file([info, (3, b''), (6, flac_picture(70000)),
+                                     comment, (1, b'\0' * 512)])
+    # Only the first comment block counts.
+    yield 'two-comments.flac', flac_file([
+        info, comment, (4, xiph_comment([('TITLE', 'Second block')]))])
+    yield 'no-comment.flac', flac_file([info, (1, b'\0' * 64)])
+    yield 'id3v1.flac', flac_file([info, comment]) + id3v1_tag()
+    # TagLib falls back to the ID3v1 tag, if the comment is empty.
+    yield 'empty-id3v1.flac', (flac_file([info, (4, xiph_comment([]))])
+                               + id3v1_tag())
+    # Larger than ‘max-frame-bytes=100000’ as a whole, but no field is.
+    big = standard_fields('Big') + [(k, c * 40000) for k, c in
+                                    (('COMMENT', 'a'), ('DESCRIPTION', 'b'),
+                                     ('LYRICS', 'c'))]
+    yield 'big-comment.flac', flac_file([info, (4, xiph_comment(big))])
+    yield 'mono-96k.flac', flac_file([(0, flac_streaminfo(96000, 1, 24,
+                                                         123456)), comment])
+
+    yield 'basic.ogg', vorbis_file(standard_fields())
+    # A comment packet spanning three pages
+    yield 'span.ogg', vorbis_file(standard_fields('Span') + [
+        ('METADATA_BLOCK_PICTURE', 'A' * 150000)])
+    yield 'basic.opus', opus_file(standard_fields())
+    yield 'span.opus', opus_file(standard_fields('Span')
+                                 + [('COMMENT', 'x' * 70000)])
+
+
+def mp4_files():
+    yield 'moov-last.m4a', mp4_file(mp4_items())
+    yield 'moov-first.m4a', mp4_file(mp4_items(), moov_first=True)
+    yield 'cover.m4a', mp4_file(mp4_items('Cover', cover=70000))
+    yield 'no-tags.m4a', mp4_file([])
+
+
+def frames_files(count):
+    """Files with <count> tag fields besides the standard ones."""
+    id3 = []
+    for i in range(count):
+        if i % 4 == 0:
+            id3.append(id3v2_frame(b'PRIV', b'owner%d\0' % i + b'\x01' * 64))
+        elif i % 4 == 1:
+            id3.append(id3v2_frame(b'COMM', b'\x03eng' + b'note %d\0' % i
+                                   + b'comment text' * 4))
+        else:
+            id3.append(txxx_frame('EXTRA %d' % i, ('value %d ' % i) * 4))
+    yield 'frames.mp3', (id3v2_tag(standard_frames(4) + id3, padding=1024)
+                         + mpeg_frames())
+    fields = standard_fields() + [('EXTRA%d' % i, ('value %d ' % i) * 4)
+                                  for i in range(count)]
+    yield 'frames.flac', flac_file([(0, flac_streaminfo()),
+                                    (4, xiph_comment(fields))])
+    yield 'frames.ogg', vorbis_file(fields)
+    yield 'frames.m4a', mp4_file(mp4_items() + [
+        mp4_freeform('EXTRA %d' % i, ('value %d ' % i) * 4)
+        for i in range(count)])
+
+
+def properties_files(mebibytes):
+    """Files with about <mebibytes> of audio data, and no shortcuts to
+    their properties: The mp3 file has no Xing header, the Ogg file's
+    length is only found on its last page."""
+    size = mebibytes * 1024 * 1024
+    yield 'long.mp3', id3v2_tag(standard_frames(4)) + mpeg_frames(size // 417)
+    yield 'long.flac', flac_file([(0, flac_streaminfo()),
+                                  (4, xiph_comment(standard_fields()))],
+                                 audio=size)
+    yield 'long.ogg', vorbis_file(standard_fields(), pages=size // 8020)
+    yield 'long.m4a', mp4_file(mp4_items(), audio=size)
+
+
+def write_set(directory, files):
+    os.makedirs(directory, exist_ok=True)
+    for name, data in files:
+        with open(os.path.join(directory, name), 'wb') as f:
+            f.write(data)
+
+
+def write_copies(directory, count, name, data):
+    ext = os.path.splitext(name)[1]
+    first = None
+    for i in range(count):
+        # File systems limit the number of links to a file (ext4: 65000).
+        if i % 50000 == 0:
+            first = str(i) + ext
+            write_set(directory, [(first, data)])
+        else:
+            os.link(os.path.join(directory, first),
+                    os.path.join(directory, str(i) + ext))
+
+
+def main(argv):
+    if len(argv) == 3 and argv[1] == 'tags':
+        write_set(argv[2], mp3_files())
+        write_set(argv[2], xiph_files())
+        write_set(argv[2], mp4_files())
+        return 0
+    if len(argv) == 5 and argv[1] == 'copies':
+        files = dict(mp3_files())
+        files.update(xiph_files())
+        files.update(mp4_files())
+        write_copies(argv[2], int(argv[3]), argv[4], files[argv[4]])
+        return 0
+    if len(argv) == 5 and argv[1] == 'frames':
+        for name, data in frames_files(int(argv[3])):
+            write_copies(os.path.join(argv[2], name.split('.')[1]),
+                         int(argv[4]), name, data)
+        return 0
+    if len(argv) == 5 and argv[1] == 'properties':
+        for name, data in properties_files(int(argv[3])):
+            write_copies(os.path.join(argv[2], name.split('.')[1]),
+                         int(argv[4]), name, data)
+        return 0
+    if len(argv) == 5 and argv[1] == 'large-m4a':
+        os.makedirs(argv[2], exist_ok=True)
+        for i in range(int(argv[3])):
+            write_large_mp4(os.path.join(argv[2], '%d.m4a' % i),
+                            int(argv[4]), 'Large %d' % i)
+        return 0
+    sys.stderr.write(__doc__)
+    return 1
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
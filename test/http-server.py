@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Serve files for amded's HTTP tests (see http.sh).
+
+Files are served from a directory. The first component of a request's path
+picks the way the server behaves, the rest names the file:
+
+  /keep-alive/NAME     range requests; the connection stays open
+  /close/NAME          range requests; "Connection: close" on every response
+  /drop/NAME           range requests; the connection is closed after each
+                       response, without telling the client
+  /ignore-ranges/NAME  the whole file, with status 200
+  /chunked/NAME        range requests; bodies in chunked transfer coding
+  /http10/NAME         range requests, answered in HTTP/1.0 without a
+                       length: the body ends with the connection
+
+The server listens on 127.0.0.1, on a free port, which it prints on its
+first line of output. It logs requests as "MODE CLIENT-PORT FIRST-LAST"
+lines to standard output, and runs until it is killed.
+
+Usage: http-server.py <directory>
+"""
+
+import http.server
+import os
+import re
+import socketserver
+import sys
+
+MODES = ('keep-alive', 'close', 'drop', 'ignore-ranges', 'chunked', 'http10')
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def do_GET(self):
+        parts = self.path.lstrip('/').split('/', 1)
+        if len(parts) != 2 or parts[0] not in MODES or '..' in parts[1]:
+            self.send_error(404)
+            return
+        mode, name = parts
+        try:
+            with open(os.path.join(self.server.root, name), 'rb') as f:
+                data = f.read()
+        except OSError:
+            self.send_error(404)
+            return
+
+        status = 200
+        first, last = 0, len(data) - 1
+        match = re.fullmatch(r'bytes=(\d+)-(\d*)',
+                             self.headers.get('Range', ''))
+        if match and mode != 'ignore-ranges':
+            first = int(match.group(1))
+            if match.group(2):
+                last = min(int(match.group(2)), len(data) - 1)
+            if first >= len(data):
+                self.send_response(416)
+                self.send_header('Content-Range', 'bytes */%d' % len(data))
+                self.send_header('Content-Length', '0')
+                self.end_headers()
+                return
+            status = 206
+        body = data[first:last + 1]
+        print('%s %d %d-%d' % (mode, self.client_address[1], first, last),
+              flush=True)
+
+        if mode == 'http10':
+            self.protocol_version = 'HTTP/1.0'
+        self.send_response(status)
+        if status == 206:
+            self.send_header('Content-Range',
+                             'bytes %d-%d/%d' % (first, last, len(data)))
+        if mode == 'chunked':
+            self.send_header('Transfer-Encoding', 'chunked')
+        elif mode != 'http10':
+            self.send_header('Content-Length', str(len(body)))
+        if mode == 'close':
+            self.send_header('Connection', 'close')
+        self.end_headers()
+
+        if mode == 'chunked':
+            # Chunks of odd sizes, with a chunk extension and a trailer
+            pos = 0
+            while pos < len(body):
+                chunk = body[pos:pos + 1000 + pos % 7]
+                self.wfile.write(b'%x;x=y\r\n' % len(chunk) + chunk + b'\r\n')
+                pos += len(chunk)
+            self.wfile.write(b'0\r\nX-Trailer: 1\r\n\r\n')
+        else:
+            self.wfile.write(body)
+        if mode in ('close', 'drop', 'http10'):
+            self.close_connection = True
+
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+
+
+def main(argv):
+    if len(argv) != 2:
+        sys.stderr.write(__doc__)
+        return 1
+    server = Server(('127.0.0.1', 0), Handler)
+    server.root = argv[1]
+    print(server.server_address[1], flush=True)
+    server.serve_forever()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
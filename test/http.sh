@@ -0,0 +1,84 @@
+#!/bin/sh
+# Test of reading http:// URLs (see http-stream.cpp)
+#
+# Serves generated files (see fixtures.py) with http-server.py, in each of
+# its modes, and fails if listing them by URL differs from listing them
+# locally, or if anything is reported on standard error. Small blocks make
+# for many range requests per file.
+#
+# Usage: http.sh [path-to-amded]
+
+amded_="${1:-./amded}"
+here_="$(dirname "$0")"
+dir_="$(mktemp -d)" || exit 1
+server_=''
+trap 'test -n "${server_}" && kill "${server_}"; rm -rf "${dir_}"' EXIT
+trap 'exit 1' INT TERM
+
+python3 "${here_}/fixtures.py" tags "${dir_}/files" || exit 1
+python3 "${here_}/http-server.py" "${dir_}/files" > "${dir_}/log" &
+server_="$!"
+
+port_=''
+tries_=0
+while [ -z "${port_}" ]; do
+    tries_=$((tries_ + 1))
+    if [ "${tries_}" -gt 50 ]; then
+        printf 'FAIL: http-server.py did not start\n'
+        exit 1
+    fi
+    sleep 0.1
+    port_="$(head -n 1 "${dir_}/log")"
+done
+
+failed_=0
+
+# check_ <mode> <amded-args>
+check_ () {
+    mode_="$1"
+    base_="http://127.0.0.1:${port_}/${mode_}"
+    urls_=''
+    for file_ in "${dir_}"/files/*; do
+        urls_="${urls_} ${base_}/${file_##*/}"
+    done
+    # shellcheck disable=SC2086
+    "${amded_}" $2 "${dir_}"/files/* > "${dir_}/local" 2>&1
+    # shellcheck disable=SC2086
+    "${amded_}" $2 ${urls_} 2> "${dir_}/errors" \
+        | sed -e "s|${base_}/|${dir_}/files/|g" > "${dir_}/remote"
+    if [ -s "${dir_}/errors" ]; then
+        printf 'FAIL: %s %s\n' "${mode_}" "$2"
+        head -n 20 "${dir_}/errors"
+        failed_=1
+    elif cmp -s "${dir_}/local" "${dir_}/remote"; then
+        printf 'ok:   %s %s\n' "${mode_}" "$2"
+    else
+        printf 'FAIL: %s %s\n' "${mode_}" "$2"
+        diff "${dir_}/local" "${dir_}/remote" | head -n 20
+        failed_=1
+    fi
+}
+
+for mode_ in keep-alive close drop ignore-ranges chunked http10; do
+    check_ "${mode_}" "-j -o io-block-size=4096"
+    check_ "${mode_}" "-m -o io-block-size=1000,no-properties"
+done
+
+# With keep-alive, the requests for one file share a connection: There is
+# one connection per file and run, but more requests.
+files_="$(ls "${dir_}/files" | wc -l)"
+requests_="$(grep -c '^keep-alive ' "${dir_}/log")"
+connections_="$(grep '^keep-alive ' "${dir_}/log" | cut -d ' ' -f 2 \
+                | sort -u | wc -l)"
+if [ "${connections_}" -gt $((2 * files_)) ] \
+   || [ "${requests_}" -le "${connections_}" ]
+then
+    printf 'FAIL: %s keep-alive requests on %s connections\n' \
+           "${requests_}" "${connections_}"
+    failed_=1
+else
+    printf 'ok:   %s keep-alive requests on %s connections\n' \
+           "${requests_}" "${connections_}"
+fi
+
+exit "${failed_}"
@@ -0,0 +1,78 @@
+#!/bin/sh
+# Differential test of amded's native tag readers (see native.cpp)
+#
+# Lists generated files (see fixtures.py) with the native readers and the
+# usual way, through TagLib, and fails if the outputs differ in any way, or
+# if ‘native-verify’ reports a difference. Files, that native readers leave
+# to TagLib, are part of the set, too: Their output has to match as well.
+#
+# Usage: native-diff.sh [path-to-amded]
+
+amded_="${1:-./amded}"
+here_="$(dirname "$0")"
+dir_="$(mktemp -d)" || exit 1
+trap 'rm -rf "${dir_}"' EXIT INT TERM
+
+python3 "${here_}/fixtures.py" tags "${dir_}/files" || exit 1
+
+failed_=0
+
+# compare_ <description> <usual-args> <native-args>
+compare_ () {
+    desc_="$1"
+    # shellcheck disable=SC2086
+    "${amded_}" $2 "${dir_}"/files/* > "${dir_}/usual" 2>&1
+    # shellcheck disable=SC2086
+    "${amded_}" $3 "${dir_}"/files/* > "${dir_}/native" 2>&1
+    if cmp -s "${dir_}/usual" "${dir_}/native"; then
+        printf 'ok:   %s\n' "${desc_}"
+    else
+        printf 'FAIL: %s\n' "${desc_}"
+        diff "${dir_}/usual" "${dir_}/native" | head -n 20
+        failed_=1
+    fi
+}
+
+# verify_ <description> <args>
+verify_ () {
+    desc_="$1"
+    # shellcheck disable=SC2086
+    "${amded_}" $2 "${dir_}"/files/* > /dev/null 2> "${dir_}/verify"
+    if [ -s "${dir_}/verify" ]; then
+        printf 'FAIL: %s\n' "${desc_}"
+        head -n 20 "${dir_}/verify"
+        failed_=1
+    else
+        printf 'ok:   %s\n' "${desc_}"
+    fi
+}
+
+# Native readers only read mp3, mp4 and Ogg files, if audio properties are
+# not listed; hence ‘no-properties’ or -F in most runs. The FLAC reader
+# produces properties, too; runs without ‘no-properties’ compare those.
+for mode_ in -m -j; do
+    for params_ in no-properties no-properties,show-empty \
+                   no-properties,json-dont-use-base64 show-empty; do
+        compare_ "${mode_} ${params_}" \
+                 "${mode_} -o ${params_}" \
+                 "${mode_} -o native-readers,${params_}"
+    done
+    for map_ in mp3=apetag mp3=id3v1 mp3=apetag,id3v1,id3v2; do
+        compare_ "${mode_} -R ${map_}" \
+                 "${mode_} -R ${map_} -o no-properties" \
+                 "${mode_} -R ${map_} -o native-readers,no-properties"
+    done
+    compare_ "${mode_} max-frame-bytes=100000" \
+             "${mode_} -o no-properties" \
+             "${mode_} -o max-frame-bytes=100000,no-properties"
+    compare_ "${mode_} -F artist,catalog-number,tag-types" \
+             "${mode_} -F artist,catalog-number,tag-types" \
+             "${mode_} -F artist,catalog-number,tag-types -o native-readers"
+done
+
+verify_ "native-verify" "-j -o native-verify,no-properties"
+verify_ "native-verify properties" "-j -o native-verify"
+verify_ "native-verify -R mp3=apetag" \
+        "-j -R mp3=apetag -o native-verify,no-properties"
+
+exit "${failed_}"
@@ -17,6 +17,30 @@
 
 using stdstring = TagLib::String;
 
+bool
+Value::operator==(const Value &other) const
+{
+    if (type != other.type) {
+        return false;
+    }
+    switch (type) {
+    case TAG_BOOLEAN:
+        return b == other.b;
+    case TAG_INTEGER:
+        return i == other.i;
+    case TAG_STRING:
+        return s == other.s;
+    default:
+        return true;
+    }
+}
+
+bool
+Value::operator!=(const Value &other) const
+{
+    return !(*this == other);
+}
+
 enum tag_type
 Value::get_type(void) const
 {
@@ -56,6 +56,10 @@ public:
     Value(Value&&) noexcept;
     Value& operator=(Value&&) noexcept;
 
+    /* comparison */
+    bool operator==(const Value&) const;
+    bool operator!=(const Value&) const;
+
     enum tag_type get_type() const;
     bool get_bool() const;
     int get_int() const;
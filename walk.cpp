@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file walk.cpp
+ * @brief Walking directory trees in search of audio files
+ *
+ * With ‘-r’, directories among the files to process are searched
+ * recursively, for files with an extension amded supports.
+ *
+ * Directories are read using getdents64(2) with large buffers, relative to
+ * the file descriptor of their parent directory. The type of an entry is
+ * taken from its ‘d_type’ field, and files are matched against the supported
+ * extensions by name only. Thus, in the common case, no file in the tree is
+ * ever stat(2)ed or opened by the walker. Only file systems that do not fill
+ * in ‘d_type’ make the walker fall back to fstatat(2), and only for entries
+ * without a supported extension, which might be directories. Entries with
+ * one are taken for files right away there, so directories named like audio
+ * files are not searched on those file systems.
+ *
+ * Entries are returned in the order the file system supplies them in, just
+ * like find(1) does. Symbolic links to directories are not followed.
+ *
+ * The walker comes in two flavours: The default one runs in the calling
+ * thread and produces one file per call, keeping only a stack of open
+ * directories around. With the ‘walk-threads’ parameter, a number of threads
+ * read directories concurrently instead, which helps with wide trees on
+ * storage with high latency. In that case, the order of files is not
+ * deterministic.
+ */
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "amded.h"
+#include "file-spec.h"
+#include "walk.h"
+
+/** Size of the buffer used for each getdents64(2) call */
+#define WALK_BUFFER_SIZE (64 * 1024)
+
+/** Number of found files the walker threads may queue up */
+#define WALK_QUEUE_SIZE 4096
+
+/** Directory entry, as returned by the getdents64 system call */
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+enum walk_entry {
+    WALK_SKIP,
+    WALK_DIR,
+    WALK_FILE
+};
+
+static enum walk_entry
+classify(int dirfd, const struct linux_dirent64 *e)
+{
+    const char *n = e->d_name;
+    unsigned char type = e->d_type;
+
+    if (n[0] == '.' && (n[1] == 0 || (n[1] == '.' && n[2] == 0))) {
+        return WALK_SKIP;
+    }
+    const bool audio = get_ext_type(n) != FILE_T_INVALID;
+    if (type == DT_UNKNOWN && audio) {
+        return WALK_FILE;
+    }
+    if (type == DT_UNKNOWN) {
+        struct stat st;
+        if (fstatat(dirfd, n, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+            return WALK_SKIP;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            type = DT_DIR;
+        } else if (S_ISREG(st.st_mode)) {
+            type = DT_REG;
+        } else if (S_ISLNK(st.st_mode)) {
+            type = DT_LNK;
+        }
+    }
+    if (type == DT_DIR) {
+        return WALK_DIR;
+    }
+    if ((type == DT_REG || type == DT_LNK) && audio) {
+        return WALK_FILE;
+    }
+    return WALK_SKIP;
+}
+
+/**
+ * Open a directory to walk
+ *
+ * Symbolic links are only followed for the root of a walk, which the user
+ * named: Links to directories found while walking are not.
+ */
+static int
+open_dir(int dirfd, const std::string &name, bool root)
+{
+    int fd = openat(dirfd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC
+                    | (root ? 0 : O_NOFOLLOW));
+    if (fd < 0) {
+        std::cerr << PROJECT ": Could not open directory `" << name << "': "
+                  << strerror(errno) << std::endl;
+    }
+    return fd;
+}
+
+/**
+ * Read the next batch of a directory's entries
+ *
+ * @return the number of bytes of entries read; zero at the end of the
+ *         directory, or if it could not be read.
+ * @sideeffects Prints a diagnostic to stderr on failure.
+ */
+static long
+read_dir(int fd, const std::string &path, std::vector<char> &buf)
+{
+    long rv = syscall(SYS_getdents64, fd, buf.data(), buf.size());
+    if (rv < 0) {
+        std::cerr << PROJECT ": Could not read directory `" << path << "': "
+                  << strerror(errno) << std::endl;
+        return 0;
+    }
+    return rv;
+}
+
+static std::string
+join_path(const std::string &dir, const char *name)
+{
+    std::string rv;
+    rv.reserve(dir.size() + strlen(name) + 1);
+    rv = dir;
+    if (rv.empty() || rv.back() != '/') {
+        rv += '/';
+    }
+    rv += name;
+    return rv;
+}
+
+namespace {
+
+/** Walker, that runs in the calling thread */
+class SerialWalker : public Amded::DirWalker {
+public:
+    SerialWalker(const std::string &root) {
+        push(AT_FDCWD, root, root, true);
+    };
+
+    ~SerialWalker() {
+        for (auto &iter : stack) {
+            close(iter.fd);
+        }
+    };
+
+    bool next(std::string &name) override;
+
+private:
+    struct frame {
+        int fd;
+        std::string path;
+        std::vector<char> buf;
+        long pos;
+        long len;
+    };
+    std::vector<frame> stack;
+
+    void
+    push(int dirfd, const std::string &name, const std::string &path,
+         bool root = false)
+    {
+        int fd = open_dir(dirfd, name, root);
+        if (fd >= 0) {
+            stack.push_back({ fd, path, std::vector<char>(WALK_BUFFER_SIZE),
+                              0, 0 });
+        }
+    };
+};
+
+bool
+SerialWalker::next(std::string &name)
+{
+    while (!stack.empty()) {
+        frame &d = stack.back();
+        if (d.pos >= d.len) {
+            d.len = read_dir(d.fd, d.path, d.buf);
+            d.pos = 0;
+            if (d.len <= 0) {
+                close(d.fd);
+                stack.pop_back();
+            }
+            continue;
+        }
+
+        auto *e = reinterpret_cast<struct linux_dirent64 *>(
+            d.buf.data() + d.pos);
+        d.pos += e->d_reclen;
+
+        switch (classify(d.fd, e)) {
+        case WALK_DIR: {
+            std::string path = join_path(d.path, e->d_name);
+            /* ‘d’ is invalid after this. */
+            push(d.fd, e->d_name, path);
+            break;
+        }
+        case WALK_FILE:
+            name = join_path(d.path, e->d_name);
+            return true;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+/** Walker, that reads directories using a number of threads */
+class ThreadedWalker : public Amded::DirWalker {
+public:
+    ThreadedWalker(const std::string &root, unsigned int n) : root(root) {
+        dirs.push_back(root);
+        for (unsigned int i = 0; i < n; ++i) {
+            threads.emplace_back([this] { work(); });
+        }
+    };
+
+    ~ThreadedWalker() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
+        }
+        have_dirs.notify_all();
+        have_space.notify_all();
+        for (auto &iter : threads) {
+            iter.join();
+        }
+    };
+
+    bool next(std::string &name) override;
+
+private:
+    const std::string root;
+    std::deque<std::string> dirs;
+    std::deque<std::string> found;
+    std::size_t busy = 0;
+    bool stop = false;
+    std::mutex lock;
+    std::condition_variable have_dirs;
+    std::condition_variable have_found;
+    std::condition_variable have_space;
+    std::vector<std::thread> threads;
+
+    bool
+    finished(void) const
+    {
+        return busy == 0 && dirs.empty();
+    };
+
+    void work(void);
+    void walk_one(const std::string &, std::vector<char> &);
+};
+
+void
+ThreadedWalker::work(void)
+{
+    std::vector<char> buf(WALK_BUFFER_SIZE);
+    std::unique_lock<std::mutex> guard(lock);
+
+    for (;;) {
+        have_dirs.wait(guard, [this] {
+            return stop || !dirs.empty() || finished();
+        });
+        if (stop || dirs.empty()) {
+            return;
+        }
+        std::string dir = std::move(dirs.front());
+        dirs.pop_front();
+        ++busy;
+        guard.unlock();
+
+        walk_one(dir, buf);
+
+        guard.lock();
+        --busy;
+        if (finished()) {
+            have_dirs.notify_all();
+            have_found.notify_all();
+        }
+    }
+}
+
+void
+ThreadedWalker::walk_one(const std::string &dir, std::vector<char> &buf)
+{
+    /* Subdirectories' paths are always longer than the root's. */
+    int fd = open_dir(AT_FDCWD, dir, dir == root);
+    if (fd < 0) {
+        return;
+    }
+
+    long len;
+    while ((len = read_dir(fd, dir, buf)) > 0) {
+        std::vector<std::string> files, subdirs;
+        for (long pos = 0; pos < len;) {
+            auto *e = reinterpret_cast<struct linux_dirent64 *>(
+                buf.data() + pos);
+            pos += e->d_reclen;
+            switch (classify(fd, e)) {
+            case WALK_DIR:
+                subdirs.push_back(join_path(dir, e->d_name));
+                break;
+            case WALK_FILE:
+                files.push_back(join_path(dir, e->d_name));
+                break;
+            default:
+                break;
+            }
+        }
+
+        std::unique_lock<std::mutex> guard(lock);
+        for (auto &iter : subdirs) {
+            dirs.push_back(std::move(iter));
+        }
+        if (!subdirs.empty()) {
+            have_dirs.notify_all();
+        }
+        for (auto &iter : files) {
+            have_space.wait(guard, [this] {
+                return stop || found.size() < WALK_QUEUE_SIZE;
+            });
+            if (stop) {
+                break;
+            }
+            found.push_back(std::move(iter));
+            have_found.notify_one();
+        }
+        if (stop) {
+            break;
+        }
+    }
+    close(fd);
+}
+
+bool
+ThreadedWalker::next(std::string &name)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    have_found.wait(guard, [this] {
+        return !found.empty() || finished();
+    });
+    if (found.empty()) {
+        return false;
+    }
+    name = std::move(found.front());
+    found.pop_front();
+    have_space.notify_one();
+    return true;
+}
+
+} /* anonymous namespace */
+
+Amded::DirWalker::~DirWalker() = default;
+
+/**
+ * Start walking a directory tree
+ *
+ * @param  root     directory to start in
+ * @param  threads  number of threads to read directories with; zero or one
+ *                  means to walk the tree in the calling thread
+ *
+ * @return A walker, that returns the names of all supported files in ‘root’
+ *         and its subdirectories.
+ */
+std::unique_ptr<Amded::DirWalker>
+new_dir_walker(const std::string &root, unsigned int threads)
+{
+    if (threads > 1) {
+        return std::make_unique<ThreadedWalker>(root, threads);
+    }
+    return std::make_unique<SerialWalker>(root);
+}
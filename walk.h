@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2025 amded workers, All rights reserved.
+ * Terms for redistribution and use can be found in LICENCE.
+ */
+
+/**
+ * @file walk.h
+ * @brief API for walking directory trees in search of audio files
+ */
+
+#ifndef INC_WALK_H
+#define INC_WALK_H
+
+#include <memory>
+#include <string>
+
+namespace Amded {
+
+    class DirWalker {
+    public:
+        virtual ~DirWalker();
+
+        /** Fetch the next file; false when the tree is exhausted. */
+        virtual bool next(std::string&) = 0;
+    };
+
+}
+
+std::unique_ptr<Amded::DirWalker> new_dir_walker(const std::string&,
+                                                 unsigned int);
+
+#endif /* INC_WALK_H */